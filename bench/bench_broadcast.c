@@ -0,0 +1,262 @@
+#include "ow18b.h"
+#include "ow18b_broadcast.h"
+
+#include <math.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+//The capacity of the ring and the number of samples per run:
+#define BENCH_CAPACITY 4096
+#define BENCH_SAMPLE_COUNT (1 << 20)
+
+//How many samples are published resp. polled at once:
+#define BENCH_CHUNK_LENGTH 64
+
+//How many subscriber threads read along in the fan-out measurement:
+#define BENCH_SUBSCRIBER_COUNT 3
+
+//How many runs per measurement (the best one counts):
+#define BENCH_RUN_COUNT 8
+
+//A subscriber thread that polls until the publisher is done:
+typedef struct __bench_subscriber_t__
+{
+	ow_broadcast_t* broadcast;
+	bool* is_done;
+
+	//The subscription is taken before the thread starts, so no sample is missed by accident:
+	ow_subscriber_t subscriber;
+
+	//Samples that came out of order (must stay zero):
+	uint64_t misordered;
+} bench_subscriber_t;
+
+//Monotonic time in nanoseconds:
+static double bench_now_ns(void);
+
+//Fill samples with consecutive sequence numbers (in the magnitude and the timestamp):
+static void bench_fill(ow_sample_t* samples, size_t count);
+
+//Publish and poll in a single thread resp. publish while subscriber threads read along.
+//Return the best time per sample.
+static double bench_publish_poll(ow_sample_t* samples, double* poll_ns);
+static double bench_fan_out(ow_sample_t* samples, bench_subscriber_t* subscribers);
+
+//The subscriber thread:
+static void* bench_subscriber_run(void* context);
+
+static double bench_now_ns(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (double)now.tv_sec * 1e9 + (double)now.tv_nsec;
+}
+
+static void bench_fill(ow_sample_t* samples, size_t count)
+{
+	for (size_t i = 0; i < count; i++)
+	{
+		memset(&samples[i], 0, sizeof(ow_sample_t));
+
+		samples[i].unit = OW_UNIT_VOLT;
+		samples[i].magnitude = (uint16_t)i;
+		samples[i].timestamp.tv_sec = (time_t)i;
+	}
+}
+
+static double bench_publish_poll(ow_sample_t* samples, double* poll_ns)
+{
+	double best_publish = INFINITY;
+	double best_poll = INFINITY;
+
+	for (int run = 0; run < BENCH_RUN_COUNT; run++)
+	{
+		ow_broadcast_t* broadcast = ow_broadcast_create(BENCH_CAPACITY);
+
+		if (!broadcast)
+		{
+			return NAN;
+		}
+
+		ow_subscriber_t subscriber;
+		ow_broadcast_subscribe(broadcast, &subscriber);
+
+		ow_sample_t polled[BENCH_CHUNK_LENGTH];
+		double publish = 0.0;
+		double poll = 0.0;
+
+		for (size_t i = 0; i < BENCH_SAMPLE_COUNT; i += BENCH_CHUNK_LENGTH)
+		{
+			double start = bench_now_ns();
+			ow_broadcast_publish(broadcast, &samples[i % BENCH_CAPACITY], BENCH_CHUNK_LENGTH);
+			double middle = bench_now_ns();
+			size_t count = ow_subscriber_poll(&subscriber, polled, BENCH_CHUNK_LENGTH);
+			double end = bench_now_ns();
+
+			publish += middle - start;
+			poll += end - middle;
+
+			if ((count != BENCH_CHUNK_LENGTH) || (polled[0].magnitude != samples[i % BENCH_CAPACITY].magnitude))
+			{
+				ow_broadcast_destroy(broadcast);
+				return NAN;
+			}
+		}
+
+		ow_broadcast_destroy(broadcast);
+
+		if (publish < best_publish)
+		{
+			best_publish = publish;
+		}
+
+		if (poll < best_poll)
+		{
+			best_poll = poll;
+		}
+	}
+
+	*poll_ns = best_poll / BENCH_SAMPLE_COUNT;
+	return best_publish / BENCH_SAMPLE_COUNT;
+}
+
+static double bench_fan_out(ow_sample_t* samples, bench_subscriber_t* subscribers)
+{
+	double best = INFINITY;
+
+	for (int run = 0; run < BENCH_RUN_COUNT; run++)
+	{
+		ow_broadcast_t* broadcast = ow_broadcast_create(BENCH_CAPACITY);
+
+		if (!broadcast)
+		{
+			return NAN;
+		}
+
+		bool is_done = false;
+		pthread_t threads[BENCH_SUBSCRIBER_COUNT];
+
+		for (size_t i = 0; i < BENCH_SUBSCRIBER_COUNT; i++)
+		{
+			subscribers[i].broadcast = broadcast;
+			subscribers[i].is_done = &is_done;
+			subscribers[i].misordered = 0;
+			ow_broadcast_subscribe(broadcast, &subscribers[i].subscriber);
+
+			if (pthread_create(&threads[i], NULL, bench_subscriber_run, &subscribers[i]) != 0)
+			{
+				return NAN;
+			}
+		}
+
+		//Publish in chunks like a batch receive loop does:
+		double start = bench_now_ns();
+
+		for (size_t i = 0; i < BENCH_SAMPLE_COUNT; i += BENCH_CHUNK_LENGTH)
+		{
+			ow_broadcast_publish(broadcast, &samples[i], BENCH_CHUNK_LENGTH);
+		}
+
+		double ns = bench_now_ns() - start;
+
+		__atomic_store_n(&is_done, true, __ATOMIC_RELEASE);
+
+		for (size_t i = 0; i < BENCH_SUBSCRIBER_COUNT; i++)
+		{
+			pthread_join(threads[i], NULL);
+		}
+
+		ow_broadcast_destroy(broadcast);
+
+		for (size_t i = 0; i < BENCH_SUBSCRIBER_COUNT; i++)
+		{
+			//Every sample is either received or dropped, and never out of order:
+			const ow_subscriber_t* subscriber = &subscribers[i].subscriber;
+
+			if ((subscribers[i].misordered != 0) || ((subscriber->received + subscriber->dropped) != BENCH_SAMPLE_COUNT))
+			{
+				return NAN;
+			}
+		}
+
+		if (ns < best)
+		{
+			best = ns;
+		}
+	}
+
+	return best / BENCH_SAMPLE_COUNT;
+}
+
+static void* bench_subscriber_run(void* context)
+{
+	bench_subscriber_t* subscriber = context;
+	ow_sample_t polled[BENCH_CHUNK_LENGTH];
+	time_t last = -1;
+
+	while (true)
+	{
+		//Check before polling, so the last samples aren't missed:
+		bool is_done = __atomic_load_n(subscriber->is_done, __ATOMIC_ACQUIRE);
+		size_t count = ow_subscriber_poll(&subscriber->subscriber, polled, BENCH_CHUNK_LENGTH);
+
+		for (size_t i = 0; i < count; i++)
+		{
+			if (polled[i].timestamp.tv_sec <= last)
+			{
+				subscriber->misordered++;
+			}
+
+			last = polled[i].timestamp.tv_sec;
+		}
+
+		if (is_done && (count == 0))
+		{
+			return NULL;
+		}
+	}
+}
+
+int main(void)
+{
+	ow_sample_t* samples = malloc(BENCH_SAMPLE_COUNT * sizeof(ow_sample_t));
+	bench_subscriber_t subscribers[BENCH_SUBSCRIBER_COUNT];
+
+	if (!samples)
+	{
+		perror("Allocating benchmark buffers failed");
+		return EXIT_FAILURE;
+	}
+
+	bench_fill(samples, BENCH_SAMPLE_COUNT);
+
+	double poll_ns = NAN;
+	double publish_ns = bench_publish_poll(samples, &poll_ns);
+	double fan_out_ns = bench_fan_out(samples, subscribers);
+
+	if (isnan(publish_ns) || isnan(fan_out_ns))
+	{
+		fprintf(stderr, "Samples got lost or out of order\n");
+		return EXIT_FAILURE;
+	}
+
+	printf("broadcast.publish.ns_per_sample %.3f\n", publish_ns);
+	printf("broadcast.poll.ns_per_sample %.3f\n", poll_ns);
+	printf("broadcast.fan_out.ns_per_sample %.3f\n", fan_out_ns);
+
+	//How much the subscribers of the last fan-out run have kept up:
+	for (size_t i = 0; i < BENCH_SUBSCRIBER_COUNT; i++)
+	{
+		printf("broadcast.fan_out.subscriber%zu.dropped_ratio %.3f\n", i, (double)subscribers[i].subscriber.dropped / BENCH_SAMPLE_COUNT);
+	}
+
+	free(samples);
+
+	return 0;
+}
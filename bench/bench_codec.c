@@ -0,0 +1,221 @@
+#include "ow18b.h"
+#include "ow18b_codec.h"
+#include "ow18b_log.h"
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+//How many records per block resp. blocks per run:
+#define BENCH_BLOCK_RECORDS 4096
+#define BENCH_BLOCK_COUNT 64
+
+//How many runs per measurement (the best one counts):
+#define BENCH_RUN_COUNT 8
+
+//The sample rate of the meter (about 3 Hz) and the jitter of the receive times:
+#define BENCH_INTERVAL_NS 333000000
+#define BENCH_JITTER_NS 1000000
+
+//Generate a logged session: a drifting reading with occasional range and flag changes.
+static uint32_t bench_random(uint32_t* state);
+static void bench_fill(ow_log_record_t* records, size_t count);
+
+//Monotonic time in nanoseconds:
+static double bench_now_ns(void);
+
+//Encode resp. decode all blocks and return the best time per record.
+//The total encoded length goes to "length".
+static double bench_encode(const ow_log_record_t* records, const ow_codec_params* params, uint8_t* bufs, size_t stride, size_t* lengths, size_t* length);
+static double bench_decode(const uint8_t* bufs, size_t stride, const size_t* lengths, ow_log_record_t* decoded);
+
+static uint32_t bench_random(uint32_t* state)
+{
+	//xorshift32:
+	*state ^= *state << 13;
+	*state ^= *state >> 17;
+	*state ^= *state << 5;
+
+	return *state;
+}
+
+static void bench_fill(ow_log_record_t* records, size_t count)
+{
+	uint32_t state = 0x12345678;
+
+	int64_t timestamp_ns = INT64_C(1700000000) * 1000000000;
+	int magnitude = 1234;
+	uint16_t unit_places = 0xF020 | 2;
+	uint8_t flags = 0x04;
+
+	for (size_t i = 0; i < count; i++)
+	{
+		timestamp_ns += BENCH_INTERVAL_NS + (int64_t)(bench_random(&state) % BENCH_JITTER_NS) - (BENCH_JITTER_NS / 2);
+
+		//The last digit wanders now and then:
+		if ((bench_random(&state) % 8) == 0)
+		{
+			magnitude += (int)(bench_random(&state) % 5) - 2;
+		}
+
+		//The occasional range switch resp. hold:
+		if ((bench_random(&state) % 2000) == 0)
+		{
+			unit_places = (unit_places == (0xF020 | 2)) ? (0xF018 | 1) : (0xF020 | 2);
+		}
+
+		if ((bench_random(&state) % 5000) == 0)
+		{
+			flags ^= 0x01;
+		}
+
+		records[i].timestamp_ns = timestamp_ns;
+		records[i].sample.unit_places = unit_places;
+		records[i].sample.value_sign = (uint16_t)(magnitude & 0x3FFF);
+		records[i].sample.flags = flags;
+		memset(records[i].sample.reserved, 0, sizeof(records[i].sample.reserved));
+	}
+}
+
+static double bench_now_ns(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (double)now.tv_sec * 1e9 + (double)now.tv_nsec;
+}
+
+static double bench_encode(const ow_log_record_t* records, const ow_codec_params* params, uint8_t* bufs, size_t stride, size_t* lengths, size_t* length)
+{
+	double best = INFINITY;
+
+	for (int run = 0; run < BENCH_RUN_COUNT; run++)
+	{
+		double start = bench_now_ns();
+
+		for (size_t i = 0; i < BENCH_BLOCK_COUNT; i++)
+		{
+			if (!ow_codec_encode(&records[i * BENCH_BLOCK_RECORDS], BENCH_BLOCK_RECORDS, params, &bufs[i * stride], stride, &lengths[i]))
+			{
+				return NAN;
+			}
+		}
+
+		double ns = bench_now_ns() - start;
+
+		if (ns < best)
+		{
+			best = ns;
+		}
+	}
+
+	*length = 0;
+
+	for (size_t i = 0; i < BENCH_BLOCK_COUNT; i++)
+	{
+		*length += lengths[i];
+	}
+
+	return best / (BENCH_BLOCK_COUNT * BENCH_BLOCK_RECORDS);
+}
+
+static double bench_decode(const uint8_t* bufs, size_t stride, const size_t* lengths, ow_log_record_t* decoded)
+{
+	double best = INFINITY;
+
+	for (int run = 0; run < BENCH_RUN_COUNT; run++)
+	{
+		double start = bench_now_ns();
+
+		for (size_t i = 0; i < BENCH_BLOCK_COUNT; i++)
+		{
+			size_t count;
+
+			if (!ow_codec_decode(&bufs[i * stride], lengths[i], &decoded[i * BENCH_BLOCK_RECORDS], BENCH_BLOCK_RECORDS, &count))
+			{
+				return NAN;
+			}
+		}
+
+		double ns = bench_now_ns() - start;
+
+		if (ns < best)
+		{
+			best = ns;
+		}
+	}
+
+	return best / (BENCH_BLOCK_COUNT * BENCH_BLOCK_RECORDS);
+}
+
+int main(void)
+{
+	size_t record_count = BENCH_BLOCK_COUNT * BENCH_BLOCK_RECORDS;
+	size_t stride = ow_codec_max_length(BENCH_BLOCK_RECORDS);
+
+	ow_log_record_t* records = malloc(record_count * sizeof(ow_log_record_t));
+	ow_log_record_t* decoded = malloc(record_count * sizeof(ow_log_record_t));
+	uint8_t* bufs = malloc(BENCH_BLOCK_COUNT * stride);
+	size_t lengths[BENCH_BLOCK_COUNT];
+
+	if (!records || !decoded || !bufs)
+	{
+		perror("Allocating benchmark buffers failed");
+		return EXIT_FAILURE;
+	}
+
+	bench_fill(records, record_count);
+
+	//Nanosecond timestamps are lossless, milliseconds are what a dashboard needs:
+	static const struct
+	{
+		const char* name;
+		uint32_t resolution_ns;
+	} resolutions[] =
+	{
+		{ "ns", 1 },
+		{ "ms", 1000000 }
+	};
+
+	for (size_t i = 0; i < sizeof(resolutions) / sizeof(resolutions[0]); i++)
+	{
+		ow_codec_params params = { .timestamp_resolution_ns = resolutions[i].resolution_ns };
+		size_t length = 0;
+
+		double encode_ns = bench_encode(records, &params, bufs, stride, lengths, &length);
+		double decode_ns = bench_decode(bufs, stride, lengths, decoded);
+
+		if (isnan(encode_ns) || isnan(decode_ns))
+		{
+			perror("Encoding or decoding failed");
+			return EXIT_FAILURE;
+		}
+
+		//Everything but the dropped timestamp digits has to come back:
+		for (size_t j = 0; j < record_count; j++)
+		{
+			int64_t timestamp_ns = records[j].timestamp_ns - (records[j].timestamp_ns % resolutions[i].resolution_ns);
+
+			if ((decoded[j].timestamp_ns != timestamp_ns) || (memcmp(&decoded[j].sample, &records[j].sample, sizeof(ow_sample_packed_t)) != 0))
+			{
+				fprintf(stderr, "Record %zu doesn't survive the round trip\n", j);
+				return EXIT_FAILURE;
+			}
+		}
+
+		printf("codec.%s.encode.ns_per_record %.3f\n", resolutions[i].name, encode_ns);
+		printf("codec.%s.decode.ns_per_record %.3f\n", resolutions[i].name, decode_ns);
+		printf("codec.%s.bytes_per_record %.3f\n", resolutions[i].name, (double)length / record_count);
+		printf("codec.%s.ratio %.3f\n", resolutions[i].name, (double)(record_count * sizeof(ow_log_record_t)) / length);
+	}
+
+	free(records);
+	free(decoded);
+	free(bufs);
+
+	return 0;
+}
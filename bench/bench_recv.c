@@ -0,0 +1,610 @@
+#include "ow18b.h"
+
+#include <errno.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <sys/socket.h>
+
+//How many frames the synthetic corpus holds:
+#define BENCH_FRAME_COUNT (1 << 16)
+
+//How many samples to push through the in-memory resp. the socketpair receive loops per run:
+#define BENCH_RECV_COUNT (1 << 20)
+#define BENCH_SOCKET_COUNT (1 << 16)
+
+//How many runs per measurement (the best one counts):
+#define BENCH_RUN_COUNT 8
+
+//The HCI handle of the synthetic connection:
+#define BENCH_HCI_HANDLE 0x0040
+
+//The length of a notification frame and the number of flag combinations:
+#define BENCH_FRAME_LENGTH 18
+#define BENCH_FLAG_COMBINATIONS 16
+
+//Every known unit code:
+#define BENCH_UNIT_CODE(code, unit_name, current_type_name, diode_test, continuity_test) code,
+
+static const uint16_t bench_unit_codes[] =
+{
+	OW_UNIT_CODES(BENCH_UNIT_CODE)
+};
+
+#define BENCH_UNIT_CODE_COUNT (sizeof(bench_unit_codes) / sizeof(bench_unit_codes[0]))
+
+//An in-memory frame source that cycles through the corpus:
+typedef struct __bench_memory_source_t__
+{
+	const uint8_t* frames;
+	size_t index;
+} bench_memory_source_t;
+
+//Counts samples for the callbacks:
+typedef struct __bench_counter_t__
+{
+	size_t count;
+	size_t limit;
+	double checksum;
+} bench_counter_t;
+
+//Feeds frames into a socketpair from another thread:
+typedef struct __bench_writer_t__
+{
+	int fd;
+	const uint8_t* frames;
+	size_t count;
+} bench_writer_t;
+
+//Build the corpus: all unit codes, decimal places, overflows, signs and flag combinations.
+static void bench_fill_frames(uint8_t* frames);
+
+//Make sure the corpus decodes to what we have put in:
+static bool bench_check_frames(const uint8_t* frames);
+
+//Monotonic time in nanoseconds:
+static double bench_now_ns(void);
+
+//The benchmarks, each returning the best time per sample in nanoseconds:
+static double bench_decode_frames(const uint8_t* frames, ow_sample_t* samples);
+static double bench_recv_callback(const uint8_t* frames, ow_stats_t* stats);
+static double bench_normalize(const ow_sample_t* samples, ow_normalized_sample_t* normalized);
+static double bench_recv_batch(const uint8_t* frames);
+static double bench_recv_normalized(const uint8_t* frames);
+static double bench_recv_packed(const uint8_t* frames);
+static double bench_recv_view(const uint8_t* frames);
+static double bench_recv_socketpair(const uint8_t* frames, ow_sample_t* samples);
+
+//Frame source and callbacks:
+static int bench_memory_read(void* context, uint8_t* buf, size_t length, struct timespec* timestamp);
+static bool bench_sample_func(ow_sample_t sample, void* context);
+static bool bench_batch_func(const ow_sample_t* samples, size_t count, void* context);
+static bool bench_normalized_func(const ow_normalized_sample_t* samples, size_t count, void* context);
+static bool bench_packed_func(ow_sample_packed_t sample, void* context);
+static bool bench_view_func(const ow_frame_view_t* view, void* context);
+static void* bench_writer_run(void* context);
+
+static void bench_fill_frames(uint8_t* frames)
+{
+	uint32_t state = 0x12345678;
+
+	for (size_t i = 0; i < BENCH_FRAME_COUNT; i++)
+	{
+		//Walk through the combinations, so every one of them shows up in the corpus:
+		size_t combination = i;
+
+		uint16_t unit_code = bench_unit_codes[combination % BENCH_UNIT_CODE_COUNT];
+		combination /= BENCH_UNIT_CODE_COUNT;
+
+		uint16_t places = combination % 4;
+		combination /= 4;
+
+		uint8_t flags = combination % BENCH_FLAG_COMBINATIONS;
+		combination /= BENCH_FLAG_COMBINATIONS;
+
+		bool is_overflow = (combination % 2) != 0;
+		bool is_negative = ((combination / 2) % 2) != 0;
+
+		//Random digits (xorshift32):
+		state ^= state << 13;
+		state ^= state >> 17;
+		state ^= state << 5;
+
+		uint16_t unit_places = unit_code | places | (is_overflow ? (1 << 2) : 0);
+		uint16_t value_sign = (uint16_t)(state % 10000) | (is_negative ? 0x8000 : 0);
+		uint16_t hci_handle = BENCH_HCI_HANDLE;
+
+		uint8_t frame[BENCH_FRAME_LENGTH] =
+		{
+			0x02, hci_handle & 0xFF, ((hci_handle >> 8) & 0x0F) | 0x20,
+			13, 0x00,
+			9, 0x00,
+			0x04, 0x00,
+			0x1B,
+			0x1B, 0x00,
+			unit_places & 0xFF, unit_places >> 8,
+			flags,
+			0x00,
+			value_sign & 0xFF, value_sign >> 8
+		};
+
+		memcpy(&frames[i * BENCH_FRAME_LENGTH], frame, BENCH_FRAME_LENGTH);
+	}
+}
+
+static bool bench_check_frames(const uint8_t* frames)
+{
+	for (size_t i = 0; i < BENCH_FRAME_COUNT; i++)
+	{
+		ow_sample_t sample;
+
+		if (!ow_decode_frame(&frames[i * BENCH_FRAME_LENGTH], BENCH_FRAME_LENGTH, BENCH_HCI_HANDLE, &sample))
+		{
+			return false;
+		}
+
+		if ((sample.unit == OW_UNIT_UNKNOWN) || (sample.is_overflow != (bool)isnan(sample.value)))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static double bench_now_ns(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (double)now.tv_sec * 1e9 + (double)now.tv_nsec;
+}
+
+static double bench_decode_frames(const uint8_t* frames, ow_sample_t* samples)
+{
+	double best = INFINITY;
+
+	for (int run = 0; run < BENCH_RUN_COUNT; run++)
+	{
+		size_t rejected;
+		double start = bench_now_ns();
+
+		ow_decode_frames(frames, BENCH_FRAME_COUNT, BENCH_HCI_HANDLE, samples, &rejected);
+
+		double ns = bench_now_ns() - start;
+
+		if (rejected != 0)
+		{
+			return NAN;
+		}
+
+		if (ns < best)
+		{
+			best = ns;
+		}
+	}
+
+	return best / BENCH_FRAME_COUNT;
+}
+
+static double bench_normalize(const ow_sample_t* samples, ow_normalized_sample_t* normalized)
+{
+	double best = INFINITY;
+
+	for (int run = 0; run < BENCH_RUN_COUNT; run++)
+	{
+		double start = bench_now_ns();
+
+		ow_normalize(samples, BENCH_FRAME_COUNT, normalized);
+
+		double ns = bench_now_ns() - start;
+
+		if (ns < best)
+		{
+			best = ns;
+		}
+	}
+
+	//Every unit of the corpus is known:
+	for (size_t i = 0; i < BENCH_FRAME_COUNT; i++)
+	{
+		if (normalized[i].quantity == OW_QUANTITY_UNKNOWN)
+		{
+			return NAN;
+		}
+	}
+
+	return best / BENCH_FRAME_COUNT;
+}
+
+static double bench_recv_callback(const uint8_t* frames, ow_stats_t* stats)
+{
+	double best = INFINITY;
+
+	for (int run = 0; run < BENCH_RUN_COUNT; run++)
+	{
+		bench_memory_source_t memory = { .frames = frames, .index = 0 };
+		bench_counter_t counter = { .count = 0, .limit = BENCH_RECV_COUNT, .checksum = 0 };
+
+		ow_source_t source =
+		{
+			.read = bench_memory_read,
+			.read_many = NULL,
+			.context = &memory,
+			.fd = -1,
+			.hci_handle = BENCH_HCI_HANDLE,
+			.stats = stats
+		};
+
+		double start = bench_now_ns();
+
+		if (!ow_recv_source(&source, bench_sample_func, &counter))
+		{
+			return NAN;
+		}
+
+		double ns = bench_now_ns() - start;
+
+		if (ns < best)
+		{
+			best = ns;
+		}
+	}
+
+	return best / BENCH_RECV_COUNT;
+}
+
+static double bench_recv_batch(const uint8_t* frames)
+{
+	double best = INFINITY;
+
+	for (int run = 0; run < BENCH_RUN_COUNT; run++)
+	{
+		bench_memory_source_t memory = { .frames = frames, .index = 0 };
+		bench_counter_t counter = { .count = 0, .limit = BENCH_RECV_COUNT, .checksum = 0 };
+
+		ow_source_t source =
+		{
+			.read = bench_memory_read,
+			.read_many = NULL,
+			.context = &memory,
+			.fd = -1,
+			.hci_handle = BENCH_HCI_HANDLE,
+			.stats = NULL
+		};
+
+		double start = bench_now_ns();
+
+		//Sources that can't be polled are read once per round, so the batches stay small, but that's the path:
+		if (!ow_recv_batch_source(&source, bench_batch_func, &counter, 64, 1000))
+		{
+			return NAN;
+		}
+
+		double ns = bench_now_ns() - start;
+
+		if (ns < best)
+		{
+			best = ns;
+		}
+	}
+
+	return best / BENCH_RECV_COUNT;
+}
+
+static double bench_recv_normalized(const uint8_t* frames)
+{
+	double best = INFINITY;
+
+	for (int run = 0; run < BENCH_RUN_COUNT; run++)
+	{
+		bench_memory_source_t memory = { .frames = frames, .index = 0 };
+		bench_counter_t counter = { .count = 0, .limit = BENCH_RECV_COUNT, .checksum = 0 };
+
+		ow_source_t source =
+		{
+			.read = bench_memory_read,
+			.read_many = NULL,
+			.context = &memory,
+			.fd = -1,
+			.hci_handle = BENCH_HCI_HANDLE,
+			.stats = NULL
+		};
+
+		double start = bench_now_ns();
+
+		if (!ow_recv_normalized_source(&source, bench_normalized_func, &counter, 64, 1000))
+		{
+			return NAN;
+		}
+
+		double ns = bench_now_ns() - start;
+
+		if (ns < best)
+		{
+			best = ns;
+		}
+	}
+
+	return best / BENCH_RECV_COUNT;
+}
+
+static double bench_recv_packed(const uint8_t* frames)
+{
+	double best = INFINITY;
+
+	for (int run = 0; run < BENCH_RUN_COUNT; run++)
+	{
+		bench_memory_source_t memory = { .frames = frames, .index = 0 };
+		bench_counter_t counter = { .count = 0, .limit = BENCH_RECV_COUNT, .checksum = 0 };
+
+		ow_source_t source =
+		{
+			.read = bench_memory_read,
+			.read_many = NULL,
+			.context = &memory,
+			.fd = -1,
+			.hci_handle = BENCH_HCI_HANDLE,
+			.stats = NULL
+		};
+
+		double start = bench_now_ns();
+
+		if (!ow_recv_packed_source(&source, bench_packed_func, &counter))
+		{
+			return NAN;
+		}
+
+		double ns = bench_now_ns() - start;
+
+		if (ns < best)
+		{
+			best = ns;
+		}
+	}
+
+	return best / BENCH_RECV_COUNT;
+}
+
+static double bench_recv_view(const uint8_t* frames)
+{
+	double best = INFINITY;
+
+	for (int run = 0; run < BENCH_RUN_COUNT; run++)
+	{
+		bench_memory_source_t memory = { .frames = frames, .index = 0 };
+		bench_counter_t counter = { .count = 0, .limit = BENCH_RECV_COUNT, .checksum = 0 };
+
+		ow_source_t source =
+		{
+			.read = bench_memory_read,
+			.read_many = NULL,
+			.context = &memory,
+			.fd = -1,
+			.hci_handle = BENCH_HCI_HANDLE,
+			.stats = NULL
+		};
+
+		double start = bench_now_ns();
+
+		if (!ow_recv_view_source(&source, bench_view_func, &counter))
+		{
+			return NAN;
+		}
+
+		double ns = bench_now_ns() - start;
+
+		if (ns < best)
+		{
+			best = ns;
+		}
+	}
+
+	return best / BENCH_RECV_COUNT;
+}
+
+static double bench_recv_socketpair(const uint8_t* frames, ow_sample_t* samples)
+{
+	double best = INFINITY;
+
+	for (int run = 0; run < BENCH_RUN_COUNT; run++)
+	{
+		int fds[2];
+
+		if (socketpair(AF_UNIX, SOCK_SEQPACKET, 0, fds) != 0)
+		{
+			return NAN;
+		}
+
+		//The writer blocks whenever the socket buffer is full, so it runs on its own thread:
+		bench_writer_t writer = { .fd = fds[1], .frames = frames, .count = BENCH_SOCKET_COUNT };
+		pthread_t thread;
+
+		ow_source_t source;
+		ow_source_init_fd(&source, fds[0], BENCH_HCI_HANDLE);
+
+		double start = bench_now_ns();
+
+		if (pthread_create(&thread, NULL, bench_writer_run, &writer) != 0)
+		{
+			return NAN;
+		}
+
+		bool success = ow_recv_n_source(&source, samples, BENCH_SOCKET_COUNT);
+		double ns = bench_now_ns() - start;
+
+		pthread_join(thread, NULL);
+
+		close(fds[0]);
+		close(fds[1]);
+
+		if (!success)
+		{
+			return NAN;
+		}
+
+		if (ns < best)
+		{
+			best = ns;
+		}
+	}
+
+	return best / BENCH_SOCKET_COUNT;
+}
+
+static int bench_memory_read(void* context, uint8_t* buf, size_t length, struct timespec* timestamp)
+{
+	bench_memory_source_t* memory = context;
+
+	//Hand out a receive time, just like the kernel would:
+	timestamp->tv_sec = 1;
+
+	memcpy(buf, &memory->frames[memory->index * BENCH_FRAME_LENGTH], (length < BENCH_FRAME_LENGTH) ? length : BENCH_FRAME_LENGTH);
+	memory->index = (memory->index + 1) % BENCH_FRAME_COUNT;
+
+	return BENCH_FRAME_LENGTH;
+}
+
+static bool bench_sample_func(ow_sample_t sample, void* context)
+{
+	bench_counter_t* counter = context;
+
+	counter->checksum += sample.magnitude;
+	return ++counter->count < counter->limit;
+}
+
+static bool bench_batch_func(const ow_sample_t* samples, size_t count, void* context)
+{
+	bench_counter_t* counter = context;
+
+	for (size_t i = 0; i < count; i++)
+	{
+		counter->checksum += samples[i].magnitude;
+	}
+
+	counter->count += count;
+	return counter->count < counter->limit;
+}
+
+static bool bench_normalized_func(const ow_normalized_sample_t* samples, size_t count, void* context)
+{
+	bench_counter_t* counter = context;
+
+	for (size_t i = 0; i < count; i++)
+	{
+		counter->checksum += samples[i].quantity;
+	}
+
+	counter->count += count;
+	return counter->count < counter->limit;
+}
+
+static bool bench_packed_func(ow_sample_packed_t sample, void* context)
+{
+	bench_counter_t* counter = context;
+
+	counter->checksum += sample.value_sign & 0x3FFF;
+	return ++counter->count < counter->limit;
+}
+
+static bool bench_view_func(const ow_frame_view_t* view, void* context)
+{
+	bench_counter_t* counter = context;
+
+	//Like a trigger that only looks at one flag and the digits:
+	if (!ow_frame_view_is_data_hold(view))
+	{
+		counter->checksum += ow_frame_view_magnitude(view);
+	}
+
+	return ++counter->count < counter->limit;
+}
+
+static void* bench_writer_run(void* context)
+{
+	bench_writer_t* writer = context;
+
+	for (size_t i = 0; i < writer->count; i++)
+	{
+		if (write(writer->fd, &writer->frames[(i % BENCH_FRAME_COUNT) * BENCH_FRAME_LENGTH], BENCH_FRAME_LENGTH) != BENCH_FRAME_LENGTH)
+		{
+			break;
+		}
+	}
+
+	return NULL;
+}
+
+int main(void)
+{
+	uint8_t* frames = malloc(BENCH_FRAME_COUNT * BENCH_FRAME_LENGTH);
+	ow_sample_t* samples = malloc(BENCH_FRAME_COUNT * sizeof(ow_sample_t));
+	ow_normalized_sample_t* normalized = malloc(BENCH_FRAME_COUNT * sizeof(ow_normalized_sample_t));
+
+	if (!frames || !samples || !normalized)
+	{
+		perror("Allocating benchmark buffers failed");
+		return EXIT_FAILURE;
+	}
+
+	bench_fill_frames(frames);
+
+	if (!bench_check_frames(frames))
+	{
+		fprintf(stderr, "The synthetic frames don't decode as expected\n");
+		return EXIT_FAILURE;
+	}
+
+	ow_stats_t stats;
+	memset(&stats, 0, sizeof(stats));
+
+	double results[] =
+	{
+		bench_decode_frames(frames, samples),
+		bench_normalize(samples, normalized),
+		bench_recv_callback(frames, NULL),
+		bench_recv_callback(frames, &stats),
+		bench_recv_batch(frames),
+		bench_recv_normalized(frames),
+		bench_recv_packed(frames),
+		bench_recv_view(frames),
+		bench_recv_socketpair(frames, samples)
+	};
+
+	const char* const names[] =
+	{
+		"decode.frames",
+		"normalize",
+		"recv.callback",
+		"recv.callback_stats",
+		"recv.batch",
+		"recv.normalized",
+		"recv.packed",
+		"recv.view",
+		"recv_n.socketpair"
+	};
+
+	for (size_t i = 0; i < sizeof(results) / sizeof(results[0]); i++)
+	{
+		if (isnan(results[i]))
+		{
+			fprintf(stderr, "Benchmark %s failed: %s\n", names[i], strerror(errno));
+			return EXIT_FAILURE;
+		}
+
+		printf("%s.ns_per_sample %.3f\n", names[i], results[i]);
+	}
+
+	free(frames);
+	free(samples);
+	free(normalized);
+
+	return 0;
+}
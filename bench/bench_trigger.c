@@ -0,0 +1,283 @@
+#include "ow18b.h"
+#include "ow18b_trigger.h"
+
+#include <errno.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+//How many frames the synthetic corpus holds and how many are received per run:
+#define BENCH_FRAME_COUNT (1 << 12)
+#define BENCH_RECV_COUNT (1 << 20)
+
+//How many runs per measurement (the best one counts):
+#define BENCH_RUN_COUNT 8
+
+//The HCI handle of the synthetic connection:
+#define BENCH_HCI_HANDLE 0x0040
+
+//The length of a notification frame:
+#define BENCH_FRAME_LENGTH 18
+
+//The unit code of millivolts (DC) and the alarm threshold in volts:
+#define BENCH_UNIT_CODE_MILLIVOLT 0xF018
+#define BENCH_THRESHOLD 0.5
+
+//An in-memory frame source that cycles through the corpus and ends after BENCH_RECV_COUNT frames:
+typedef struct __bench_memory_source_t__
+{
+	const uint8_t* frames;
+	size_t count;
+} bench_memory_source_t;
+
+//What the callbacks count:
+typedef struct __bench_counter_t__
+{
+	uint64_t events;
+
+	//The state of the hand-written filter:
+	bool was_above;
+	bool was_low_battery;
+} bench_counter_t;
+
+//Build the corpus: a millivolt sawtooth that crosses the threshold once per period, with the low battery flag toggling every 1024 frames.
+static void bench_fill_frames(uint8_t* frames);
+
+//Monotonic time in nanoseconds:
+static double bench_now_ns(void);
+
+//Receive the corpus with a filtering sample callback resp. with a trigger (same conditions).
+//Return the best time per sample in nanoseconds and store the number of events.
+static double bench_recv_filter(const uint8_t* frames, uint64_t* events);
+static double bench_recv_trigger(const uint8_t* frames, const ow_condition_t* conditions, size_t count, uint64_t* events);
+
+//Frame source and callbacks:
+static int bench_memory_read(void* context, uint8_t* buf, size_t length, struct timespec* timestamp);
+static bool bench_filter_func(ow_sample_t sample, void* context);
+static bool bench_trigger_func(const ow_trigger_event_t* event, void* context);
+
+static void bench_fill_frames(uint8_t* frames)
+{
+	for (size_t i = 0; i < BENCH_FRAME_COUNT; i++)
+	{
+		//One decimal place, so the sawtooth goes from 0.0 to 999.9 mV:
+		uint16_t unit_places = BENCH_UNIT_CODE_MILLIVOLT | 1;
+		uint16_t value_sign = (uint16_t)((i * 7) % 10000);
+		uint8_t flags = ((i / 1024) % 2) ? 0x08 : 0x00;
+		uint16_t hci_handle = BENCH_HCI_HANDLE;
+
+		uint8_t frame[BENCH_FRAME_LENGTH] =
+		{
+			0x02, hci_handle & 0xFF, ((hci_handle >> 8) & 0x0F) | 0x20,
+			13, 0x00,
+			9, 0x00,
+			0x04, 0x00,
+			0x1B,
+			0x1B, 0x00,
+			unit_places & 0xFF, unit_places >> 8,
+			flags,
+			0x00,
+			value_sign & 0xFF, value_sign >> 8
+		};
+
+		memcpy(&frames[i * BENCH_FRAME_LENGTH], frame, BENCH_FRAME_LENGTH);
+	}
+}
+
+static double bench_now_ns(void)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	return (double)now.tv_sec * 1e9 + (double)now.tv_nsec;
+}
+
+static double bench_recv_filter(const uint8_t* frames, uint64_t* events)
+{
+	double best = INFINITY;
+
+	for (int run = 0; run < BENCH_RUN_COUNT; run++)
+	{
+		bench_memory_source_t memory = { .frames = frames, .count = 0 };
+		bench_counter_t counter = { .events = 0, .was_above = false, .was_low_battery = false };
+
+		ow_source_t source;
+		memset(&source, 0, sizeof(source));
+
+		source.read = bench_memory_read;
+		source.context = &memory;
+		source.fd = -1;
+		source.hci_handle = BENCH_HCI_HANDLE;
+
+		double start = bench_now_ns();
+
+		//The source ends with ENODATA:
+		if (ow_recv_source(&source, bench_filter_func, &counter) || (errno != ENODATA))
+		{
+			return NAN;
+		}
+
+		double ns = bench_now_ns() - start;
+
+		if (ns < best)
+		{
+			best = ns;
+		}
+
+		*events = counter.events;
+	}
+
+	return best / BENCH_RECV_COUNT;
+}
+
+static double bench_recv_trigger(const uint8_t* frames, const ow_condition_t* conditions, size_t count, uint64_t* events)
+{
+	double best = INFINITY;
+	ow_trigger_t* trigger = ow_trigger_create(conditions, count);
+
+	if (!trigger)
+	{
+		return NAN;
+	}
+
+	for (int run = 0; run < BENCH_RUN_COUNT; run++)
+	{
+		bench_memory_source_t memory = { .frames = frames, .count = 0 };
+		bench_counter_t counter = { .events = 0, .was_above = false, .was_low_battery = false };
+
+		ow_source_t source;
+		memset(&source, 0, sizeof(source));
+
+		source.read = bench_memory_read;
+		source.context = &memory;
+		source.fd = -1;
+		source.hci_handle = BENCH_HCI_HANDLE;
+
+		ow_trigger_reset(trigger);
+
+		double start = bench_now_ns();
+
+		if (ow_recv_trigger_source(&source, trigger, bench_trigger_func, &counter) || (errno != ENODATA))
+		{
+			ow_trigger_destroy(trigger);
+			return NAN;
+		}
+
+		double ns = bench_now_ns() - start;
+
+		if (ns < best)
+		{
+			best = ns;
+		}
+
+		*events = counter.events;
+	}
+
+	ow_trigger_destroy(trigger);
+
+	return best / BENCH_RECV_COUNT;
+}
+
+static int bench_memory_read(void* context, uint8_t* buf, size_t length, struct timespec* timestamp)
+{
+	bench_memory_source_t* memory = context;
+
+	if (memory->count == BENCH_RECV_COUNT)
+	{
+		return 0;
+	}
+
+	//Hand out a receive time, just like the kernel would:
+	timestamp->tv_sec = 1;
+
+	memcpy(buf, &memory->frames[(memory->count % BENCH_FRAME_COUNT) * BENCH_FRAME_LENGTH], (length < BENCH_FRAME_LENGTH) ? length : BENCH_FRAME_LENGTH);
+	memory->count++;
+
+	return BENCH_FRAME_LENGTH;
+}
+
+static bool bench_filter_func(ow_sample_t sample, void* context)
+{
+	bench_counter_t* counter = context;
+
+	//What every consumer writes by hand today: a rising edge (without hysteresis) and a flag that is set:
+	bool is_above = (sample.value / 1000.0) > BENCH_THRESHOLD;
+
+	if (is_above && !counter->was_above)
+	{
+		counter->events++;
+	}
+
+	if (sample.is_low_battery && !counter->was_low_battery)
+	{
+		counter->events++;
+	}
+
+	counter->was_above = is_above;
+	counter->was_low_battery = sample.is_low_battery;
+
+	return true;
+}
+
+static bool bench_trigger_func(const ow_trigger_event_t* event, void* context)
+{
+	bench_counter_t* counter = context;
+
+	(void)event;
+	counter->events++;
+
+	return true;
+}
+
+int main(void)
+{
+	uint8_t* frames = malloc(BENCH_FRAME_COUNT * BENCH_FRAME_LENGTH);
+
+	if (!frames)
+	{
+		perror("Allocating benchmark buffers failed");
+		return EXIT_FAILURE;
+	}
+
+	bench_fill_frames(frames);
+
+	const ow_condition_t conditions[] =
+	{
+		{ .type = OW_CONDITION_RISING, .quantity = OW_QUANTITY_VOLTAGE, .threshold = BENCH_THRESHOLD, .hysteresis = 0.0 },
+		{ .type = OW_CONDITION_FLAG_SET, .flags = OW_TRIGGER_FLAG_LOW_BATTERY }
+	};
+
+	uint64_t filter_events = 0;
+	uint64_t trigger_events = 0;
+	uint64_t flag_events = 0;
+
+	double filter_ns = bench_recv_filter(frames, &filter_events);
+	double trigger_ns = bench_recv_trigger(frames, conditions, 2, &trigger_events);
+	double flag_ns = bench_recv_trigger(frames, &conditions[1], 1, &flag_events);
+
+	if (isnan(filter_ns) || isnan(trigger_ns) || isnan(flag_ns))
+	{
+		fprintf(stderr, "Benchmark failed: %s\n", strerror(errno));
+		return EXIT_FAILURE;
+	}
+
+	//The trigger has to see the same events as the hand-written filter:
+	if (trigger_events != filter_events)
+	{
+		fprintf(stderr, "The trigger fired %llu times instead of %llu\n", (unsigned long long)trigger_events, (unsigned long long)filter_events);
+		return EXIT_FAILURE;
+	}
+
+	printf("trigger.callback_filter.ns_per_sample %.3f\n", filter_ns);
+	printf("trigger.threshold_and_flag.ns_per_sample %.3f\n", trigger_ns);
+	printf("trigger.flag_only.ns_per_sample %.3f\n", flag_ns);
+	printf("trigger.events_per_sample %.6f\n", (double)trigger_events / BENCH_RECV_COUNT);
+
+	free(frames);
+
+	return 0;
+}
@@ -0,0 +1,251 @@
+#include "ow18b.h"
+
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+//How many payloads to decode per run:
+#define BENCH_SAMPLE_COUNT (1 << 20)
+
+//How many runs per decoder (the best one counts):
+#define BENCH_RUN_COUNT 16
+
+//How long the meter typically stays in one unit for the "runs" mix:
+#define BENCH_RUN_LENGTH 1000
+
+//A decoder for a 6-byte payload:
+typedef void (*bench_decode_func_t)(const uint8_t*, ow_sample_t*);
+
+//A unit word and how often it shows up in our "realistic" mix:
+typedef struct __bench_unit_weight_t__
+{
+	uint16_t unit_word;
+	int weight;
+} bench_unit_weight_t;
+
+//Mostly DC voltage, some current and resistance, a few rare modes and the occasional unknown code:
+static const bench_unit_weight_t bench_unit_weights[] =
+{
+	{ 0xF020, 30 }, { 0xF018, 15 }, { 0xF060, 8 }, { 0xF058, 4 }, { 0xF2A0, 1 },
+	{ 0xF098, 8 }, { 0xF090, 3 }, { 0xF0A0, 5 }, { 0xF0D8, 1 }, { 0xF0E0, 1 },
+	{ 0xF120, 5 }, { 0xF128, 5 }, { 0xF130, 2 }, { 0xF2E0, 3 },
+	{ 0xF148, 1 }, { 0xF150, 1 }, { 0xF1A0, 2 }, { 0xF1E0, 1 },
+	{ 0xF220, 2 }, { 0xF260, 1 }, { 0xF360, 1 }, { 0xF3F8, 1 }
+};
+
+//The switch-based unit decoding of the original receive loop, kept as reference:
+static void bench_decode_switch(const uint8_t* payload, ow_sample_t* sample);
+
+//Generate payloads with a random unit per sample resp. long runs of the same unit:
+static uint32_t bench_random(uint32_t* state);
+static uint16_t bench_random_unit_word(uint32_t* state);
+static void bench_fill(uint8_t* payloads, bool runs);
+
+//Decode all payloads with the given decoder and return the best time per sample:
+static double bench_run(bench_decode_func_t decode, const uint8_t* payloads, ow_sample_t* samples);
+
+static void bench_decode_switch(const uint8_t* payload, ow_sample_t* sample)
+{
+	uint16_t unit_places = (uint16_t)payload[0] | ((uint16_t)payload[1] << 8);
+	uint16_t value_sign = (uint16_t)payload[4] | ((uint16_t)payload[5] << 8);
+
+	switch (unit_places & 0xFFF8)
+	{
+	case 0xF018: sample->unit = OW_UNIT_MILLIVOLT; sample->current_type = OW_CURRENT_TYPE_DC; break;
+	case 0xF058: sample->unit = OW_UNIT_MILLIVOLT; sample->current_type = OW_CURRENT_TYPE_AC; break;
+	case 0xF020: sample->unit = OW_UNIT_VOLT; sample->current_type = OW_CURRENT_TYPE_DC; sample->is_diode_test = false; break;
+	case 0xF060: sample->unit = OW_UNIT_VOLT; sample->current_type = OW_CURRENT_TYPE_AC; sample->is_diode_test = false; break;
+	case 0xF2A0: sample->unit = OW_UNIT_VOLT; sample->current_type = OW_CURRENT_TYPE_DC; sample->is_diode_test = true; break;
+	case 0xF090: sample->unit = OW_UNIT_MICROAMPERE; sample->current_type = OW_CURRENT_TYPE_DC; break;
+	case 0xF0D0: sample->unit = OW_UNIT_MICROAMPERE; sample->current_type = OW_CURRENT_TYPE_AC; break;
+	case 0xF098: sample->unit = OW_UNIT_MILLIAMPERE; sample->current_type = OW_CURRENT_TYPE_DC; break;
+	case 0xF0D8: sample->unit = OW_UNIT_MILLIAMPERE; sample->current_type = OW_CURRENT_TYPE_AC; break;
+	case 0xF0A0: sample->unit = OW_UNIT_AMPERE; sample->current_type = OW_CURRENT_TYPE_DC; break;
+	case 0xF0E0: sample->unit = OW_UNIT_AMPERE; sample->current_type = OW_CURRENT_TYPE_AC; break;
+	case 0xF120: sample->unit = OW_UNIT_OHM; sample->is_continuity_test = false; break;
+	case 0xF2E0: sample->unit = OW_UNIT_OHM; sample->is_continuity_test = true; break;
+	case 0xF128: sample->unit = OW_UNIT_KILOOHM; break;
+	case 0xF130: sample->unit = OW_UNIT_MEGAOHM; break;
+	case 0xF148: sample->unit = OW_UNIT_NANOFARAD; break;
+	case 0xF150: sample->unit = OW_UNIT_MICROFARAD; break;
+	case 0xF158: sample->unit = OW_UNIT_MILLIFARAD; break;
+	case 0xF160: sample->unit = OW_UNIT_FARAD; break;
+	case 0xF1A0: sample->unit = OW_UNIT_HERTZ; break;
+	case 0xF1E0: sample->unit = OW_UNIT_PERCENT; break;
+	case 0xF220: sample->unit = OW_UNIT_CELSIUS; break;
+	case 0xF260: sample->unit = OW_UNIT_FAHRENHEIT; break;
+	case 0xF360: sample->unit = OW_UNIT_NEARFIELD; break;
+
+	default: sample->unit = OW_UNIT_UNKNOWN;
+	}
+
+	if (unit_places & (1 << 2))
+	{
+		sample->value = NAN;
+	}
+	else
+	{
+		double factor;
+
+		switch (unit_places & 0x0003)
+		{
+		case 0: factor = 1; break;
+		case 1: factor = 0.1; break;
+		case 2: factor = 0.01; break;
+		default: factor = 0.001; break;
+		}
+
+		sample->value = ((value_sign & 0x8000) ? -1.0 : 1.0) * factor * (double)(value_sign & 0x3FFF);
+	}
+
+	uint8_t flags = payload[2];
+
+	sample->is_data_hold = (flags & (1 << 0)) != 0;
+	sample->is_relative = (flags & (1 << 1)) != 0;
+	sample->is_auto_range = (flags & (1 << 2)) != 0;
+	sample->is_low_battery = (flags & (1 << 3)) != 0;
+}
+
+static uint32_t bench_random(uint32_t* state)
+{
+	//xorshift32:
+	*state ^= *state << 13;
+	*state ^= *state >> 17;
+	*state ^= *state << 5;
+
+	return *state;
+}
+
+static uint16_t bench_random_unit_word(uint32_t* state)
+{
+	//Sum up the weights:
+	int total = 0;
+
+	for (size_t i = 0; i < sizeof(bench_unit_weights) / sizeof(bench_unit_weights[0]); i++)
+	{
+		total += bench_unit_weights[i].weight;
+	}
+
+	//Pick one:
+	int pick = (int)(bench_random(state) % (uint32_t)total);
+
+	for (size_t i = 0; i < sizeof(bench_unit_weights) / sizeof(bench_unit_weights[0]); i++)
+	{
+		pick -= bench_unit_weights[i].weight;
+
+		if (pick < 0)
+		{
+			return bench_unit_weights[i].unit_word;
+		}
+	}
+
+	return bench_unit_weights[0].unit_word;
+}
+
+static void bench_fill(uint8_t* payloads, bool runs)
+{
+	uint32_t state = 0x12345678;
+	uint16_t unit_word = 0;
+
+	for (size_t i = 0; i < BENCH_SAMPLE_COUNT; i++)
+	{
+		//Switch the unit on every sample resp. every couple of samples:
+		if (!runs || ((i % BENCH_RUN_LENGTH) == 0))
+		{
+			unit_word = bench_random_unit_word(&state);
+		}
+
+		uint32_t random = bench_random(&state);
+		uint16_t unit_places = unit_word | (random & 0x3);
+		uint16_t value_sign = (random >> 8) & 0xBFFF;
+
+		uint8_t* payload = &payloads[i * 6];
+
+		payload[0] = unit_places & 0xFF;
+		payload[1] = unit_places >> 8;
+		payload[2] = (random >> 4) & 0x0F;
+		payload[3] = 0;
+		payload[4] = value_sign & 0xFF;
+		payload[5] = value_sign >> 8;
+	}
+}
+
+static double bench_run(bench_decode_func_t decode, const uint8_t* payloads, ow_sample_t* samples)
+{
+	double best = INFINITY;
+
+	for (int run = 0; run < BENCH_RUN_COUNT; run++)
+	{
+		struct timespec start, end;
+		clock_gettime(CLOCK_MONOTONIC, &start);
+
+		for (size_t i = 0; i < BENCH_SAMPLE_COUNT; i++)
+		{
+			decode(&payloads[i * 6], &samples[i]);
+		}
+
+		clock_gettime(CLOCK_MONOTONIC, &end);
+
+		double ns = (double)(end.tv_sec - start.tv_sec) * 1e9 + (double)(end.tv_nsec - start.tv_nsec);
+
+		if (ns < best)
+		{
+			best = ns;
+		}
+	}
+
+	return best / BENCH_SAMPLE_COUNT;
+}
+
+int main(void)
+{
+	uint8_t* payloads = malloc(BENCH_SAMPLE_COUNT * 6);
+	ow_sample_t* samples = malloc(BENCH_SAMPLE_COUNT * sizeof(ow_sample_t));
+
+	if (!payloads || !samples)
+	{
+		perror("Allocating benchmark buffers failed");
+		return EXIT_FAILURE;
+	}
+
+	for (int runs = 0; runs <= 1; runs++)
+	{
+		bench_fill(payloads, runs);
+
+		double switch_ns = bench_run(bench_decode_switch, payloads, samples);
+		unsigned int switch_check = 0;
+
+		for (size_t i = 0; i < BENCH_SAMPLE_COUNT; i++)
+		{
+			switch_check = switch_check * 31 + samples[i].unit;
+		}
+
+		double table_ns = bench_run(ow_decode_payload, payloads, samples);
+		unsigned int table_check = 0;
+
+		for (size_t i = 0; i < BENCH_SAMPLE_COUNT; i++)
+		{
+			table_check = table_check * 31 + samples[i].unit;
+		}
+
+		//Both have to agree on the units:
+		if (switch_check != table_check)
+		{
+			fprintf(stderr, "Unit decoding mismatch between switch and table\n");
+			return EXIT_FAILURE;
+		}
+
+		const char* mix = runs ? "runs" : "mixed";
+
+		printf("units.switch.%s.ns_per_sample %.3f\n", mix, switch_ns);
+		printf("units.table.%s.ns_per_sample %.3f\n", mix, table_ns);
+	}
+
+	free(payloads);
+	free(samples);
+
+	return 0;
+}
@@ -0,0 +1,504 @@
+//For accept4(...):
+#define _GNU_SOURCE
+
+#include "ow18b.h"
+#include "ow18b_shm.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <sys/eventfd.h>
+#include <sys/signalfd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/time.h>
+#include <sys/un.h>
+
+//How many meters one daemon serves at most:
+#define DAEMON_MAX_METERS 16
+
+//The default capacity of a ring (about 20 minutes at 3 samples per second):
+#define DAEMON_DEFAULT_CAPACITY 4096
+
+//How many samples a meter thread publishes at once at most:
+#define DAEMON_MAX_BATCH 64
+
+//How long a client may take to send its request:
+#define DAEMON_REQUEST_TIMEOUT_MS 1000
+
+//A meter the daemon holds the connection to (or a replayed capture standing in for one):
+typedef struct __daemon_meter_t__
+{
+	char name[OW_SHM_MAX_NAME_LENGTH + 1];
+
+	//Either a btsnoop capture to replay or a Bluetooth meter:
+	const char* replay_path;
+	ow_config_t config;
+
+	ow_shm_ring_t* ring;
+	pthread_t thread;
+	bool is_started;
+} daemon_meter_t;
+
+//Options shared by all meters:
+typedef struct __daemon_options_t__
+{
+	const char* socket_path;
+	size_t capacity;
+	int dev_id;
+
+	//Replay captures as fast as possible resp. over and over again:
+	bool is_fast;
+	bool is_looped;
+} daemon_options_t;
+
+//The daemon's options and meters:
+static daemon_options_t daemon_options =
+{
+	.socket_path = OW_SHM_DEFAULT_SOCKET_PATH,
+	.capacity = DAEMON_DEFAULT_CAPACITY,
+	.dev_id = OW_DEV_ID_AUTOMATIC,
+	.is_fast = false,
+	.is_looped = false
+};
+
+static daemon_meter_t daemon_meters[DAEMON_MAX_METERS];
+static size_t daemon_meter_count = 0;
+
+//Becomes readable on SIGINT/SIGTERM (an eventfd that is never read), so the meter threads stop waiting:
+static int daemon_stop_fd = -1;
+
+//Print the usage:
+static void daemon_usage(const char* program);
+
+//Parse a meter argument ("name=AA:BB:CC:DD:EE:FF", "name=auto" or "name=capture.btsnoop").
+//Returns false if it is malformed.
+static bool daemon_parse_meter(const char* arg, daemon_meter_t* meter);
+
+//The meter threads and their batch func (publishes into the ring):
+static void* daemon_meter_run(void* context);
+static bool daemon_publish(const ow_sample_t* samples, size_t count, void* context);
+
+//Receive from a meter resp. a capture until the daemon stops.
+//Sets errno on error (ECANCELED if the daemon stops).
+static bool daemon_recv_meter(daemon_meter_t* meter);
+static bool daemon_recv_replay(daemon_meter_t* meter);
+
+//Create the listening control socket (accessible for everybody).
+//Returns -1 on error and sets errno.
+static int daemon_listen(const char* socket_path);
+
+//Answer the request of a freshly accepted client:
+static void daemon_serve(int client_fd);
+
+static void daemon_usage(const char* program)
+{
+	fprintf(stderr,
+		"Usage: %s [-s socket] [-c capacity] [-i dev_id] [-f] [-l] name=source ...\n"
+		"  source is the address of a multimeter (AA:BB:CC:DD:EE:FF), \"auto\" to scan for one\n"
+		"  or the path of a btsnoop capture to replay (-f: as fast as possible, -l: in a loop)\n",
+		program);
+}
+
+static bool daemon_parse_meter(const char* arg, daemon_meter_t* meter)
+{
+	const char* separator = strchr(arg, '=');
+
+	if (!separator || (separator == arg) || ((size_t)(separator - arg) > OW_SHM_MAX_NAME_LENGTH) || (separator[1] == '\0'))
+	{
+		return false;
+	}
+
+	memset(meter, 0, sizeof(daemon_meter_t));
+	memcpy(meter->name, arg, (size_t)(separator - arg));
+
+	const char* source = &separator[1];
+
+	meter->config.dev_id = daemon_options.dev_id;
+	meter->config.connect_mode = OW_CONNECT_MODE_AUTOMATIC;
+
+	if (strcmp(source, "auto") == 0)
+	{
+		meter->config.scan_mode = OW_SCAN_MODE_AUTOMATIC;
+	}
+	else if (bachk(source) == 0)
+	{
+		meter->config.scan_mode = OW_SCAN_MODE_NONE;
+		str2ba(source, &meter->config.addr);
+	}
+	else
+	{
+		meter->replay_path = source;
+	}
+
+	return true;
+}
+
+static void* daemon_meter_run(void* context)
+{
+	daemon_meter_t* meter = context;
+	bool result = meter->replay_path ? daemon_recv_replay(meter) : daemon_recv_meter(meter);
+
+	//A stop request is no error:
+	int error = (result || (errno == ECANCELED)) ? 0 : errno;
+
+	if (error != 0)
+	{
+		fprintf(stderr, "Meter %s: %s\n", meter->name, strerror(error));
+	}
+
+	ow_shm_ring_finish(meter->ring, error);
+
+	return NULL;
+}
+
+static bool daemon_publish(const ow_sample_t* samples, size_t count, void* context)
+{
+	daemon_meter_t* meter = context;
+
+	ow_shm_ring_publish(meter->ring, samples, count);
+	return true;
+}
+
+static bool daemon_recv_meter(daemon_meter_t* meter)
+{
+	//The persistent session reconnects on its own, so the clients never notice a dropped link.
+	//Its waits end as soon as the daemon stops, even if the meter is out of range:
+	ow_persist_params params =
+	{
+		.cache_path = NULL,
+		.min_backoff_ms = 250,
+		.max_backoff_ms = 30000,
+		.max_attempts = 0,
+		.cancel_fd = daemon_stop_fd
+	};
+
+	ow_persistent_t persistent;
+	ow_source_t source;
+
+	if (!ow_persistent_open(&persistent, &meter->config, &params, &source))
+	{
+		return false;
+	}
+
+	bool result = ow_recv_batch_source(&source, daemon_publish, meter, DAEMON_MAX_BATCH, 0);
+
+	//Restore the HCI filter and disconnect, whatever has happened:
+	int error = errno;
+	ow_persistent_close(&persistent);
+	errno = error;
+
+	return result;
+}
+
+static bool daemon_recv_replay(daemon_meter_t* meter)
+{
+	while (true)
+	{
+		int fd = open(meter->replay_path, O_RDONLY | O_CLOEXEC);
+
+		if (fd < 0)
+		{
+			return false;
+		}
+
+		//Waiting for data (a pipe may stay silent) and for the recorded pace of the frames ends as soon as the daemon stops:
+		ow_replay_t replay;
+		ow_source_t source;
+		ow_replay_pacing_t pacing = daemon_options.is_fast ? OW_REPLAY_PACING_NONE : OW_REPLAY_PACING_RECORDED;
+
+		if (!ow_replay_init(&replay, fd, OW_REPLAY_FORMAT_BTSNOOP, pacing, daemon_stop_fd, OW_HCI_HANDLE_ANY, &source))
+		{
+			int error = errno;
+			close(fd);
+
+			errno = error;
+			return false;
+		}
+
+		bool result = ow_recv_batch_source(&source, daemon_publish, meter, DAEMON_MAX_BATCH, 0);
+		int error = errno;
+
+		close(fd);
+
+		//Start over at the end of the capture if we shall loop:
+		if (result || (error != ENODATA) || !daemon_options.is_looped)
+		{
+			errno = error;
+			return result;
+		}
+	}
+}
+
+static int daemon_listen(const char* socket_path)
+{
+	struct sockaddr_un addr = { .sun_family = AF_UNIX };
+
+	if (strlen(socket_path) >= sizeof(addr.sun_path))
+	{
+		errno = ENAMETOOLONG;
+		return -1;
+	}
+
+	strcpy(addr.sun_path, socket_path);
+
+	int sock = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+
+	if (sock < 0)
+	{
+		return -1;
+	}
+
+	//A socket file left behind by an earlier daemon would make bind(...) fail:
+	unlink(socket_path);
+
+	int error;
+
+	if (bind(sock, (struct sockaddr*)&addr, sizeof(addr)) != 0)
+	{
+		error = errno;
+		goto close_out;
+	}
+
+	//Clients don't need any privileges:
+	if ((chmod(socket_path, 0666) != 0) || (listen(sock, SOMAXCONN) != 0))
+	{
+		error = errno;
+		unlink(socket_path);
+		goto close_out;
+	}
+
+	return sock;
+
+close_out:
+	close(sock);
+
+	errno = error;
+	return -1;
+}
+
+static void daemon_serve(int client_fd)
+{
+	//Don't let a client stall the daemon:
+	struct timeval timeout = { .tv_sec = DAEMON_REQUEST_TIMEOUT_MS / 1000, .tv_usec = (DAEMON_REQUEST_TIMEOUT_MS % 1000) * 1000 };
+	setsockopt(client_fd, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+
+	ow_shm_request_t request;
+	ssize_t length = recv(client_fd, &request, sizeof(request), 0);
+
+	if (length < 0)
+	{
+		return;
+	}
+
+	if ((length != (ssize_t)sizeof(request)) || (request.version != OW_SHM_VERSION) || (memchr(request.name, '\0', sizeof(request.name)) == NULL))
+	{
+		ow_shm_ring_reply(NULL, client_fd, EPROTO);
+		return;
+	}
+
+	for (size_t i = 0; i < daemon_meter_count; i++)
+	{
+		if (strcmp(daemon_meters[i].name, request.name) == 0)
+		{
+			ow_shm_ring_reply(daemon_meters[i].ring, client_fd, 0);
+			return;
+		}
+	}
+
+	ow_shm_ring_reply(NULL, client_fd, ENOENT);
+}
+
+int main(int argc, char** argv)
+{
+	int option;
+
+	while ((option = getopt(argc, argv, "s:c:i:flh")) != -1)
+	{
+		switch (option)
+		{
+		case 's':
+			daemon_options.socket_path = optarg;
+			break;
+
+		case 'c':
+			daemon_options.capacity = strtoul(optarg, NULL, 10);
+			break;
+
+		case 'i':
+			daemon_options.dev_id = atoi(optarg);
+			break;
+
+		case 'f':
+			daemon_options.is_fast = true;
+			break;
+
+		case 'l':
+			daemon_options.is_looped = true;
+			break;
+
+		default:
+			daemon_usage(argv[0]);
+			return (option == 'h') ? 0 : EXIT_FAILURE;
+		}
+	}
+
+	if ((optind >= argc) || ((size_t)(argc - optind) > DAEMON_MAX_METERS) || (daemon_options.capacity == 0))
+	{
+		daemon_usage(argv[0]);
+		return EXIT_FAILURE;
+	}
+
+	//Parse the meters and create their rings:
+	int exit_code = EXIT_FAILURE;
+
+	for (int i = optind; i < argc; i++)
+	{
+		daemon_meter_t* meter = &daemon_meters[daemon_meter_count];
+
+		if (!daemon_parse_meter(argv[i], meter))
+		{
+			fprintf(stderr, "Malformed meter \"%s\"\n", argv[i]);
+			goto destroy_out;
+		}
+
+		meter->ring = ow_shm_ring_create(meter->name, daemon_options.capacity);
+
+		if (!meter->ring)
+		{
+			perror("Creating a ring failed");
+			goto destroy_out;
+		}
+
+		daemon_meter_count++;
+	}
+
+	//Take SIGINT and SIGTERM via a descriptor, so the main loop can shut down cleanly (and restore the HCI filters):
+	sigset_t signals;
+	sigemptyset(&signals);
+	sigaddset(&signals, SIGINT);
+	sigaddset(&signals, SIGTERM);
+
+	//Block them before starting threads, so they inherit the mask:
+	pthread_sigmask(SIG_BLOCK, &signals, NULL);
+
+	int signal_fd = signalfd(-1, &signals, SFD_CLOEXEC);
+
+	if (signal_fd < 0)
+	{
+		perror("Creating the signal descriptor failed");
+		goto destroy_out;
+	}
+
+	daemon_stop_fd = eventfd(0, EFD_CLOEXEC);
+
+	if (daemon_stop_fd < 0)
+	{
+		perror("Creating the stop descriptor failed");
+		goto signal_out;
+	}
+
+	int listen_fd = daemon_listen(daemon_options.socket_path);
+
+	if (listen_fd < 0)
+	{
+		perror("Creating the control socket failed");
+		goto stop_fd_out;
+	}
+
+	//Connect to the meters:
+	for (size_t i = 0; i < daemon_meter_count; i++)
+	{
+		int error = pthread_create(&daemon_meters[i].thread, NULL, daemon_meter_run, &daemon_meters[i]);
+
+		if (error != 0)
+		{
+			errno = error;
+			perror("Starting a meter thread failed");
+			goto stop_out;
+		}
+
+		daemon_meters[i].is_started = true;
+	}
+
+	//Serve clients until we are told to stop:
+	while (true)
+	{
+		struct pollfd poll_fds[2] =
+		{
+			{ .fd = listen_fd, .events = POLLIN },
+			{ .fd = signal_fd, .events = POLLIN }
+		};
+
+		if (poll(poll_fds, 2, -1) < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+
+			perror("Polling failed");
+			goto stop_out;
+		}
+
+		if (poll_fds[1].revents)
+		{
+			//Consume the signal, so unblocking it later doesn't deliver it once more:
+			struct signalfd_siginfo info;
+			ssize_t bytes_read = read(signal_fd, &info, sizeof(info));
+			(void)bytes_read;
+
+			break;
+		}
+
+		int client_fd = accept4(listen_fd, NULL, NULL, SOCK_CLOEXEC);
+
+		if (client_fd >= 0)
+		{
+			daemon_serve(client_fd);
+			close(client_fd);
+		}
+	}
+
+	exit_code = 0;
+
+stop_out:
+	//Wake up the meter threads, wherever they wait (for frames, the recorded pace, a scan or a reconnect).
+	//Only a connection attempt runs until its timeout. Another signal ends the daemon right away.
+	eventfd_write(daemon_stop_fd, 1);
+	pthread_sigmask(SIG_UNBLOCK, &signals, NULL);
+
+	for (size_t i = 0; i < daemon_meter_count; i++)
+	{
+		if (daemon_meters[i].is_started)
+		{
+			pthread_join(daemon_meters[i].thread, NULL);
+		}
+	}
+
+	close(listen_fd);
+	unlink(daemon_options.socket_path);
+
+stop_fd_out:
+	close(daemon_stop_fd);
+
+signal_out:
+	close(signal_fd);
+
+destroy_out:
+	for (size_t i = 0; i < daemon_meter_count; i++)
+	{
+		ow_shm_ring_destroy(daemon_meters[i].ring);
+	}
+
+	return exit_code;
+}
@@ -1,8 +1,11 @@
 #ifndef __OW18B_H__
 #define __OW18B_H__
 
+#include <math.h>
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
+#include <time.h>
 
 #include <bluetooth/bluetooth.h>
 #include <bluetooth/hci.h>
@@ -11,6 +14,12 @@
 //Use the device ID of the default adapter:
 #define OW_DEV_ID_AUTOMATIC -1
 
+//Accept frames of any HCI connection (useful for replays):
+#define OW_HCI_HANDLE_ANY 0xFFFF
+
+//The maximum length of a device's friendly name, without zero terminator:
+#define OW_MAX_NAME_LENGTH 29
+
 typedef enum __ow_scan_mode_t__
 {
 	OW_SCAN_MODE_NONE,
@@ -41,10 +50,28 @@ typedef struct __ow_scan_params_t__
 	//Filter type to choose which advertising info blobs we look at:
 	ow_scan_filter_type_t filter_type;
 
-	//Which friendly device name to look for?
+	//Which friendly device name to look for? ("ow_scan(...)" accepts NULL for every named device.)
 	const char* name;
 } ow_scan_params;
 
+//A multimeter found by "ow_scan(...)":
+typedef struct __ow_scan_result_t__
+{
+	//The address to put into "ow_config_t" (and its type):
+	bdaddr_t addr;
+	uint8_t addr_type;
+
+	//The friendly name:
+	char name[OW_MAX_NAME_LENGTH + 1];
+
+	//The signal strength of the last advertisement in dBm:
+	int8_t rssi;
+
+	//When the last advertisement has arrived (CLOCK_MONOTONIC) and how many have been seen:
+	struct timespec last_seen;
+	unsigned int seen_count;
+} ow_scan_result_t;
+
 typedef enum __ow_connect_mode_t__
 {
 	OW_CONNECT_MODE_AUTOMATIC,
@@ -68,6 +95,54 @@ typedef struct __ow_connect_params_t__
 	int to;
 } ow_connect_params;
 
+//Why the receive loop has dropped a frame:
+typedef enum __ow_reject_reason_t__
+{
+	//Not exactly one sample long:
+	OW_REJECT_REASON_LENGTH,
+
+	//Header fields that differ from a notification of the multimeter:
+	OW_REJECT_REASON_PACKET_TYPE,
+	OW_REJECT_REASON_HANDLE,
+	OW_REJECT_REASON_TOTAL_LENGTH,
+	OW_REJECT_REASON_L2CAP_LENGTH,
+	OW_REJECT_REASON_CID,
+	OW_REJECT_REASON_ATT_OPCODE,
+	OW_REJECT_REASON_ATT_HANDLE,
+
+	OW_REJECT_REASON_COUNT
+} ow_reject_reason_t;
+
+//Counters of a receive loop (owned by the caller, zero them before use and read them via "ow_get_stats(...)"):
+typedef struct __ow_stats_t__
+{
+	//Everything the source has delivered:
+	uint64_t frames_read;
+	uint64_t bytes_read;
+
+	//Dropped frames by reason:
+	uint64_t rejected[OW_REJECT_REASON_COUNT];
+
+	//Reads that have been retried because of EAGAIN or EINTR:
+	uint64_t retries;
+
+	//Accepted samples and the odd ones among them:
+	uint64_t samples;
+	uint64_t unknown_units;
+	uint64_t overflows;
+
+	//How often the receive loop has called back.
+	//Only every 64th callback is timed: "callback_ns" is the total time of the "timed_callbacks" (divide them for the mean).
+	uint64_t callbacks;
+	uint64_t timed_callbacks;
+	uint64_t callback_ns;
+} ow_stats_t;
+
+//A function that sees every frame the receive loop reads, valid or not (e. g. to capture the raw traffic).
+//It gets the frame, its length, its receive time and a user-provided context.
+//It runs on the receive path, so it must not block.
+typedef void (*ow_tap_func_t)(const uint8_t*, size_t, const struct timespec*, void*);
+
 typedef struct __ow_config_t__
 {
 	//The device ID to use (can be OW_DEV_ID_AUTOMATIC):
@@ -90,44 +165,113 @@ typedef struct __ow_config_t__
 
 	//The parameters to use for connecting (only if connect_mode == OW_CONNECT_MODE_AUTOMATIC):
 	ow_connect_params connect_params;
-} ow_config_t;
-
-//The units of measurement:
-typedef enum __ow_unit_t__
-{
-	OW_UNIT_MILLIVOLT, 			//0xF018 (DC), 0xF058 (AC)
-	OW_UNIT_VOLT, 				//0xF020 (DC), 0xF060 (AC), 0xF2A0 (diode test)
 
-	OW_UNIT_MICROAMPERE, 		//0xF090 (DC), 0xF0D0 (AC)
-	OW_UNIT_MILLIAMPERE, 		//0xF098 (DC), 0xF0D8 (AC)
-	OW_UNIT_AMPERE, 			//0xF0A0 (DC), 0xF0E0 (AC)
+	//Counters to update while receiving (can be NULL):
+	ow_stats_t* stats;
 
-	OW_UNIT_OHM, 				//0xF120 (normal), 0xF2E0 (continuity test)
-	OW_UNIT_KILOOHM, 			//0xF128
-	OW_UNIT_MEGAOHM, 			//0xF130
-
-	OW_UNIT_NANOFARAD, 			//0xF148
-	OW_UNIT_MICROFARAD, 		//0xF150
-	OW_UNIT_MILLIFARAD, 		//0xF158
-	OW_UNIT_FARAD, 				//0xF160 (?)
+	//A function that sees every frame that is read while receiving (can be NULL, see "ow_tap_func_t"):
+	ow_tap_func_t tap;
+	void* tap_context;
+} ow_config_t;
 
-	OW_UNIT_HERTZ, 				//0xF1A0
-	OW_UNIT_PERCENT, 			//0xF1E0
+//The two types of current:
+typedef enum __ow_current_type_t__
+{
+	OW_CURRENT_TYPE_DC,
+	OW_CURRENT_TYPE_AC
+} ow_current_type_t;
 
-	OW_UNIT_CELSIUS, 			//0xF220
-	OW_UNIT_FAHRENHEIT, 		//0xF260
+//The units of measurement.
+//X(name, long string, short string, decimal exponent w.r.t. the SI base unit, unit with the same quantity and exponent 0, quantity)
+#define OW_UNITS(X) \
+	X(MILLIVOLT, 	"Millivolt", 	"mV", 	-3, 	VOLT, 			VOLTAGE) \
+	X(VOLT, 		"Volt", 		"V", 	0, 	VOLT, 			VOLTAGE) \
+	\
+	X(MICROAMPERE, 	"Microampere", 	"µA", 	-6, 	AMPERE, 		CURRENT) \
+	X(MILLIAMPERE, 	"Milliampere", 	"mA", 	-3, 	AMPERE, 		CURRENT) \
+	X(AMPERE, 		"Ampere", 		"A", 	0, 	AMPERE, 		CURRENT) \
+	\
+	X(OHM, 			"Ohm", 			"Ω", 	0, 	OHM, 			RESISTANCE) \
+	X(KILOOHM, 		"Kiloohm", 		"kΩ", 	3, 	OHM, 			RESISTANCE) \
+	X(MEGAOHM, 		"Megaohm", 		"MΩ", 	6, 	OHM, 			RESISTANCE) \
+	\
+	X(NANOFARAD, 	"Nanofarad", 	"nF", 	-9, 	FARAD, 			CAPACITANCE) \
+	X(MICROFARAD, 	"Microfarad", 	"µF", 	-6, 	FARAD, 			CAPACITANCE) \
+	X(MILLIFARAD, 	"Millifarad", 	"mF", 	-3, 	FARAD, 			CAPACITANCE) \
+	X(FARAD, 		"Farad", 		"F", 	0, 	FARAD, 			CAPACITANCE) \
+	\
+	X(HERTZ, 		"Hertz", 		"Hz", 	0, 	HERTZ, 			FREQUENCY) \
+	X(PERCENT, 		"Percent", 		"%", 	0, 	PERCENT, 		PERCENTAGE) \
+	\
+	X(CELSIUS, 		"Celsius", 		"°C", 	0, 	CELSIUS, 		TEMPERATURE) \
+	X(FAHRENHEIT, 	"Fahrenheit", 	"°F", 	0, 	FAHRENHEIT, 	TEMPERATURE) \
+	\
+	X(NEARFIELD, 	"Near field", 	"NCV", 	0, 	NEARFIELD, 		NEAR_FIELD)
 
-	OW_UNIT_NEARFIELD, 			//0xF360 (0...4)
+typedef enum __ow_unit_t__
+{
+#define OW_UNIT_ENUM(name, str, short_str, exponent, base_unit, quantity) OW_UNIT_##name,
+	OW_UNITS(OW_UNIT_ENUM)
+#undef OW_UNIT_ENUM
 
 	OW_UNIT_UNKNOWN
 } ow_unit_t;
 
-//The two types of current:
-typedef enum __ow_current_type_t__
+//The unit words sent by the multimeter (lowermost 3 bits cleared, see "Internal data format" in the README).
+//Adding a row here is all it takes to support a new unit code.
+//X(code, unit, current type, is diode test, is continuity test)
+#define OW_UNIT_CODES(X) \
+	X(0xF018, MILLIVOLT, 	DC, false, false) \
+	X(0xF058, MILLIVOLT, 	AC, false, false) \
+	X(0xF020, VOLT, 		DC, false, false) \
+	X(0xF060, VOLT, 		AC, false, false) \
+	X(0xF2A0, VOLT, 		DC, true, 	false) \
+	\
+	X(0xF090, MICROAMPERE, 	DC, false, false) \
+	X(0xF0D0, MICROAMPERE, 	AC, false, false) \
+	X(0xF098, MILLIAMPERE, 	DC, false, false) \
+	X(0xF0D8, MILLIAMPERE, 	AC, false, false) \
+	X(0xF0A0, AMPERE, 		DC, false, false) \
+	X(0xF0E0, AMPERE, 		AC, false, false) \
+	\
+	X(0xF120, OHM, 			DC, false, false) \
+	X(0xF2E0, OHM, 			DC, false, true) \
+	X(0xF128, KILOOHM, 		DC, false, false) \
+	X(0xF130, MEGAOHM, 		DC, false, false) \
+	\
+	X(0xF148, NANOFARAD, 	DC, false, false) \
+	X(0xF150, MICROFARAD, 	DC, false, false) \
+	X(0xF158, MILLIFARAD, 	DC, false, false) \
+	X(0xF160, FARAD, 		DC, false, false) 	/* (?) */ \
+	\
+	X(0xF1A0, HERTZ, 		DC, false, false) \
+	X(0xF1E0, PERCENT, 		DC, false, false) \
+	\
+	X(0xF220, CELSIUS, 		DC, false, false) \
+	X(0xF260, FAHRENHEIT, 	DC, false, false) \
+	\
+	X(0xF360, NEARFIELD, 	DC, false, false) 	/* (0...4) */
+
+//The physical quantities the units measure.
+//X(name, string, unit normalized values are given in)
+#define OW_QUANTITIES(X) \
+	X(VOLTAGE, 		"Voltage", 		VOLT) \
+	X(CURRENT, 		"Current", 		AMPERE) \
+	X(RESISTANCE, 	"Resistance", 	OHM) \
+	X(CAPACITANCE, 	"Capacitance", 	FARAD) \
+	X(FREQUENCY, 	"Frequency", 	HERTZ) \
+	X(PERCENTAGE, 	"Percentage", 	PERCENT) \
+	X(TEMPERATURE, 	"Temperature", 	CELSIUS) \
+	X(NEAR_FIELD, 	"Near field", 	NEARFIELD)
+
+typedef enum __ow_quantity_t__
 {
-	OW_CURRENT_TYPE_DC,
-	OW_CURRENT_TYPE_AC
-} ow_current_type_t;
+#define OW_QUANTITY_ENUM(name, str, unit) OW_QUANTITY_##name,
+	OW_QUANTITIES(OW_QUANTITY_ENUM)
+#undef OW_QUANTITY_ENUM
+
+	OW_QUANTITY_UNKNOWN
+} ow_quantity_t;
 
 //A sample of measurement data:
 typedef struct __ow_sample_t__
@@ -160,17 +304,421 @@ typedef struct __ow_sample_t__
 
 	//Is the multimeter battery low?
 	bool is_low_battery;
+
+	//The raw fields of the frame the sample has been decoded from.
+	//The unit code (see OW_UNIT_CODES) is kept even for OW_UNIT_UNKNOWN.
+	//"magnitude" holds the displayed digits without decimal point, "places" the number of decimal places.
+	uint16_t unit_code;
+	uint16_t magnitude;
+	uint8_t places;
+	bool is_negative;
+	bool is_overflow;
+
+	//When the frame has been received (CLOCK_REALTIME).
+	//This is the arrival time in the kernel if the source supports it, otherwise the time right after reading.
+	//Decoding functions without a source leave it zero.
+	struct timespec timestamp;
 } ow_sample_t;
 
+//Bits of the unit word of a payload:
+#define OW_UNIT_CODE_MASK 0xFFF8
+#define OW_OVERFLOW_BIT (1 << 2)
+#define OW_PLACES_MASK 0x0003
+
+//Bits of the value word:
+#define OW_VALUE_MAGNITUDE_MASK 0x3FFF
+#define OW_VALUE_SIGN_BIT 0x8000
+
+//Bits of the flag byte:
+#define OW_FLAG_DATA_HOLD (1 << 0)
+#define OW_FLAG_RELATIVE (1 << 1)
+#define OW_FLAG_AUTO_RANGE (1 << 2)
+#define OW_FLAG_LOW_BATTERY (1 << 3)
+#define OW_FLAGS_MASK 0x0F
+
+//A sample packed into 8 bytes for bulk storage and transport.
+//The words keep the layout of the frame (see "Internal data format" in the README), unused bits are zero.
+typedef struct __ow_sample_packed_t__
+{
+	//Unit code (bits 3 to 15), overflow (bit 2) and decimal places (bits 0 and 1):
+	uint16_t unit_places;
+
+	//Magnitude (bits 0 to 13) and sign (bit 15):
+	uint16_t value_sign;
+
+	//Data hold (bit 0), relative (bit 1), auto range (bit 2) and low battery (bit 3):
+	uint8_t flags;
+
+	uint8_t reserved[3];
+} ow_sample_packed_t;
+
+//A view of a validated frame in the receive buffer (see "ow_recv_view(...)").
+//Nothing is decoded up front, use the "ow_frame_view_...(...)" accessors for what you need.
+typedef struct __ow_frame_view_t__
+{
+	//The 6 payload bytes (unit word, flag byte, a zero byte and value word, see "Internal data format" in the README):
+	const uint8_t* payload;
+
+	//When the frame has been received (see "ow_sample_t"):
+	struct timespec timestamp;
+} ow_frame_view_t;
+
+//An exact decimal number: mantissa * 10^exponent (e. g. 1230 and -3 for a display of "1.230").
+typedef struct __ow_decimal_t__
+{
+	int64_t mantissa;
+	int32_t exponent;
+} ow_decimal_t;
+
+//A sample converted to the unit of its quantity (see "ow_normalize(...)"):
+typedef struct __ow_normalized_sample_t__
+{
+	//The quantity (OW_QUANTITY_UNKNOWN for unknown units):
+	ow_quantity_t quantity;
+
+	//The current type (only defined for voltage and current):
+	ow_current_type_t current_type;
+
+	//The value in the unit of the quantity (e. g. volts for OW_UNIT_MILLIVOLT, °C for OW_UNIT_FAHRENHEIT).
+	//On overflow, this will be NaN.
+	double value;
+
+	//Modes that change the meaning of the value (see "ow_sample_t"):
+	bool is_continuity_test;
+	bool is_diode_test;
+	bool is_relative;
+
+	//The receive time of the sample:
+	struct timespec timestamp;
+} ow_normalized_sample_t;
+
 //A callback to a function that receives a sample and a user-provided context.
 //The return value indicates if more samples shall be fetched.
 typedef bool (*ow_sample_func_t)(ow_sample_t, void*);
 
+//Same for packed samples:
+typedef bool (*ow_sample_packed_func_t)(ow_sample_packed_t, void*);
+
+//Same for frame views (the view and its payload are only valid during the call):
+typedef bool (*ow_frame_view_func_t)(const ow_frame_view_t*, void*);
+
+//A callback to a function that receives a batch of samples, their number and a user-provided context.
+//The samples are only valid during the call. The return value indicates if more samples shall be fetched.
+typedef bool (*ow_batch_func_t)(const ow_sample_t*, size_t, void*);
+
+//Same for normalized samples:
+typedef bool (*ow_normalized_batch_func_t)(const ow_normalized_sample_t*, size_t, void*);
+
+//A run of frames with identical payloads (see "ow_recv_changes(...)"):
+typedef struct __ow_sample_run_t__
+{
+	//The sample of the run. Its timestamp is the receive time of the first frame:
+	ow_sample_t sample;
+
+	//The receive time of the last frame:
+	struct timespec last_timestamp;
+
+	//The number of frames in the run (at least 1):
+	uint64_t count;
+
+	//Has the run been cut by the heartbeat (instead of a new value)?
+	bool is_heartbeat;
+} ow_sample_run_t;
+
+//A callback to a function that receives a run of identical samples and a user-provided context.
+//The run is only valid during the call. The return value indicates if more samples shall be fetched.
+typedef bool (*ow_sample_run_func_t)(const ow_sample_run_t*, void*);
+
+//A function that reads the next raw HCI frame (starting with the packet type byte) into the given buffer.
+//It behaves like read(2): Returns the length of exactly one frame, 0 on EoF or -1 with errno set.
+//EAGAIN and EINTR are treated as recoverable by the receive loop.
+//The receive time of the frame (CLOCK_REALTIME) goes to the timespec. Leave it zero if unknown, the receive loop fills in the current time then.
+typedef int (*ow_source_read_func_t)(void*, uint8_t*, size_t, struct timespec*);
+
+//A function that reads up to "count" frames at once without blocking (e. g. via recvmmsg(2)).
+//Frame i goes to "bufs + i * stride", its length to "lengths[i]" (a zero length signals EoF) and its receive time to "timestamps[i]" (see above).
+//Returns the number of frames or -1 with errno set (EAGAIN if nothing is ready).
+typedef int (*ow_source_read_many_func_t)(void*, uint8_t*, size_t, size_t, size_t*, struct timespec*);
+
+//A source of raw HCI frames that drives the receive loop:
+typedef struct __ow_source_t__
+{
+	//The read functions and their context ("read_many" is optional and may be NULL):
+	ow_source_read_func_t read;
+	ow_source_read_many_func_t read_many;
+	void* context;
+
+	//A descriptor that can be polled for new frames or -1 if there is none (reads may block then):
+	int fd;
+
+	//The HCI handle of the multimeter connection (can be OW_HCI_HANDLE_ANY):
+	uint16_t hci_handle;
+
+	//Counters to update while receiving from this source (can be NULL, the init functions set it to NULL):
+	ow_stats_t* stats;
+
+	//A function that sees every frame read from this source (can be NULL, the init functions set it to NULL):
+	ow_tap_func_t tap;
+	void* tap_context;
+} ow_source_t;
+
+//The framing of replayed data:
+typedef enum __ow_replay_format_t__
+{
+	//Every read(2) on the descriptor yields exactly one frame (socketpair, SOCK_SEQPACKET, ...):
+	OW_REPLAY_FORMAT_DATAGRAM,
+
+	//A btsnoop capture (datalink type H4) in a file or pipe:
+	OW_REPLAY_FORMAT_BTSNOOP
+} ow_replay_format_t;
+
+//The speed of a replay:
+typedef enum __ow_replay_pacing_t__
+{
+	//Deliver frames as fast as possible:
+	OW_REPLAY_PACING_NONE,
+
+	//Deliver frames at the pace they have been recorded with (only for timestamped formats):
+	OW_REPLAY_PACING_RECORDED
+} ow_replay_pacing_t;
+
+//The state of a replay source (owned by the caller, don't touch the members):
+typedef struct __ow_replay_t__
+{
+	int fd;
+	ow_replay_format_t format;
+	ow_replay_pacing_t pacing;
+	int cancel_fd;
+
+	//The first timestamp of the replay and the corresponding monotonic time:
+	bool has_origin;
+	uint64_t origin_timestamp;
+	struct timespec origin_time;
+} ow_replay_t;
+
+//Parameters for persistent sessions:
+typedef struct __ow_persist_params_t__
+{
+	//A file to cache the resolved address of the multimeter in (NULL for no cache):
+	const char* cache_path;
+
+	//The delay between reconnect attempts starts at "min_backoff_ms" and doubles up to "max_backoff_ms":
+	unsigned int min_backoff_ms;
+	unsigned int max_backoff_ms;
+
+	//How many reconnect attempts in a row before giving up (0 for never):
+	unsigned int max_attempts;
+
+	//A descriptor that cancels the session as soon as it becomes readable (e. g. an eventfd another thread writes to) or -1 for none.
+	//Scanning, waiting for frames and reconnecting fail with ECANCELED then. The source can't be polled (its "fd" is -1), its reads wait for both descriptors instead.
+	int cancel_fd;
+} ow_persist_params;
+
+//A persistent session that keeps its socket open and reconnects on its own (owned by the caller, don't touch the members):
+typedef struct __ow_persistent_t__
+{
+	ow_config_t config;
+	ow_persist_params params;
+
+	//The socket and the filter to restore:
+	int bt_sock;
+	struct hci_filter old_hci_filter;
+	socklen_t old_hci_filter_length;
+
+	//The multimeter and the current connection:
+	bdaddr_t addr;
+	uint16_t hci_handle;
+	bool is_connected;
+
+	//How many times the connection has been re-established (read-only):
+	unsigned int reconnects;
+} ow_persistent_t;
+
+//A multimeter of a multi-device receive:
+typedef struct __ow_multi_device_t__
+{
+	//The address of the multimeter:
+	bdaddr_t addr;
+
+	//The callback for its samples and the corresponding context:
+	ow_sample_func_t callback;
+	void* context;
+
+	//The HCI handle of its connection (set on connect, provide it yourself for sources):
+	uint16_t hci_handle;
+
+	//Has the callback returned false (set by the library)?
+	bool is_done;
+} ow_multi_device_t;
+
+//A receive session that can be driven from an event loop (owned by the caller, don't touch the members):
+typedef struct __ow_session_t__
+{
+	//The source of the frames (the HCI socket for connected sessions):
+	ow_source_t source;
+
+	//The connection (only for sessions opened via ow_session_open(...)):
+	bool is_connected;
+	int bt_sock;
+	uint16_t hci_handle;
+	struct hci_filter old_hci_filter;
+	socklen_t old_hci_filter_length;
+
+	//The descriptor flags to restore on close (-1 if untouched):
+	int old_fd_flags;
+} ow_session_t;
+
 //Convert sample stuff to strings:
 const char* ow_unit_to_str(ow_unit_t unit);
 const char* ow_unit_to_short_str(ow_unit_t unit);
 const char* ow_current_type_to_str(ow_current_type_t current_type);
 
+//Get the decimal exponent of a unit w.r.t. its SI base unit (e. g. -3 for OW_UNIT_MILLIVOLT):
+int ow_unit_to_si_exponent(ow_unit_t unit);
+
+//Get the unit with the same quantity and exponent 0 (e. g. OW_UNIT_VOLT for OW_UNIT_MILLIVOLT, units without prefix map to themselves):
+ow_unit_t ow_unit_to_base_unit(ow_unit_t unit);
+
+//Convert a value of a unit to its base unit (see "ow_unit_to_base_unit(...)", e. g. 0.3 mV become 0.0003 V). Values of unknown units are kept as they are.
+double ow_unit_to_base_value(ow_unit_t unit, double value);
+
+//Get the quantity a unit measures resp. a string representation and the unit of a quantity:
+ow_quantity_t ow_unit_to_quantity(ow_unit_t unit);
+const char* ow_quantity_to_str(ow_quantity_t quantity);
+ow_unit_t ow_quantity_to_unit(ow_quantity_t quantity);
+
+//Convert "count" samples to the units of their quantities, so values stay comparable when the range changes.
+//The conversion is a table lookup without branches per sample. Values of unknown units are kept as they are.
+//Relative values are differences, so the offset of Fahrenheit is left out for them (+9 °F become +5 °C).
+void ow_normalize(const ow_sample_t* samples, size_t count, ow_normalized_sample_t* normalized);
+
+//Get the exact value of a sample as displayed (magnitude and decimal places) resp. in its SI base unit (e. g. volts for millivolts).
+//Both only shift the exponent, nothing is rounded. Returns false on overflow (there is no value).
+bool ow_sample_to_decimal(const ow_sample_t* sample, ow_decimal_t* decimal);
+bool ow_sample_to_si_decimal(const ow_sample_t* sample, ow_decimal_t* decimal);
+
+//Compare two decimals exactly (-1, 0 or 1, like "strcmp(...)"), even if their exponents differ:
+int ow_decimal_compare(const ow_decimal_t* a, const ow_decimal_t* b);
+
+//Express a decimal as a multiple of 10^exponent (e. g. -6 for microvolts) and store that mantissa.
+//Returns false and sets errno to ERANGE if that is not exactly possible (digits would be lost or the mantissa overflows).
+bool ow_decimal_rescale(const ow_decimal_t* decimal, int32_t exponent, int64_t* mantissa);
+
+//Format a decimal without rounding (e. g. "-1.230", "0.005" or "4700") like "snprintf(...)":
+//Returns the length of the whole string (without the terminator), even if it has been truncated to "size".
+size_t ow_decimal_format(const ow_decimal_t* decimal, char* buf, size_t size);
+
+//Convert samples from and to their packed representation.
+//Both directions are lossless, except that the timestamp is not packed (unpacked samples have a zero timestamp).
+void ow_sample_pack(const ow_sample_t* sample, ow_sample_packed_t* packed);
+void ow_sample_unpack(const ow_sample_packed_t* packed, ow_sample_t* sample);
+
+//Look up what a unit code (see OW_UNIT_CODES, the lower 3 bits are ignored) stands for:
+ow_unit_t ow_unit_code_to_unit(uint16_t unit_code);
+ow_current_type_t ow_unit_code_to_current_type(uint16_t unit_code);
+bool ow_unit_code_is_diode_test(uint16_t unit_code);
+bool ow_unit_code_is_continuity_test(uint16_t unit_code);
+
+//Decode a frame view into a full sample (the same as "ow_recv(...)" delivers, including the timestamp):
+void ow_frame_view_decode(const ow_frame_view_t* view, ow_sample_t* sample);
+
+//Accessors that decode single fields of a frame view on demand:
+static inline uint16_t ow_frame_view_unit_places(const ow_frame_view_t* view)
+{
+	return (uint16_t)view->payload[0] | ((uint16_t)view->payload[1] << 8);
+}
+
+static inline uint16_t ow_frame_view_value_sign(const ow_frame_view_t* view)
+{
+	return (uint16_t)view->payload[4] | ((uint16_t)view->payload[5] << 8);
+}
+
+static inline uint8_t ow_frame_view_flags(const ow_frame_view_t* view)
+{
+	return view->payload[2] & OW_FLAGS_MASK;
+}
+
+static inline uint16_t ow_frame_view_unit_code(const ow_frame_view_t* view)
+{
+	return ow_frame_view_unit_places(view) & OW_UNIT_CODE_MASK;
+}
+
+static inline ow_unit_t ow_frame_view_unit(const ow_frame_view_t* view)
+{
+	return ow_unit_code_to_unit(ow_frame_view_unit_code(view));
+}
+
+static inline ow_current_type_t ow_frame_view_current_type(const ow_frame_view_t* view)
+{
+	return ow_unit_code_to_current_type(ow_frame_view_unit_code(view));
+}
+
+static inline uint16_t ow_frame_view_magnitude(const ow_frame_view_t* view)
+{
+	return ow_frame_view_value_sign(view) & OW_VALUE_MAGNITUDE_MASK;
+}
+
+static inline uint8_t ow_frame_view_places(const ow_frame_view_t* view)
+{
+	return ow_frame_view_unit_places(view) & OW_PLACES_MASK;
+}
+
+static inline bool ow_frame_view_is_negative(const ow_frame_view_t* view)
+{
+	return (ow_frame_view_value_sign(view) & OW_VALUE_SIGN_BIT) != 0;
+}
+
+static inline bool ow_frame_view_is_overflow(const ow_frame_view_t* view)
+{
+	return (ow_frame_view_unit_places(view) & OW_OVERFLOW_BIT) != 0;
+}
+
+//The value as "ow_sample_t" has it (NaN on overflow):
+static inline double ow_frame_view_value(const ow_frame_view_t* view)
+{
+	static const double place_divisors[OW_PLACES_MASK + 1] = { 1.0, 10.0, 100.0, 1000.0 };
+
+	if (ow_frame_view_is_overflow(view))
+	{
+		return NAN;
+	}
+
+	double value = (double)ow_frame_view_magnitude(view) / place_divisors[ow_frame_view_places(view)];
+	return ow_frame_view_is_negative(view) ? -value : value;
+}
+
+static inline bool ow_frame_view_is_data_hold(const ow_frame_view_t* view)
+{
+	return (view->payload[2] & OW_FLAG_DATA_HOLD) != 0;
+}
+
+static inline bool ow_frame_view_is_relative(const ow_frame_view_t* view)
+{
+	return (view->payload[2] & OW_FLAG_RELATIVE) != 0;
+}
+
+static inline bool ow_frame_view_is_auto_range(const ow_frame_view_t* view)
+{
+	return (view->payload[2] & OW_FLAG_AUTO_RANGE) != 0;
+}
+
+static inline bool ow_frame_view_is_low_battery(const ow_frame_view_t* view)
+{
+	return (view->payload[2] & OW_FLAG_LOW_BATTERY) != 0;
+}
+
+//Take a consistent-enough snapshot of counters that may be updated concurrently (e. g. by a stream's receiver thread):
+void ow_get_stats(const ow_stats_t* stats, ow_stats_t* snapshot);
+
+//Get a string representation of a reject reason:
+const char* ow_reject_reason_to_str(ow_reject_reason_t reason);
+
+//Scan on the given adapter (or OW_DEV_ID_AUTOMATIC) for "deadline_ms" milliseconds and collect every multimeter that advertises.
+//NULL parameters scan like OW_SCAN_MODE_AUTOMATIC. Each meter is reported once, with the RSSI of its last advertisement.
+//The results are sorted by RSSI (strongest first). If more than "max_results" meters answer, the later ones are ignored.
+//Their number is stored to "count". Sets errno on error.
+bool ow_scan(int dev_id, const ow_scan_params* params, unsigned long deadline_ms, ow_scan_result_t* results, size_t max_results, size_t* count);
+
 //Open a connection to the OWON device.
 //Use the provided configuration.
 //Provide samples via callback until false is returned.
@@ -181,4 +729,97 @@ bool ow_recv(const ow_config_t* config, ow_sample_func_t callback, void* context
 //Instead, we receive exactly n samples and write them to the given address.
 bool ow_recv_n(const ow_config_t* config, ow_sample_t* samples, int n);
 
+//Same as "ow_recv(...)" resp. "ow_recv_n(...)", but the frames are taken from the given source.
+//Nothing is connected or disconnected. The source is not closed.
+bool ow_recv_source(const ow_source_t* source, ow_sample_func_t callback, void* context);
+bool ow_recv_n_source(const ow_source_t* source, ow_sample_t* samples, int n);
+
+//Decode a single raw frame (starting with the packet type byte) of the given connection.
+//Returns false if the frame is not a valid sample notification.
+bool ow_decode_frame(const uint8_t* frame, size_t length, uint16_t hci_handle, ow_sample_t* sample);
+
+//Decode the 6 payload bytes of a frame that has already been validated:
+void ow_decode_payload(const uint8_t* payload, ow_sample_t* sample);
+
+//Decode "count" consecutive raw frames of exactly 18 bytes each.
+//The samples of valid frames are stored densely to "out", which must have room for "count" samples.
+//Returns the number of valid frames. If "rejected" is not NULL, the number of invalid frames is stored there.
+size_t ow_decode_frames(const uint8_t* frames, size_t count, uint16_t hci_handle, ow_sample_t* out, size_t* rejected);
+
+//Same as "ow_recv(...)" resp. "ow_recv_source(...)", but packed samples are delivered (nothing is decoded):
+bool ow_recv_packed(const ow_config_t* config, ow_sample_packed_func_t callback, void* context);
+bool ow_recv_packed_source(const ow_source_t* source, ow_sample_packed_func_t callback, void* context);
+
+//Same as "ow_recv(...)" resp. "ow_recv_source(...)", but a view of each validated frame is delivered (nothing is decoded or copied).
+//Consumers that only archive raw bytes or check a flag skip decoding altogether.
+bool ow_recv_view(const ow_config_t* config, ow_frame_view_func_t callback, void* context);
+bool ow_recv_view_source(const ow_source_t* source, ow_frame_view_func_t callback, void* context);
+
+//Same as "ow_recv(...)" resp. "ow_recv_source(...)", but samples are delivered in batches of up to "max_batch" samples.
+//Every wakeup drains all ready frames. A batch is handed to the callback as soon as it is full
+//or "max_latency_us" microseconds after its first sample have passed (0 flushes after every wakeup).
+//For sources that can't be polled, the latency bound is only checked after each frame.
+bool ow_recv_batch(const ow_config_t* config, ow_batch_func_t callback, void* context, size_t max_batch, unsigned long max_latency_us);
+bool ow_recv_batch_source(const ow_source_t* source, ow_batch_func_t callback, void* context, size_t max_batch, unsigned long max_latency_us);
+
+//Same as "ow_recv_batch(...)" resp. "ow_recv_batch_source(...)", but every batch is normalized (see "ow_normalize(...)") before it is handed to the callback.
+bool ow_recv_normalized(const ow_config_t* config, ow_normalized_batch_func_t callback, void* context, size_t max_batch, unsigned long max_latency_us);
+bool ow_recv_normalized_source(const ow_source_t* source, ow_normalized_batch_func_t callback, void* context, size_t max_batch, unsigned long max_latency_us);
+
+//Same as "ow_recv(...)" resp. "ow_recv_source(...)", but only changes are delivered.
+//Frames whose raw payload (value, unit and flags) equals the one before are coalesced into a run.
+//A run is handed to the callback when a different payload arrives, so it always lags one change behind.
+//If "heartbeat_ms" is not 0, a run is also handed over once it spans that many milliseconds (the next frame starts a new run).
+//When the source ends (ENODATA), the pending run is delivered before returning.
+bool ow_recv_changes(const ow_config_t* config, ow_sample_run_func_t callback, void* context, unsigned long heartbeat_ms);
+bool ow_recv_changes_source(const ow_source_t* source, ow_sample_run_func_t callback, void* context, unsigned long heartbeat_ms);
+
+//Connect to several OWON devices on a single HCI socket and demultiplex their samples by connection.
+//Only the adapter and connect settings of the configuration are used, the addresses come from "devices".
+//Every device receives samples until its callback returns false. Then, all devices are disconnected.
+bool ow_recv_multi(const ow_config_t* config, ow_multi_device_t* devices, size_t count);
+
+//Same as "ow_recv_multi(...)", but the frames are taken from the given source (its HCI handle is ignored).
+bool ow_recv_multi_source(const ow_source_t* source, ow_multi_device_t* devices, size_t count);
+
+//Open a persistent session to the OWON device and initialize a frame source for it.
+//If the configuration requires a scan and "params->cache_path" holds an address, the scan is skipped (unless connecting fails).
+//Resolved addresses are written to the cache. If "params" is NULL, there is no cache and reconnects are retried forever.
+//When the connection terminates (e. g. on supervision timeout), reading from the source reconnects with exponential backoff.
+//Reconnecting blocks, even on a non-blocking session (unless "params->cancel_fd" cancels it). Sets errno on error.
+bool ow_persistent_open(ow_persistent_t* persistent, const ow_config_t* config, const ow_persist_params* params, ow_source_t* source);
+
+//Restore the HCI filter, disconnect and close the socket:
+void ow_persistent_close(ow_persistent_t* persistent);
+
+//Open a non-blocking session to the OWON device, using the provided configuration.
+//Sets errno on error.
+bool ow_session_open(ow_session_t* session, const ow_config_t* config);
+
+//Open a non-blocking session on the given frame source (its descriptor is switched to non-blocking mode until closed).
+//Sets errno on error.
+bool ow_session_open_source(ow_session_t* session, const ow_source_t* source);
+
+//Get the descriptor to poll for readability (-1 if the source can't be polled):
+int ow_session_fd(const ow_session_t* session);
+
+//Decode the samples of all frames that are ready, without blocking, and store up to "max_samples" of them.
+//Their number is stored to "count" (can be 0). Frames beyond "max_samples" are left for the next call.
+//Sets errno on error (ENODATA if the source has ended).
+bool ow_session_process(ow_session_t* session, ow_sample_t* samples, size_t max_samples, size_t* count);
+
+//Close the session. Connected sessions restore the HCI filter, disconnect and close the socket.
+void ow_session_close(ow_session_t* session);
+
+//Initialize a frame source that performs one read(2) per frame on the given descriptor (e. g. an HCI socket).
+//Kernel receive timestamps are enabled on sockets.
+void ow_source_init_fd(ow_source_t* source, int fd, uint16_t hci_handle);
+
+//Initialize a frame source that replays frames from the given descriptor.
+//For btsnoop captures, the file header is consumed and validated.
+//"cancel_fd" cancels the replay as soon as it becomes readable (like "ow_persist_params.cancel_fd") or is -1 for none.
+//Reading the header, waiting for frames (also in the middle of a record) and pacing fail with ECANCELED then. The source can't be polled (its "fd" is -1).
+//Sets errno on error.
+bool ow_replay_init(ow_replay_t* replay, int fd, ow_replay_format_t format, ow_replay_pacing_t pacing, int cancel_fd, uint16_t hci_handle, ow_source_t* source);
+
 #endif
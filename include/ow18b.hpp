@@ -0,0 +1,634 @@
+#ifndef __OW18B_HPP__
+#define __OW18B_HPP__
+
+//A header-only C++20 layer on top of ow18b.h.
+//Errors are thrown as std::system_error with the errno value of the C function.
+
+extern "C"
+{
+#include "ow18b.h"
+}
+
+#include <array>
+#include <cerrno>
+#include <coroutine>
+#include <cstddef>
+#include <exception>
+#include <iterator>
+#include <span>
+#include <string_view>
+#include <system_error>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include <poll.h>
+
+#if __has_include(<generator>)
+#include <generator>
+#endif
+
+namespace ow
+{
+	//Throw the current errno:
+	[[noreturn]] inline void throw_errno(const char* what)
+	{
+		throw std::system_error(errno, std::generic_category(), what);
+	}
+
+	//Compile-time information about a unit (generated from OW_UNITS):
+	struct unit_info
+	{
+		ow_unit_t unit;
+		std::string_view name;
+		std::string_view symbol;
+
+		//The decimal exponent w.r.t. the SI base unit (e. g. -3 for OW_UNIT_MILLIVOLT) and the matching factor:
+		int si_exponent;
+		double si_factor;
+	};
+
+	namespace detail
+	{
+		constexpr double pow10(int exponent)
+		{
+			double factor = 1.0;
+
+			for (int i = 0; i < exponent; i++)
+			{
+				factor *= 10.0;
+			}
+
+			for (int i = 0; i > exponent; i--)
+			{
+				factor /= 10.0;
+			}
+
+			return factor;
+		}
+	}
+
+	inline constexpr std::array<unit_info, OW_UNIT_UNKNOWN> units =
+	{{
+#define OW_UNIT_INFO(name, str, short_str, exponent, base_unit, quantity) { OW_UNIT_##name, str, short_str, exponent, detail::pow10(exponent) },
+		OW_UNITS(OW_UNIT_INFO)
+#undef OW_UNIT_INFO
+	}};
+
+	//Look up a unit (OW_UNIT_UNKNOWN gives an empty entry):
+	constexpr unit_info unit_traits_of(ow_unit_t unit)
+	{
+		return (static_cast<unsigned int>(unit) < OW_UNIT_UNKNOWN) ? units[unit] : unit_info { OW_UNIT_UNKNOWN, "Unknown", "?", 0, 1.0 };
+	}
+
+	//The same as a type trait, e. g. "ow::unit_traits<OW_UNIT_MILLIVOLT>::symbol":
+	template <ow_unit_t Unit>
+	struct unit_traits
+	{
+		static constexpr ow_unit_t unit = Unit;
+		static constexpr std::string_view name = unit_traits_of(Unit).name;
+		static constexpr std::string_view symbol = unit_traits_of(Unit).symbol;
+		static constexpr int si_exponent = unit_traits_of(Unit).si_exponent;
+		static constexpr double si_factor = unit_traits_of(Unit).si_factor;
+	};
+
+	namespace detail
+	{
+		//Trampolines for the C callbacks.
+		//Exceptions must not unwind through the C receive loop, so they are parked here and rethrown afterwards.
+		template <typename Func>
+		struct callback_context
+		{
+			Func& func;
+			std::exception_ptr exception;
+		};
+
+		template <typename Func>
+		bool sample_trampoline(ow_sample_t sample, void* context)
+		{
+			auto* callback_context = static_cast<detail::callback_context<Func>*>(context);
+
+			try
+			{
+				return callback_context->func(static_cast<const ow_sample_t&>(sample));
+			}
+			catch (...)
+			{
+				callback_context->exception = std::current_exception();
+				return false;
+			}
+		}
+
+		template <typename Func>
+		bool batch_trampoline(const ow_sample_t* samples, size_t count, void* context)
+		{
+			auto* callback_context = static_cast<detail::callback_context<Func>*>(context);
+
+			try
+			{
+				return callback_context->func(std::span<const ow_sample_t>(samples, count));
+			}
+			catch (...)
+			{
+				callback_context->exception = std::current_exception();
+				return false;
+			}
+		}
+
+		//Turn the outcome of a C receive function into a return value resp. an exception:
+		template <typename Func>
+		bool finish_recv(bool result, callback_context<Func>& context, const char* what)
+		{
+			if (context.exception)
+			{
+				std::rethrow_exception(context.exception);
+			}
+
+			if (!result && (errno != ENODATA))
+			{
+				throw_errno(what);
+			}
+
+			return result;
+		}
+	}
+
+	//"ow_recv(...)" resp. "ow_recv_source(...)" with any callable like "bool(const ow_sample_t&)" (no void* context).
+	//Returns true if the callable has returned false and false if the source has ended (ENODATA). Other errors are thrown.
+	template <typename Func>
+	bool recv(const ow_config_t& config, Func&& func)
+	{
+		detail::callback_context<std::remove_reference_t<Func>> context { func, nullptr };
+		bool result = ow_recv(&config, detail::sample_trampoline<std::remove_reference_t<Func>>, &context);
+		return detail::finish_recv(result, context, "ow_recv");
+	}
+
+	template <typename Func>
+	bool recv(const ow_source_t& source, Func&& func)
+	{
+		detail::callback_context<std::remove_reference_t<Func>> context { func, nullptr };
+		bool result = ow_recv_source(&source, detail::sample_trampoline<std::remove_reference_t<Func>>, &context);
+		return detail::finish_recv(result, context, "ow_recv_source");
+	}
+
+	//"ow_recv_batch(...)" resp. "ow_recv_batch_source(...)" with any callable like "bool(std::span<const ow_sample_t>)" (returns the same as above):
+	template <typename Func>
+	bool recv_batch(const ow_config_t& config, Func&& func, size_t max_batch, unsigned long max_latency_us)
+	{
+		detail::callback_context<std::remove_reference_t<Func>> context { func, nullptr };
+		bool result = ow_recv_batch(&config, detail::batch_trampoline<std::remove_reference_t<Func>>, &context, max_batch, max_latency_us);
+		return detail::finish_recv(result, context, "ow_recv_batch");
+	}
+
+	template <typename Func>
+	bool recv_batch(const ow_source_t& source, Func&& func, size_t max_batch, unsigned long max_latency_us)
+	{
+		detail::callback_context<std::remove_reference_t<Func>> context { func, nullptr };
+		bool result = ow_recv_batch_source(&source, detail::batch_trampoline<std::remove_reference_t<Func>>, &context, max_batch, max_latency_us);
+		return detail::finish_recv(result, context, "ow_recv_batch_source");
+	}
+
+	class session;
+
+	//Something that resumes a coroutine once a descriptor is readable (see "poll_reactor" below):
+	template <typename Reactor>
+	concept reactor = requires(Reactor& reactor, int fd, std::coroutine_handle<> handle)
+	{
+		reactor.wait_readable(fd, handle);
+	};
+
+	//The awaitable of "session::next_batch_async(...)":
+	template <reactor Reactor>
+	class batch_awaiter
+	{
+	public:
+		batch_awaiter(session& session, std::span<ow_sample_t> buffer, Reactor& reactor) :
+			session_(session), buffer_(buffer), reactor_(reactor)
+		{
+		}
+
+		//Samples that are ready right away don't suspend at all:
+		bool await_ready();
+		void await_suspend(std::coroutine_handle<> handle);
+		std::span<const ow_sample_t> await_resume();
+
+	private:
+		session& session_;
+		std::span<ow_sample_t> buffer_;
+		Reactor& reactor_;
+		std::span<const ow_sample_t> result_;
+		bool is_ready_ = false;
+	};
+
+	//A move-only non-blocking session (see "ow_session_open(...)").
+	//The destructor restores the HCI filter and disconnects, also during stack unwinding.
+	class session
+	{
+	public:
+		//How many samples the range of "samples()" decodes at once:
+		static constexpr size_t range_batch_size = 64;
+
+		explicit session(const ow_config_t& config)
+		{
+			if (!ow_session_open(&session_, &config))
+			{
+				throw_errno("ow_session_open");
+			}
+
+			is_open_ = true;
+		}
+
+		explicit session(const ow_source_t& source)
+		{
+			if (!ow_session_open_source(&session_, &source))
+			{
+				throw_errno("ow_session_open_source");
+			}
+
+			is_open_ = true;
+		}
+
+		session(const session&) = delete;
+		session& operator=(const session&) = delete;
+
+		session(session&& other) noexcept :
+			session_(other.session_), is_open_(std::exchange(other.is_open_, false)), has_ended_(other.has_ended_)
+		{
+		}
+
+		session& operator=(session&& other) noexcept
+		{
+			if (this != &other)
+			{
+				close();
+
+				session_ = other.session_;
+				is_open_ = std::exchange(other.is_open_, false);
+				has_ended_ = other.has_ended_;
+			}
+
+			return *this;
+		}
+
+		~session()
+		{
+			close();
+		}
+
+		//Close early (the destructor does nothing afterwards):
+		void close() noexcept
+		{
+			if (is_open_)
+			{
+				ow_session_close(&session_);
+				is_open_ = false;
+			}
+		}
+
+		//The descriptor to wait for (-1 if the source can't be polled):
+		int fd() const
+		{
+			return ow_session_fd(&session_);
+		}
+
+		//Has the source ended (ENODATA)?
+		bool has_ended() const
+		{
+			return has_ended_;
+		}
+
+		//Decode whatever is ready without blocking into "buffer" and return the filled part (can be empty).
+		std::span<const ow_sample_t> process(std::span<ow_sample_t> buffer)
+		{
+			size_t count = 0;
+
+			if (has_ended_)
+			{
+				return {};
+			}
+
+			if (!ow_session_process(&session_, buffer.data(), buffer.size(), &count))
+			{
+				if (errno != ENODATA)
+				{
+					throw_errno("ow_session_process");
+				}
+
+				has_ended_ = true;
+			}
+
+			return buffer.first(count);
+		}
+
+		//Wait for the next samples and return them. Only an ended source gives an empty span.
+		std::span<const ow_sample_t> next_batch(std::span<ow_sample_t> buffer)
+		{
+			while (!has_ended_)
+			{
+				std::span<const ow_sample_t> samples = process(buffer);
+
+				if (!samples.empty() || has_ended_)
+				{
+					return samples;
+				}
+
+				//Sources that can't be polled block in "process(...)" instead:
+				if (fd() >= 0)
+				{
+					struct pollfd poll_fd = { .fd = fd(), .events = POLLIN, .revents = 0 };
+
+					if ((poll(&poll_fd, 1, -1) < 0) && (errno != EINTR))
+					{
+						throw_errno("poll");
+					}
+				}
+			}
+
+			return {};
+		}
+
+		//"co_await session.next_batch_async(buffer, reactor)" suspends until the descriptor is readable and gives the samples.
+		//The result can be empty if the frames have been no samples (just await again) or if the source has ended (see "has_ended()").
+		template <reactor Reactor>
+		batch_awaiter<Reactor> next_batch_async(std::span<ow_sample_t> buffer, Reactor& reactor)
+		{
+			return batch_awaiter<Reactor>(*this, buffer, reactor);
+		}
+
+		//An input range over the samples that ends with the source:
+		//"for (const ow_sample_t& sample : session.samples()) { ... }"
+		class sample_range
+		{
+		public:
+			class iterator
+			{
+			public:
+				using iterator_category = std::input_iterator_tag;
+				using value_type = ow_sample_t;
+				using difference_type = std::ptrdiff_t;
+
+				iterator() = default;
+
+				explicit iterator(sample_range* range) :
+					range_(range)
+				{
+				}
+
+				const ow_sample_t& operator*() const
+				{
+					return range_->current_[range_->index_];
+				}
+
+				const ow_sample_t* operator->() const
+				{
+					return &range_->current_[range_->index_];
+				}
+
+				iterator& operator++()
+				{
+					range_->advance();
+					return *this;
+				}
+
+				void operator++(int)
+				{
+					range_->advance();
+				}
+
+				bool operator==(std::default_sentinel_t) const
+				{
+					return range_->index_ >= range_->current_.size();
+				}
+
+			private:
+				sample_range* range_ = nullptr;
+			};
+
+			explicit sample_range(session& session) :
+				session_(session)
+			{
+			}
+
+			//The range is single-pass, so "begin()" fetches the first batch:
+			iterator begin()
+			{
+				current_ = session_.next_batch(buffer_);
+				index_ = 0;
+
+				return iterator(this);
+			}
+
+			std::default_sentinel_t end() const
+			{
+				return std::default_sentinel;
+			}
+
+		private:
+			void advance()
+			{
+				if (++index_ >= current_.size())
+				{
+					current_ = session_.next_batch(buffer_);
+					index_ = 0;
+				}
+			}
+
+			session& session_;
+			std::array<ow_sample_t, range_batch_size> buffer_;
+			std::span<const ow_sample_t> current_;
+			size_t index_ = 0;
+		};
+
+		sample_range samples()
+		{
+			return sample_range(*this);
+		}
+
+#if defined(__cpp_lib_generator)
+		//The same as a std::generator (C++23):
+		std::generator<const ow_sample_t&> generate()
+		{
+			for (const ow_sample_t& sample : samples())
+			{
+				co_yield sample;
+			}
+		}
+#endif
+
+		//The underlying C session:
+		ow_session_t* get()
+		{
+			return &session_;
+		}
+
+	private:
+		ow_session_t session_ {};
+		bool is_open_ = false;
+		bool has_ended_ = false;
+	};
+
+	template <reactor Reactor>
+	bool batch_awaiter<Reactor>::await_ready()
+	{
+		result_ = session_.process(buffer_);
+		is_ready_ = !result_.empty() || session_.has_ended() || (session_.fd() < 0);
+
+		return is_ready_;
+	}
+
+	template <reactor Reactor>
+	void batch_awaiter<Reactor>::await_suspend(std::coroutine_handle<> handle)
+	{
+		reactor_.wait_readable(session_.fd(), handle);
+	}
+
+	template <reactor Reactor>
+	std::span<const ow_sample_t> batch_awaiter<Reactor>::await_resume()
+	{
+		return is_ready_ ? result_ : session_.process(buffer_);
+	}
+
+	//A minimal single-threaded reactor: "run()" polls all waiting descriptors and resumes their coroutines until nobody waits anymore.
+	//Any event loop with a "wait_readable(int, std::coroutine_handle<>)" member works the same way.
+	class poll_reactor
+	{
+	public:
+		void wait_readable(int fd, std::coroutine_handle<> handle)
+		{
+			waiters_.push_back({ fd, handle });
+		}
+
+		void run()
+		{
+			std::vector<struct pollfd> poll_fds;
+
+			while (!waiters_.empty())
+			{
+				poll_fds.clear();
+
+				for (const waiter& waiter : waiters_)
+				{
+					poll_fds.push_back({ .fd = waiter.fd, .events = POLLIN, .revents = 0 });
+				}
+
+				if (poll(poll_fds.data(), poll_fds.size(), -1) < 0)
+				{
+					if (errno == EINTR)
+					{
+						continue;
+					}
+
+					throw_errno("poll");
+				}
+
+				//Take the ready ones out before resuming, since they will wait again:
+				std::vector<std::coroutine_handle<>> ready;
+				std::vector<waiter> waiting;
+
+				for (size_t i = 0; i < poll_fds.size(); i++)
+				{
+					if (poll_fds[i].revents)
+					{
+						ready.push_back(waiters_[i].handle);
+					}
+					else
+					{
+						waiting.push_back(waiters_[i]);
+					}
+				}
+
+				waiters_ = std::move(waiting);
+
+				for (std::coroutine_handle<> handle : ready)
+				{
+					handle.resume();
+				}
+			}
+		}
+
+	private:
+		struct waiter
+		{
+			int fd;
+			std::coroutine_handle<> handle;
+		};
+
+		std::vector<waiter> waiters_;
+	};
+
+	//A minimal eagerly started coroutine for "co_await" (C++20 has none in the standard library).
+	//An exception inside the coroutine is kept and rethrown by "get()".
+	class task
+	{
+	public:
+		struct promise_type
+		{
+			std::exception_ptr exception;
+
+			task get_return_object()
+			{
+				return task(std::coroutine_handle<promise_type>::from_promise(*this));
+			}
+
+			std::suspend_never initial_suspend() noexcept
+			{
+				return {};
+			}
+
+			std::suspend_always final_suspend() noexcept
+			{
+				return {};
+			}
+
+			void return_void()
+			{
+			}
+
+			void unhandled_exception()
+			{
+				exception = std::current_exception();
+			}
+		};
+
+		task(task&& other) noexcept :
+			handle_(std::exchange(other.handle_, nullptr))
+		{
+		}
+
+		task(const task&) = delete;
+		task& operator=(const task&) = delete;
+		task& operator=(task&&) = delete;
+
+		~task()
+		{
+			if (handle_)
+			{
+				handle_.destroy();
+			}
+		}
+
+		bool is_done() const
+		{
+			return handle_.done();
+		}
+
+		//Rethrow the exception of a finished coroutine:
+		void get() const
+		{
+			if (handle_.done() && handle_.promise().exception)
+			{
+				std::rethrow_exception(handle_.promise().exception);
+			}
+		}
+
+	private:
+		explicit task(std::coroutine_handle<promise_type> handle) :
+			handle_(handle)
+		{
+		}
+
+		std::coroutine_handle<promise_type> handle_;
+	};
+}
+
+#endif
@@ -0,0 +1,69 @@
+#ifndef __OW18B_BROADCAST_H__
+#define __OW18B_BROADCAST_H__
+
+#include "ow18b.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+//A single-writer ring that any number of subscribers read from.
+//The publisher never waits: Once the ring is full, the oldest samples are overwritten.
+typedef struct __ow_broadcast_t__ ow_broadcast_t;
+
+//A cursor into a broadcast.
+//It belongs to one consumer thread. There is no need to unsubscribe, just stop polling.
+typedef struct __ow_subscriber_t__
+{
+	ow_broadcast_t* broadcast;
+
+	//The position of the next sample to read:
+	uint64_t position;
+
+	//How many samples have been read resp. overwritten before this subscriber could read them?
+	uint64_t received;
+	uint64_t dropped;
+} ow_subscriber_t;
+
+//Counters of a broadcast:
+typedef struct __ow_broadcast_stats_t__
+{
+	//The capacity of the ring (rounded up to a power of two):
+	size_t capacity;
+
+	//How many samples have been published?
+	uint64_t published;
+} ow_broadcast_stats_t;
+
+//Create a broadcast whose ring holds at least "capacity" samples.
+//Returns NULL on error and sets errno.
+ow_broadcast_t* ow_broadcast_create(size_t capacity);
+
+//Publish samples (from a single thread only).
+//Subscribers see each sample as soon as it has been written.
+void ow_broadcast_publish(ow_broadcast_t* broadcast, const ow_sample_t* samples, size_t count);
+
+//Sample resp. batch functions for "ow_recv(...)", "ow_recv_batch(...)" etc. (pass the broadcast as context).
+//They publish the samples and keep the receive loop running until "ow_broadcast_stop(...)" is called.
+bool ow_broadcast_sample_func(ow_sample_t sample, void* context);
+bool ow_broadcast_batch_func(const ow_sample_t* samples, size_t count, void* context);
+
+//Make the functions above return false, so the receive loop ends with the next sample (can be called from any thread):
+void ow_broadcast_stop(ow_broadcast_t* broadcast);
+
+//Get a snapshot of the counters (can be called from any thread):
+void ow_broadcast_get_stats(const ow_broadcast_t* broadcast, ow_broadcast_stats_t* stats);
+
+//Free the broadcast. Nobody may publish or poll anymore.
+void ow_broadcast_destroy(ow_broadcast_t* broadcast);
+
+//Subscribe to a broadcast (can be called from any thread at any time).
+//The subscriber starts with the next sample that is published.
+void ow_broadcast_subscribe(ow_broadcast_t* broadcast, ow_subscriber_t* subscriber);
+
+//Copy up to "max_samples" samples that the subscriber hasn't seen yet to "samples" (never blocks).
+//If the subscriber has fallen behind by more than the capacity, it skips to the oldest sample in the ring and counts the gap as dropped.
+//Returns the number of samples.
+size_t ow_subscriber_poll(ow_subscriber_t* subscriber, ow_sample_t* samples, size_t max_samples);
+
+#endif
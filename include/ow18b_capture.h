@@ -0,0 +1,42 @@
+#ifndef __OW18B_CAPTURE_H__
+#define __OW18B_CAPTURE_H__
+
+#include "ow18b.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+//A btsnoop capture file that is written by a background thread:
+typedef struct __ow_capture_t__ ow_capture_t;
+
+//Counters of a capture:
+typedef struct __ow_capture_stats_t__
+{
+	//Frames that have been queued resp. dropped because the buffer was full:
+	uint64_t frames;
+	uint64_t dropped;
+
+	//Bytes that have made it to the file (header included):
+	uint64_t bytes_written;
+} ow_capture_stats_t;
+
+//Create (or truncate) the btsnoop file at the given path and start the writer thread.
+//The buffer between the receive loop and the writer holds at least "buffer_size" bytes.
+//Returns NULL on error and sets errno.
+ow_capture_t* ow_capture_open(const char* path, size_t buffer_size);
+
+//Tap function for "ow_config_t" resp. "ow_source_t" (pass the capture as "tap_context").
+//Queues the frame with its receive time. Never blocks: If the buffer is full, the frame is dropped and counted.
+void ow_capture_tap(const uint8_t* frame, size_t length, const struct timespec* timestamp, void* context);
+
+//Get a snapshot of the counters (can be called while capturing):
+void ow_capture_get_stats(const ow_capture_t* capture, ow_capture_stats_t* stats);
+
+//Write the remaining frames, stop the writer thread and close the file.
+//Don't call this while a receive loop still taps into the capture.
+//Returns false and sets errno if writing has failed at some point.
+bool ow_capture_close(ow_capture_t* capture);
+
+#endif
@@ -0,0 +1,35 @@
+#ifndef __OW18B_CODEC_H__
+#define __OW18B_CODEC_H__
+
+#include "ow18b.h"
+#include "ow18b_log.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+//Parameters for encoding blocks:
+typedef struct __ow_codec_params_t__
+{
+	//Timestamps are stored in multiples of this (1 keeps nanoseconds, 1000000 milliseconds).
+	//Coarser timestamps compress much better. Decoded timestamps are rounded down to a multiple.
+	uint32_t timestamp_resolution_ns;
+} ow_codec_params;
+
+//The largest block "ow_codec_encode(...)" can produce for the given number of records:
+size_t ow_codec_max_length(size_t count);
+
+//Encode a block of records (packed samples with timestamps, e. g. from a log) into "buf" of "size" bytes.
+//If "params" is NULL, timestamps are kept in nanoseconds.
+//The length of the block is stored to "length". Sets errno on error (ENOBUFS if "size" is too small).
+bool ow_codec_encode(const ow_log_record_t* records, size_t count, const ow_codec_params* params, uint8_t* buf, size_t size, size_t* length);
+
+//Get the number of records in a block without decoding it.
+//Sets errno on error (EINVAL if the block is damaged).
+bool ow_codec_count(const uint8_t* buf, size_t length, size_t* count);
+
+//Decode a block into "records", which has room for "max_records" records. Their number is stored to "count".
+//Sets errno on error (EINVAL if the block is damaged, ENOBUFS if "max_records" is too small).
+bool ow_codec_decode(const uint8_t* buf, size_t length, ow_log_record_t* records, size_t max_records, size_t* count);
+
+#endif
@@ -0,0 +1,66 @@
+#ifndef __OW18B_LATENCY_H__
+#define __OW18B_LATENCY_H__
+
+#include "ow18b.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <time.h>
+
+//Every power of two is split into 2^OW_HISTOGRAM_SUB_BITS buckets (relative error below 12.5 %):
+#define OW_HISTOGRAM_SUB_BITS 3
+#define OW_HISTOGRAM_BUCKET_COUNT ((64 - OW_HISTOGRAM_SUB_BITS + 1) << OW_HISTOGRAM_SUB_BITS)
+
+//A histogram of durations in nanoseconds with logarithmic buckets (fixed size, no allocations):
+typedef struct __ow_histogram_t__
+{
+	uint64_t buckets[OW_HISTOGRAM_BUCKET_COUNT];
+
+	//Exact summary values:
+	uint64_t count;
+	uint64_t min_ns;
+	uint64_t max_ns;
+	uint64_t sum_ns;
+} ow_histogram_t;
+
+//Latency and jitter of the samples of one multimeter:
+typedef struct __ow_latency_t__
+{
+	//From the receive time of a sample to the call of "ow_latency_record(...)":
+	ow_histogram_t latency;
+
+	//The difference between two consecutive inter-arrival times:
+	ow_histogram_t jitter;
+
+	//Samples that have been received "in the future" (clock steps, recorded timestamps of replays):
+	uint64_t clock_anomalies;
+
+	//The previous sample (don't touch):
+	bool has_last;
+	struct timespec last_timestamp;
+	bool has_last_interval;
+	uint64_t last_interval_ns;
+} ow_latency_t;
+
+//Reset a histogram:
+void ow_histogram_init(ow_histogram_t* histogram);
+
+//Count a duration:
+void ow_histogram_record(ow_histogram_t* histogram, uint64_t ns);
+
+//Add the counts of "source" to "histogram":
+void ow_histogram_merge(ow_histogram_t* histogram, const ow_histogram_t* source);
+
+//Get an upper bound for the given quantile (0.0 to 1.0, e. g. 0.99) resp. the mean (0 if the histogram is empty):
+uint64_t ow_histogram_quantile(const ow_histogram_t* histogram, double quantile);
+uint64_t ow_histogram_mean(const ow_histogram_t* histogram);
+
+//Reset the latency and jitter histograms:
+void ow_latency_init(ow_latency_t* latency);
+
+//Call this first thing in your sample callback (or whenever the sample has reached its destination).
+//Records the latency from the receive time of the sample until now and the jitter of its arrival.
+void ow_latency_record(ow_latency_t* latency, const ow_sample_t* sample);
+
+#endif
@@ -0,0 +1,71 @@
+#ifndef __OW18B_LOG_H__
+#define __OW18B_LOG_H__
+
+#include "ow18b.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+//A fixed-size log record (timestamps are nanoseconds since the epoch, everything is in host byte order):
+typedef struct __ow_log_record_t__
+{
+	int64_t timestamp_ns;
+	ow_sample_packed_t sample;
+} ow_log_record_t;
+
+//Parameters for log writers:
+typedef struct __ow_log_params_t__
+{
+	//How many records go into one segment file before the next one is started:
+	uint64_t segment_records;
+
+	//Every "index_interval"-th record of a segment gets an entry in its sparse time index:
+	uint32_t index_interval;
+} ow_log_params;
+
+//An append-only log writer for the samples of one multimeter:
+typedef struct __ow_log_t__ ow_log_t;
+
+//A read-only view of a log:
+typedef struct __ow_log_reader_t__ ow_log_reader_t;
+
+//Function pointer to receive the records of a query. Return false to end the query.
+typedef bool (*ow_log_record_func_t)(const ow_log_record_t* record, void* context);
+
+//Open a log writer in the given (existing) directory. If "params" is NULL, default parameters are used.
+//Existing segments are kept, the writer always starts a new one.
+//Returns NULL on error and sets errno.
+ow_log_t* ow_log_open(const char* dir_path, const ow_log_params* params);
+
+//Append a sample with the given timestamp.
+//A timestamp that is older than its predecessor is raised to the predecessor's, so segments stay sorted.
+//Records are buffered, so errors may show up later (at the latest in "ow_log_close(...)"). Sets errno on error.
+//If writing or starting the next segment fails (e. g. ENOSPC or EMFILE), the next append tries again. Until that succeeds, appends are refused (there is no room).
+bool ow_log_append(ow_log_t* log, int64_t timestamp_ns, const ow_sample_t* sample);
+
+//Callbacks for "ow_recv(...)" resp. "ow_recv_batch(...)" that append samples with their receive time (the current time if it is zero).
+//Pass the log writer as context. The receive ends if appending fails.
+bool ow_log_sample_func(ow_sample_t sample, void* context);
+bool ow_log_batch_func(const ow_sample_t* samples, size_t count, void* context);
+
+//Write all buffered records to the segment.
+//Sets errno on error.
+bool ow_log_flush(ow_log_t* log);
+
+//Flush and close the log writer.
+//Returns false and sets errno if any error has occurred since the last flush (or in a sample callback).
+bool ow_log_close(ow_log_t* log);
+
+//Map all segments of the log in the given directory. Records that are appended later are not visible.
+//Returns NULL on error and sets errno.
+ow_log_reader_t* ow_log_reader_open(const char* dir_path);
+
+//Provide every record with t0 <= timestamp <= t1 via callback (sorted by timestamp within each segment).
+//Returns the number of records provided.
+size_t ow_log_query(const ow_log_reader_t* reader, int64_t t0, int64_t t1, ow_log_record_func_t callback, void* context);
+
+//Unmap the segments and free the reader:
+void ow_log_reader_close(ow_log_reader_t* reader);
+
+#endif
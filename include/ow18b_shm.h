@@ -0,0 +1,89 @@
+#ifndef __OW18B_SHM_H__
+#define __OW18B_SHM_H__
+
+#include "ow18b.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+//Where the daemon (see daemon/ow18bd.c) listens by default:
+#define OW_SHM_DEFAULT_SOCKET_PATH "/run/ow18bd.sock"
+
+//The maximum length of a meter name, without zero terminator:
+#define OW_SHM_MAX_NAME_LENGTH 31
+
+//The version of the control messages and the ring layout:
+#define OW_SHM_VERSION 1
+
+//A request on the control socket (SOCK_SEQPACKET, one message per request):
+typedef struct __ow_shm_request_t__
+{
+	uint32_t version;
+
+	//The name of the meter to attach to (zero-terminated):
+	char name[OW_SHM_MAX_NAME_LENGTH + 1];
+} ow_shm_request_t;
+
+//The reply to a request.
+//If "error" is 0, the descriptor of the ring comes along (SCM_RIGHTS). Otherwise, it is an errno value (e. g. ENOENT for an unknown meter).
+typedef struct __ow_shm_reply_t__
+{
+	int32_t error;
+} ow_shm_reply_t;
+
+//A ring of samples in a memfd that one writer (the daemon) shares with any number of readers in other processes:
+typedef struct __ow_shm_ring_t__ ow_shm_ring_t;
+
+//A client's read-only mapping of a ring and its position in it:
+typedef struct __ow_shm_client_t__ ow_shm_client_t;
+
+//Counters of a client:
+typedef struct __ow_shm_stats_t__
+{
+	//The capacity of the ring:
+	size_t capacity;
+
+	//How many samples have been read resp. overwritten before the client could read them?
+	uint64_t received;
+	uint64_t dropped;
+} ow_shm_stats_t;
+
+//Create a ring that holds at least "capacity" samples. The name only shows up in /proc (see memfd_create(2)).
+//Returns NULL on error and sets errno.
+ow_shm_ring_t* ow_shm_ring_create(const char* name, size_t capacity);
+
+//Publish samples (from a single thread only). The publisher never waits for readers.
+void ow_shm_ring_publish(ow_shm_ring_t* ring, const ow_sample_t* samples, size_t count);
+
+//Tell the readers that no more samples will come and why (an errno value, e. g. ENODATA for an exhausted source):
+void ow_shm_ring_finish(ow_shm_ring_t* ring, int error);
+
+//Send the reply to a request on the control socket, along with a read-only descriptor of the ring if "error" is 0.
+//Sets errno on error.
+bool ow_shm_ring_reply(const ow_shm_ring_t* ring, int socket_fd, int error);
+
+//Unmap and close the ring. Readers keep their mappings.
+void ow_shm_ring_destroy(ow_shm_ring_t* ring);
+
+//Ask the daemon at "socket_path" (NULL for OW_SHM_DEFAULT_SOCKET_PATH) for the ring of the named meter and map it.
+//The client starts with the next sample that is published. No special privileges are needed.
+//Returns NULL on error and sets errno (e. g. ENOENT for an unknown meter).
+ow_shm_client_t* ow_shm_attach(const char* socket_path, const char* name);
+
+//Copy up to "max_samples" samples the client hasn't seen yet to "samples" (never blocks, no syscalls).
+//If the client has fallen behind by more than the capacity, it skips ahead and counts the gap as dropped.
+//Returns the number of samples.
+size_t ow_shm_poll(ow_shm_client_t* client, ow_sample_t* samples, size_t max_samples);
+
+//Does the daemon still publish to the ring?
+//If not, its reason is stored to "error" (if not NULL). Samples that are still in the ring can be polled anyway.
+bool ow_shm_is_running(const ow_shm_client_t* client, int* error);
+
+//Get the counters of a client:
+void ow_shm_get_stats(const ow_shm_client_t* client, ow_shm_stats_t* stats);
+
+//Unmap the ring and free the client:
+void ow_shm_detach(ow_shm_client_t* client);
+
+#endif
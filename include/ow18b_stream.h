@@ -0,0 +1,54 @@
+#ifndef __OW18B_STREAM_H__
+#define __OW18B_STREAM_H__
+
+#include "ow18b.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+//A receiver thread that publishes samples into a lock-free single-producer/single-consumer ring:
+typedef struct __ow_stream_t__ ow_stream_t;
+
+//Counters of a stream:
+typedef struct __ow_stream_stats_t__
+{
+	//The capacity of the ring (rounded up to a power of two):
+	size_t capacity;
+
+	//The maximum number of samples that have been waiting in the ring at once:
+	size_t high_water_mark;
+
+	//How many samples have been published resp. dropped because the ring was full?
+	uint64_t published;
+	uint64_t dropped;
+} ow_stream_stats_t;
+
+//Connect to the OWON device using the provided configuration and start receiving on an internal thread.
+//The ring holds at least "capacity" samples. If the consumer falls behind, new samples are dropped.
+//Returns NULL on error and sets errno.
+ow_stream_t* ow_stream_start(const ow_config_t* config, size_t capacity);
+
+//Same as "ow_stream_start(...)", but the frames are taken from the given source.
+ow_stream_t* ow_stream_start_source(const ow_source_t* source, size_t capacity);
+
+//Take the oldest sample out of the ring (never blocks).
+//Returns false if the ring is empty.
+bool ow_stream_pop(ow_stream_t* stream, ow_sample_t* sample);
+
+//Take up to "max_samples" samples out of the ring (never blocks).
+//Returns the number of samples.
+size_t ow_stream_pop_bulk(ow_stream_t* stream, ow_sample_t* samples, size_t max_samples);
+
+//Is the receiver thread still running?
+//If it has stopped on its own, the error is stored to "error" (if not NULL), e. g. ENODATA for an exhausted source.
+bool ow_stream_is_running(const ow_stream_t* stream, int* error);
+
+//Get a snapshot of the counters (can be called while the stream is running):
+void ow_stream_get_stats(const ow_stream_t* stream, ow_stream_stats_t* stats);
+
+//Stop the receiver thread, disconnect and free the stream.
+//Samples that are still in the ring are lost. For sources that can't be polled, this waits for their next frame.
+void ow_stream_stop(ow_stream_t* stream);
+
+#endif
@@ -0,0 +1,122 @@
+#ifndef __OW18B_SUMMARY_H__
+#define __OW18B_SUMMARY_H__
+
+#include "ow18b.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+//Quantiles are estimated with a relative error of at most 1 %:
+#define OW_SKETCH_RELATIVE_ACCURACY 0.01
+
+//Buckets per sign. Values within a ratio of about 2.8e4 of the largest one are estimated with full accuracy, smaller ones are merged into the lowest bucket.
+#define OW_SKETCH_BUCKET_COUNT 512
+
+//The maximum number of different keys per summary:
+#define OW_SUMMARY_MAX_STREAMS 32
+
+//Logarithmically spaced buckets of the absolute values of one sign (don't touch):
+typedef struct __ow_sketch_store_t__
+{
+	int32_t offset;
+	uint64_t count;
+	uint64_t counts[OW_SKETCH_BUCKET_COUNT];
+} ow_sketch_store_t;
+
+//A mergeable quantile sketch with fixed memory (don't touch the members):
+typedef struct __ow_sketch_t__
+{
+	ow_sketch_store_t positive;
+	ow_sketch_store_t negative;
+	uint64_t zero_count;
+} ow_sketch_t;
+
+//The samples of a summary are kept apart by quantity and mode.
+//Auto-range prefixes are not part of the key: Millivolts and volts end up in the same stream.
+typedef struct __ow_summary_key_t__
+{
+	//The unit without prefix (see "ow_unit_to_base_unit(...)"):
+	ow_unit_t unit;
+
+	ow_current_type_t current_type;
+	bool is_diode_test;
+	bool is_continuity_test;
+	bool is_relative;
+} ow_summary_key_t;
+
+//The running statistics of one key:
+typedef struct __ow_summary_stream_t__
+{
+	ow_summary_key_t key;
+
+	//The number of values (overflows are only counted in "overflows"):
+	uint64_t count;
+	uint64_t overflows;
+
+	//Everything below is in the base unit of the key (e. g. volts):
+	double min;
+	double max;
+	double mean;
+
+	//The sum of squared differences from the mean (Welford), see "ow_summary_stream_variance(...)":
+	double m2;
+
+	ow_sketch_t sketch;
+} ow_summary_stream_t;
+
+//The statistics of all keys a meter (or several of them) has delivered.
+//The streams are allocated on demand. Initialize the summary with "ow_summary_init(...)" and free it with "ow_summary_destroy(...)".
+typedef struct __ow_summary_t__
+{
+	ow_summary_stream_t* streams[OW_SUMMARY_MAX_STREAMS];
+	size_t stream_count;
+
+	//Samples with OW_UNIT_UNKNOWN are not summarized, only counted:
+	uint64_t unknown_units;
+} ow_summary_t;
+
+//Reset a sketch:
+void ow_sketch_init(ow_sketch_t* sketch);
+
+//Count a value (must not be NaN):
+void ow_sketch_add(ow_sketch_t* sketch, double value);
+
+//Add the counts of "source" to "sketch":
+void ow_sketch_merge(ow_sketch_t* sketch, const ow_sketch_t* source);
+
+//Get the number of values resp. an estimate of the given quantile (0.0 to 1.0, NaN if the sketch is empty):
+uint64_t ow_sketch_count(const ow_sketch_t* sketch);
+double ow_sketch_quantile(const ow_sketch_t* sketch, double quantile);
+
+//Start an empty summary:
+void ow_summary_init(ow_summary_t* summary);
+
+//Free the streams of a summary. Call "ow_summary_init(...)" to use it again.
+void ow_summary_destroy(ow_summary_t* summary);
+
+//Add a sample to the stream of its key. Values are converted to the base unit.
+//Sets errno on error (ENOMEM, or ENOSPC if there are OW_SUMMARY_MAX_STREAMS keys already).
+bool ow_summary_add(ow_summary_t* summary, const ow_sample_t* sample);
+
+//Callback for "ow_recv(...)" that adds every sample. Pass the summary as context.
+//The receive ends if adding fails.
+bool ow_summary_sample_func(ow_sample_t sample, void* context);
+
+//Add everything from "source" (e. g. another time window or another meter) to "summary".
+//The result is the same as if all samples had been added to "summary" (up to rounding).
+//Sets errno on error (see "ow_summary_add(...)").
+bool ow_summary_merge(ow_summary_t* summary, const ow_summary_t* source);
+
+//Get the key of a sample:
+void ow_summary_key_from_sample(const ow_sample_t* sample, ow_summary_key_t* key);
+
+//Find the stream of the given key (NULL if there is none yet):
+const ow_summary_stream_t* ow_summary_find(const ow_summary_t* summary, const ow_summary_key_t* key);
+
+//Get the sample variance (NaN with less than two values) resp. an estimate of a quantile (see "ow_sketch_quantile(...)") of a stream.
+//Quantiles are clamped to the exact minimum and maximum.
+double ow_summary_stream_variance(const ow_summary_stream_t* stream);
+double ow_summary_stream_quantile(const ow_summary_stream_t* stream, double quantile);
+
+#endif
@@ -0,0 +1,99 @@
+#ifndef __OW18B_TRIGGER_H__
+#define __OW18B_TRIGGER_H__
+
+#include "ow18b.h"
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+//Flags that flag conditions can watch (the flag byte of the frame plus the overflow):
+#define OW_TRIGGER_FLAG_DATA_HOLD OW_FLAG_DATA_HOLD
+#define OW_TRIGGER_FLAG_RELATIVE OW_FLAG_RELATIVE
+#define OW_TRIGGER_FLAG_AUTO_RANGE OW_FLAG_AUTO_RANGE
+#define OW_TRIGGER_FLAG_LOW_BATTERY OW_FLAG_LOW_BATTERY
+#define OW_TRIGGER_FLAG_OVERFLOW (1 << 4)
+
+//What a condition waits for:
+typedef enum __ow_condition_type_t__
+{
+	//The value of "quantity" is above resp. below "threshold".
+	//Once it is, it has to come back by "hysteresis" before the condition is left again. Fires with every sample while the condition holds.
+	OW_CONDITION_ABOVE,
+	OW_CONDITION_BELOW,
+
+	//Same, but only fires once when the condition is entered (also if the first value of "quantity" is already beyond "threshold"):
+	OW_CONDITION_RISING,
+	OW_CONDITION_FALLING,
+
+	//The value of "quantity" changes faster than "threshold" per second (in either direction).
+	//Fires once per excursion, the rate has to drop by "hysteresis" before it can fire again.
+	OW_CONDITION_RATE,
+
+	//The unit changes (including auto-range steps, e. g. from OW_UNIT_MILLIVOLT to OW_UNIT_VOLT):
+	OW_CONDITION_UNIT_CHANGE,
+
+	//The measurement mode changes: quantity, current type, diode test, continuity test or relative mode (auto-range steps don't count):
+	OW_CONDITION_MODE_CHANGE,
+
+	//One of "flags" (OW_TRIGGER_FLAG_*) is set resp. cleared. All flags count as cleared before the first sample.
+	OW_CONDITION_FLAG_SET,
+	OW_CONDITION_FLAG_CLEARED
+} ow_condition_type_t;
+
+//A condition of a trigger:
+typedef struct __ow_condition_t__
+{
+	ow_condition_type_t type;
+
+	//For thresholds and rates: The quantity to watch and the limits in its unit (e. g. volts, see "ow_normalize(...)").
+	//Samples of other quantities and overflows are skipped. A change of the quantity starts over.
+	ow_quantity_t quantity;
+	double threshold;
+	double hysteresis;
+
+	//For flag conditions:
+	uint8_t flags;
+} ow_condition_t;
+
+//Conditions compiled into a predicate program, together with the state of its last evaluation (opaque).
+//It belongs to one receive loop. Use one trigger per multimeter.
+typedef struct __ow_trigger_t__ ow_trigger_t;
+
+//What is handed to the callback if a condition fires:
+typedef struct __ow_trigger_event_t__
+{
+	//The index of the condition (as passed to "ow_trigger_create(...)"):
+	size_t condition;
+
+	//The sample that made it fire:
+	ow_sample_t sample;
+
+	//The value of the sample in the unit of its quantity resp. the rate per second for OW_CONDITION_RATE (NaN on overflow):
+	double value;
+} ow_trigger_event_t;
+
+//A callback for events. The event is only valid during the call.
+//The return value indicates if more samples shall be fetched.
+typedef bool (*ow_trigger_func_t)(const ow_trigger_event_t*, void*);
+
+//Compile "count" conditions into a trigger.
+//Returns NULL on error and sets errno (EINVAL for a malformed condition, e. g. a threshold for OW_QUANTITY_UNKNOWN or a negative hysteresis).
+ow_trigger_t* ow_trigger_create(const ow_condition_t* conditions, size_t count);
+
+//Forget the previous samples, so the next one is treated like the first:
+void ow_trigger_reset(ow_trigger_t* trigger);
+
+//Evaluate the trigger on a sample (e. g. from a stream or a broadcast) and hand every condition that fires to the callback, in the order of the conditions.
+//Returns false as soon as the callback does.
+bool ow_trigger_evaluate(ow_trigger_t* trigger, const ow_sample_t* sample, ow_trigger_func_t callback, void* context);
+
+//Same as "ow_recv(...)" resp. "ow_recv_source(...)", but the trigger is evaluated on the receive thread and the callback is only called on events.
+//Frames are only decoded as far as the conditions need it, a full sample is decoded for events only (see "ow_recv_view(...)").
+bool ow_recv_trigger(const ow_config_t* config, ow_trigger_t* trigger, ow_trigger_func_t callback, void* context);
+bool ow_recv_trigger_source(const ow_source_t* source, ow_trigger_t* trigger, ow_trigger_func_t callback, void* context);
+
+//Free the trigger:
+void ow_trigger_destroy(ow_trigger_t* trigger);
+
+#endif
@@ -1,11 +1,21 @@
+//For ppoll(...) and recvmmsg(...):
+#define _GNU_SOURCE
+
 #include "ow18b.h"
+#include "ow18b_btsnoop.h"
 
 #include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
 #include <unistd.h>
 
+#include <limits.h>
 #include <sys/types.h>
 #include <sys/socket.h>
 
@@ -19,21 +29,49 @@
 #define OW_SCAN_DEVICE_NAME 0x09
 #define OW_SCAN_SUBEVENT_ADVERTISING_INFO 0x02
 
+//Update a counter that may be read concurrently (we are its only writer, so no read-modify-write is needed):
+#define OW_STATS_ADD(stats, member, amount) __atomic_store_n(&(stats)->member, (stats)->member + (amount), __ATOMIC_RELAXED)
+
+//Only every n-th callback is timed, so the two clock reads don't show up per sample (a power of two):
+#define OW_STATS_TIMING_INTERVAL 64
+
+//Unit code lookup:
+#define OW_UNIT_CODE_COUNT (1 << 13)
+#define OW_UNIT_CODE_ATTR_KNOWN (1 << 0)
+#define OW_UNIT_CODE_ATTR_AC (1 << 1)
+#define OW_UNIT_CODE_ATTR_DIODE (1 << 2)
+#define OW_UNIT_CODE_ATTR_CONTINUITY (1 << 3)
+
+//10^exponent as a constant expression for the unit conversions (1 for exponents <= 0, the exponents of OW_UNITS are multiples of 3):
+#define OW_POW10(exponent) (((exponent) >= 9) ? 1e9 : ((exponent) >= 6) ? 1e6 : ((exponent) >= 3) ? 1e3 : 1.0)
+
 //Length validation for scanning:
 #define OW_SCAN_META_OFFSET (1 + HCI_EVENT_HDR_SIZE)
 #define OW_SCAN_MIN_LENGTH (OW_SCAN_META_OFFSET + sizeof(evt_le_meta_event) + 1 + sizeof(le_advertising_info))
 
-//The maximum length of a device's friendly name, without zero terminator:
-#define OW_MAX_NAME_LENGTH 29
-
 //The exact length of a sample packet that contains measurement data:
 #define OW_SAMPLE_LENGTH 18
 
+//The length of the constant header resp. the offset and length of the payload:
+#define OW_HEADER_LENGTH 12
+#define OW_PAYLOAD_OFFSET OW_HEADER_LENGTH
+#define OW_PAYLOAD_LENGTH 6
+
 //HCI-ACL-L2CAP-ATT magic numbers:
 #define OW_L2CAP_DEST_CID ((uint16_t)0x0004)
 #define OW_ATT_OPCODE_HANDLE_VALUE_NOTIFICATION ((uint8_t)0x001B)
 #define OW_ATT_HANDLE ((uint16_t)0x001B)
 
+//The Disconnection Complete event (packet type, event code, length, status, handle, reason):
+#define OW_DISCONN_COMPLETE_LENGTH (1 + HCI_EVENT_HDR_SIZE + 4)
+
+//The length of a textual address (without terminator) resp. of a cache file line:
+#define OW_ADDR_STR_LENGTH 17
+#define OW_CACHE_LINE_LENGTH (OW_ADDR_STR_LENGTH + 2)
+
+//How many frames to read per call when draining a source for a batch:
+#define OW_BATCH_READ_COUNT 32
+
 //Internally used for ow_recv_n(...):
 typedef struct __ow_recv_n_context_t__
 {
@@ -42,6 +80,132 @@ typedef struct __ow_recv_n_context_t__
 	int count;
 } ow_recv_n_context_t;
 
+//What we know about a 13-bit unit code:
+typedef struct __ow_unit_code_info_t__
+{
+	//The ow_unit_t (only valid with OW_UNIT_CODE_ATTR_KNOWN):
+	uint8_t unit;
+
+	//OW_UNIT_CODE_ATTR_* flags:
+	uint8_t attributes;
+} ow_unit_code_info_t;
+
+//A precomputed header template to validate frames against:
+typedef struct __ow_frame_matcher_t__
+{
+	//Bytes 0 to 7 resp. 8 to 11 of the header, in memory order:
+	uint64_t expected_lo;
+	uint32_t expected_hi;
+
+	//Which bits to compare:
+	uint64_t mask_lo;
+	uint32_t mask_hi;
+} ow_frame_matcher_t;
+
+//Internally used to hand validated frames to the different delivery flavors.
+//The return value indicates if more frames shall be fetched.
+typedef bool (*ow_frame_func_t)(const uint8_t*, const struct timespec*, void*);
+
+//Room for a single timestamp control message (SCM_TIMESTAMPNS or HCI_CMSG_TSTAMP):
+typedef union __ow_timestamp_control_t__
+{
+	struct cmsghdr header;
+	uint8_t buf[CMSG_SPACE(sizeof(struct timespec))];
+} ow_timestamp_control_t;
+
+//Internally used to demultiplex the frames of several devices:
+typedef struct __ow_multi_context_t__
+{
+	ow_multi_device_t* devices;
+	size_t count;
+
+	//How many devices still want samples:
+	size_t active;
+} ow_multi_context_t;
+
+//Internally used to run a receive loop on the source of a connection:
+typedef bool (*ow_source_run_func_t)(const ow_source_t*, void*);
+
+//Internally used to run a frame loop resp. a batch loop via ow_recv_config(...):
+typedef struct __ow_frame_loop_t__
+{
+	ow_frame_func_t frame_func;
+	void* context;
+} ow_frame_loop_t;
+
+typedef struct __ow_batch_loop_t__
+{
+	ow_batch_func_t callback;
+	void* context;
+	size_t max_batch;
+	unsigned long max_latency_us;
+} ow_batch_loop_t;
+
+//Internally used to deliver decoded samples, packed samples resp. frame views to a user callback:
+typedef struct __ow_sample_callback_context_t__
+{
+	ow_sample_func_t callback;
+	void* context;
+} ow_sample_callback_context_t;
+
+typedef struct __ow_packed_callback_context_t__
+{
+	ow_sample_packed_func_t callback;
+	void* context;
+} ow_packed_callback_context_t;
+
+typedef struct __ow_view_callback_context_t__
+{
+	ow_frame_view_func_t callback;
+	void* context;
+} ow_view_callback_context_t;
+
+//Internally used to coalesce identical frames for ow_recv_changes(...):
+typedef struct __ow_change_context_t__
+{
+	ow_sample_run_func_t callback;
+	void* context;
+	unsigned long heartbeat_ms;
+
+	//The pending run:
+	bool has_run;
+	uint8_t payload[OW_PAYLOAD_LENGTH];
+	struct timespec first_timestamp;
+	struct timespec last_timestamp;
+	uint64_t count;
+} ow_change_context_t;
+
+//Internally used to normalize batches for ow_recv_normalized(...):
+typedef struct __ow_normalized_context_t__
+{
+	ow_normalized_batch_func_t callback;
+	void* context;
+
+	//Room for a whole batch:
+	ow_normalized_sample_t* normalized;
+} ow_normalized_context_t;
+
+//How a unit is converted to the unit of its quantity: (value + offset) * multiplier / divisor
+typedef struct __ow_unit_scale_t__
+{
+	double offset;
+	double multiplier;
+	double divisor;
+} ow_unit_scale_t;
+
+//The AD structures of an advertising report we are interested in:
+typedef struct __ow_scan_ad_t__
+{
+	bool has_flags;
+	uint8_t flags;
+
+	bool has_name;
+	char name[OW_MAX_NAME_LENGTH + 1];
+} ow_scan_ad_t;
+
+//Packed samples have to stay that small:
+_Static_assert(sizeof(ow_sample_packed_t) == 8, "ow_sample_packed_t must be 8 bytes");
+
 //The scan parameters for automatic scans:
 static ow_scan_params automatic_scan_params =
 {
@@ -79,6 +243,154 @@ static ow_connect_params automatic_connect_params =
 	.to = 25000
 };
 
+//Every 13-bit unit code, directly indexed (generated from OW_UNIT_CODES):
+static const ow_unit_code_info_t ow_unit_codes[OW_UNIT_CODE_COUNT] =
+{
+#define OW_UNIT_CODE_INFO(code, unit_name, current_type_name, diode_test, continuity_test) \
+	[(code) >> 3] = \
+	{ \
+		.unit = OW_UNIT_##unit_name, \
+		.attributes = OW_UNIT_CODE_ATTR_KNOWN | \
+			((OW_CURRENT_TYPE_##current_type_name == OW_CURRENT_TYPE_AC) ? OW_UNIT_CODE_ATTR_AC : 0) | \
+			((diode_test) ? OW_UNIT_CODE_ATTR_DIODE : 0) | \
+			((continuity_test) ? OW_UNIT_CODE_ATTR_CONTINUITY : 0) \
+	},
+
+	OW_UNIT_CODES(OW_UNIT_CODE_INFO)
+
+#undef OW_UNIT_CODE_INFO
+};
+
+//String representations, SI exponents and base units of the units (generated from OW_UNITS):
+static const char* const ow_unit_strs[] =
+{
+#define OW_UNIT_STR(name, str, short_str, exponent, base_unit, quantity) [OW_UNIT_##name] = str,
+	OW_UNITS(OW_UNIT_STR)
+#undef OW_UNIT_STR
+};
+
+static const char* const ow_unit_short_strs[] =
+{
+#define OW_UNIT_SHORT_STR(name, str, short_str, exponent, base_unit, quantity) [OW_UNIT_##name] = short_str,
+	OW_UNITS(OW_UNIT_SHORT_STR)
+#undef OW_UNIT_SHORT_STR
+};
+
+static const int8_t ow_unit_si_exponents[] =
+{
+#define OW_UNIT_SI_EXPONENT(name, str, short_str, exponent, base_unit, quantity) [OW_UNIT_##name] = exponent,
+	OW_UNITS(OW_UNIT_SI_EXPONENT)
+#undef OW_UNIT_SI_EXPONENT
+};
+
+static const uint8_t ow_unit_base_units[] =
+{
+#define OW_UNIT_BASE_UNIT(name, str, short_str, exponent, base_unit, quantity) [OW_UNIT_##name] = OW_UNIT_##base_unit,
+	OW_UNITS(OW_UNIT_BASE_UNIT)
+#undef OW_UNIT_BASE_UNIT
+};
+
+//The quantities of the units and their conversions, indexed by unit (generated from OW_UNITS, OW_UNIT_UNKNOWN included, so a clamped index never misses).
+//Negative exponents divide, so e. g. 0.3 mV become the double that is closest to 0.0003 V.
+//Fahrenheit is the only unit that is not a power of ten of the unit of its quantity: °C = (°F - 32) * 5 / 9
+static const uint8_t ow_unit_quantities[OW_UNIT_UNKNOWN + 1] =
+{
+#define OW_UNIT_QUANTITY(name, str, short_str, exponent, base_unit, quantity) [OW_UNIT_##name] = OW_QUANTITY_##quantity,
+	OW_UNITS(OW_UNIT_QUANTITY)
+#undef OW_UNIT_QUANTITY
+	[OW_UNIT_UNKNOWN] = OW_QUANTITY_UNKNOWN
+};
+
+static const ow_unit_scale_t ow_unit_scales[OW_UNIT_UNKNOWN + 1] =
+{
+#define OW_UNIT_SCALE(name, str, short_str, exponent, base_unit, quantity) [OW_UNIT_##name] = \
+	{ \
+		(OW_UNIT_##name == OW_UNIT_FAHRENHEIT) ? -32.0 : 0.0, \
+		(OW_UNIT_##name == OW_UNIT_FAHRENHEIT) ? 5.0 : OW_POW10(exponent), \
+		(OW_UNIT_##name == OW_UNIT_FAHRENHEIT) ? 9.0 : OW_POW10(-(exponent)) \
+	},
+	OW_UNITS(OW_UNIT_SCALE)
+#undef OW_UNIT_SCALE
+	[OW_UNIT_UNKNOWN] = { 0.0, 1.0, 1.0 }
+};
+
+//The conversions to the base units (the powers of ten alone, so Fahrenheit stays Fahrenheit), indexed by unit (generated from OW_UNITS, OW_UNIT_UNKNOWN included):
+static const ow_unit_scale_t ow_unit_base_scales[OW_UNIT_UNKNOWN + 1] =
+{
+#define OW_UNIT_BASE_SCALE(name, str, short_str, exponent, base_unit, quantity) [OW_UNIT_##name] = { 0.0, OW_POW10(exponent), OW_POW10(-(exponent)) },
+	OW_UNITS(OW_UNIT_BASE_SCALE)
+#undef OW_UNIT_BASE_SCALE
+	[OW_UNIT_UNKNOWN] = { 0.0, 1.0, 1.0 }
+};
+
+//Every exponent must be one that OW_POW10(...) knows:
+#define OW_UNIT_EXPONENT_CHECK(name, str, short_str, exponent, base_unit, quantity) \
+	_Static_assert((((exponent) % 3) == 0) && ((exponent) >= -9) && ((exponent) <= 9), "OW_POW10(...) does not cover the exponent of OW_UNIT_" #name);
+OW_UNITS(OW_UNIT_EXPONENT_CHECK)
+#undef OW_UNIT_EXPONENT_CHECK
+
+//String representations and units of the quantities (generated from OW_QUANTITIES):
+static const char* const ow_quantity_strs[] =
+{
+#define OW_QUANTITY_STR(name, str, unit) [OW_QUANTITY_##name] = str,
+	OW_QUANTITIES(OW_QUANTITY_STR)
+#undef OW_QUANTITY_STR
+};
+
+static const ow_unit_t ow_quantity_units[] =
+{
+#define OW_QUANTITY_UNIT(name, str, unit) [OW_QUANTITY_##name] = OW_UNIT_##unit,
+	OW_QUANTITIES(OW_QUANTITY_UNIT)
+#undef OW_QUANTITY_UNIT
+};
+
+//Divisors for the decimal places of a value:
+static const double ow_place_divisors[OW_PLACES_MASK + 1] = { 1.0, 10.0, 100.0, 1000.0 };
+
+//Powers of ten that fit into 64 bits (for exact decimal arithmetic):
+#define OW_DECIMAL_MAX_DIGITS 19
+
+static const uint64_t ow_decimal_powers[OW_DECIMAL_MAX_DIGITS + 1] =
+{
+	1ULL, 10ULL, 100ULL, 1000ULL, 10000ULL, 100000ULL, 1000000ULL, 10000000ULL, 100000000ULL, 1000000000ULL,
+	10000000000ULL, 100000000000ULL, 1000000000000ULL, 10000000000000ULL, 100000000000000ULL,
+	1000000000000000ULL, 10000000000000000ULL, 100000000000000000ULL, 1000000000000000000ULL, 10000000000000000000ULL
+};
+
+//Which reject reason a mismatch in each byte of the header stands for:
+static const ow_reject_reason_t ow_header_reject_reasons[OW_HEADER_LENGTH] =
+{
+	OW_REJECT_REASON_PACKET_TYPE,
+	OW_REJECT_REASON_HANDLE, OW_REJECT_REASON_HANDLE,
+	OW_REJECT_REASON_TOTAL_LENGTH, OW_REJECT_REASON_TOTAL_LENGTH,
+	OW_REJECT_REASON_L2CAP_LENGTH, OW_REJECT_REASON_L2CAP_LENGTH,
+	OW_REJECT_REASON_CID, OW_REJECT_REASON_CID,
+	OW_REJECT_REASON_ATT_OPCODE,
+	OW_REJECT_REASON_ATT_HANDLE, OW_REJECT_REASON_ATT_HANDLE
+};
+
+static const char* const ow_reject_reason_strs[] =
+{
+	"Length",
+	"Packet type",
+	"HCI handle",
+	"Total length",
+	"L2CAP length",
+	"L2CAP CID",
+	"ATT opcode",
+	"ATT handle"
+};
+
+//The parameters for persistent sessions that don't provide their own:
+static ow_persist_params automatic_persist_params =
+{
+	.cache_path = NULL,
+	.min_backoff_ms = 250,
+	.max_backoff_ms = 30000,
+	.max_attempts = 0,
+	.cancel_fd = -1
+};
+
 //Get the device ID of the default Bluetooth adapter.
 //Sets errno on error.
 static bool ow_get_default_device_id(int* dev_id);
@@ -87,31 +399,187 @@ static bool ow_get_default_device_id(int* dev_id);
 //Sets errno on error.
 static bool ow_open_socket(int dev_id, int* bt_sock);
 
+//Open a socket on the adapter of the given configuration.
+//Sets errno on error.
+static bool ow_open_config_socket(const ow_config_t* config, int* bt_sock);
+
+//Get the address of the multimeter according to the scan mode of the given configuration.
+//A scan can be cancelled by "cancel_fd" (-1 for none, see "ow_scan_for_address(...)"). Sets errno on error.
+static bool ow_config_address(int bt_sock, const ow_config_t* config, struct hci_filter* old_hci_filter, socklen_t old_hci_filter_length, int cancel_fd, bdaddr_t* addr);
+
+//Get the connect parameters of the given configuration (NULL if the connect mode is invalid):
+static const ow_connect_params* ow_config_connect_params(const ow_config_t* config);
+
 //Get resp. set a HCI filter for the given socket.
 //Sets errno on error.
 static bool ow_get_hci_filter(int bt_sock, struct hci_filter* filter, socklen_t* filter_length);
 static bool ow_set_hci_filter(int bt_sock, struct hci_filter* filter, socklen_t filter_length);
 
-//Read the flags from a given advertising info struct:
-static bool ow_scan_read_flags(const le_advertising_info* info, uint8_t* flags);
+//Make sure the given socket only sees asynchronous data packets.
+//Sets errno on error.
+static bool ow_set_async_filter(int bt_sock);
+
+//Parse the flags and the friendly name from the AD structures of a given advertising info struct (in a single pass):
+static void ow_scan_parse_ad(const le_advertising_info* info, ow_scan_ad_t* ad);
 
-//Does the given advertising info match the given filter type?
-static bool ow_scan_filter_matches_info(ow_scan_filter_type_t filter_type, const le_advertising_info* info);
+//Do the parsed AD structures match the given filter type?
+static bool ow_scan_filter_matches_ad(ow_scan_filter_type_t filter_type, const ow_scan_ad_t* ad);
 
-//Try to parse the friendly name of a device from a given advertising struct:
-static bool ow_scan_parse_friendly_name(const le_advertising_info* info, char* name);
+//Return the advertising info of an HCI event if it is a report of a device we are looking for (NULL otherwise).
+//Its parsed AD structures go to "ad", its RSSI to "rssi".
+static const le_advertising_info* ow_scan_match_report(const ow_scan_params* params, const uint8_t* buf, size_t length, ow_scan_ad_t* ad, int8_t* rssi);
+
+//Set the event filter and the scan parameters and enable the LE scan.
+//The old HCI filter has to be restored by the caller, also on error. Sets errno on error.
+static bool ow_scan_enable(int bt_sock, const ow_scan_params* params);
 
 //Scan for the multimeter using the provided socket and scan parameters.
-//Sets errno on error.
-static bool ow_scan_for_address(int bt_sock, const ow_scan_params* params, struct hci_filter* old_hci_filter, socklen_t old_hci_filter_length, bdaddr_t* addr);
+//If "cancel_fd" is not -1, the scan fails with ECANCELED as soon as it becomes readable. Sets errno on error.
+static bool ow_scan_for_address(int bt_sock, const ow_scan_params* params, struct hci_filter* old_hci_filter, socklen_t old_hci_filter_length, int cancel_fd, bdaddr_t* addr);
+
+//Hash a device address for the deduplication table of "ow_scan(...)":
+static size_t ow_scan_hash_addr(const bdaddr_t* addr);
+
+//Rank scan results (strongest signal first):
+static int ow_scan_compare_results(const void* a, const void* b);
 
 //Connect to the multimeter.
 //Sets errno on error.
 static bool ow_connect(int bt_sock, bdaddr_t addr, const ow_connect_params* params, uint16_t* hci_handle);
 
+//Connect a session according to the configuration (the socket stays in blocking mode).
+//Sets errno on error.
+static bool ow_session_connect(ow_session_t* session, const ow_config_t* config);
+
+//Connect according to the configuration and run the given loop on the connection.
+//Sets errno on error.
+static bool ow_recv_config(const ow_config_t* config, ow_source_run_func_t run_func, void* context);
+
+//Is the given frame a valid sample notification?
+static inline bool ow_frame_is_valid(const ow_frame_matcher_t* matcher, const uint8_t* frame, size_t length);
+
+//Pass validated frames from the given source to the given function.
+//Sets errno on error.
+static bool ow_recv_frames(const ow_source_t* source, ow_frame_func_t frame_func, void* context);
+
+//Collect decoded samples from the given source into batches (see ow_recv_batch(...)).
+//Sets errno on error.
+static bool ow_recv_batches(const ow_source_t* source, ow_batch_func_t callback, void* context, size_t max_batch, unsigned long max_latency_us);
+
+//Read up to "count" frames from the given source (via "read_many" if available, otherwise a single "read").
+//Every frame gets a receive time. Returns the number of frames (a zero-length frame signals EoF) or -1 with errno set.
+static int ow_source_read_frames(const ow_source_t* source, uint8_t (*bufs)[HCI_MAX_EVENT_SIZE], size_t count, size_t* lengths, struct timespec* timestamps);
+
+//Give the current time (CLOCK_REALTIME) to frames whose source couldn't tell their receive time:
+static void ow_fill_timestamps(struct timespec* timestamps, size_t count);
+
+//Adapters to run the loops above via ow_recv_config(...):
+static bool ow_run_frame_loop(const ow_source_t* source, void* context);
+static bool ow_run_batch_loop(const ow_source_t* source, void* context);
+
 //An internal sample func for ow_recv_n(...):
 static bool ow_recv_n_sample(ow_sample_t sample, void* context);
 
+//Internal frame funcs that decode, pack resp. only wrap frames for a user callback:
+static bool ow_sample_frame(const uint8_t* frame, const struct timespec* timestamp, void* context);
+static bool ow_packed_frame(const uint8_t* frame, const struct timespec* timestamp, void* context);
+static bool ow_view_frame(const uint8_t* frame, const struct timespec* timestamp, void* context);
+
+//An internal batch func that normalizes a batch for a user callback:
+static bool ow_normalized_batch(const ow_sample_t* samples, size_t count, void* context);
+
+//An internal frame func that coalesces identical frames into runs:
+static bool ow_change_frame(const uint8_t* frame, const struct timespec* timestamp, void* context);
+
+//Hand the pending run to the callback:
+static bool ow_change_deliver(ow_change_context_t* change_context, bool is_heartbeat);
+
+//Run the change loop and deliver the pending run when the source ends:
+static bool ow_run_change_loop(const ow_source_t* source, void* context);
+
+//An internal frame func that demultiplexes frames by HCI handle:
+static bool ow_multi_frame(const uint8_t* frame, const struct timespec* timestamp, void* context);
+
+//The absolute value of a mantissa (INT64_MIN included):
+static uint64_t ow_decimal_magnitude(int64_t mantissa);
+
+//Multiply a magnitude by 10^digits. Returns false on overflow.
+static bool ow_decimal_scale_up(uint64_t magnitude, int64_t digits, uint64_t* result);
+
+//Compare the magnitudes of two decimals (both non-zero):
+static int ow_decimal_compare_magnitudes(uint64_t a, int32_t a_exponent, uint64_t b, int32_t b_exponent);
+
+//Append a character to a string buffer like "snprintf(...)" would (the position counts on beyond the end):
+static void ow_decimal_put(char* buf, size_t size, size_t* position, char c);
+
+//Pack a raw payload (unused bits are cleared):
+static void ow_pack_payload(const uint8_t* payload, ow_sample_packed_t* packed);
+
+//Read exactly "length" bytes from the given descriptor (retries on short reads and EINTR).
+//If "cancel_fd" is not -1, every read waits for it too and fails with ECANCELED as soon as it becomes readable.
+//Returns false on error (errno set) or on EoF (errno = 0, if nothing has been read at all).
+static bool ow_read_full(int fd, int cancel_fd, void* buf, size_t length);
+
+//Decode big-endian integers from a byte buffer:
+static uint32_t ow_read_be32(const uint8_t* buf);
+static uint64_t ow_read_be64(const uint8_t* buf);
+
+//Decode little-endian integers from a byte buffer:
+static uint16_t ow_read_le16(const uint8_t* buf);
+
+//Load words in memory order from unaligned addresses:
+static uint64_t ow_load64(const uint8_t* buf);
+static uint32_t ow_load32(const uint8_t* buf);
+
+//Prepare the header template for the given HCI handle (can be OW_HCI_HANDLE_ANY):
+static void ow_frame_matcher_init(ow_frame_matcher_t* matcher, uint16_t hci_handle);
+
+//Does the header of the given frame (at least OW_HEADER_LENGTH bytes) match the template?
+static inline bool ow_frame_matches(const ow_frame_matcher_t* matcher, const uint8_t* frame);
+
+//Frame source read funcs for plain descriptors resp. replays:
+static int ow_fd_source_read(void* context, uint8_t* buf, size_t length, struct timespec* timestamp);
+static int ow_fd_source_read_many(void* context, uint8_t* bufs, size_t stride, size_t count, size_t* lengths, struct timespec* timestamps);
+
+//Ask the kernel to timestamp incoming frames on the given descriptor (best effort, HCI sockets and others):
+static void ow_enable_timestamps(int fd);
+
+//Receive a single frame like read(2) and pick up its kernel timestamp (if any):
+static int ow_read_timestamped(int fd, uint8_t* buf, size_t length, struct timespec* timestamp);
+
+//Find the kernel timestamp in the control messages of a received message (untouched if there is none):
+static void ow_message_timestamp(struct msghdr* message, struct timespec* timestamp);
+static int ow_replay_source_read(void* context, uint8_t* buf, size_t length, struct timespec* receive_time);
+
+//Read resp. write the address cache of a persistent session.
+//Reading fails (without errno) if there is no usable cache. Writing is best effort.
+static bool ow_persistent_read_cache(const ow_persistent_t* persistent, bdaddr_t* addr);
+static void ow_persistent_write_cache(const ow_persistent_t* persistent, bdaddr_t addr);
+
+//Connect a persistent session to its address, retrying with exponential backoff.
+//Sets errno on error.
+static bool ow_persistent_reconnect(ow_persistent_t* persistent);
+
+//The frame source read func of persistent sessions:
+static int ow_persistent_source_read(void* context, uint8_t* buf, size_t length, struct timespec* timestamp);
+
+//Count a frame that has been read and whether it has been accepted (the reason for rejects is only diagnosed here):
+static void ow_stats_count_frame(ow_stats_t* stats, const ow_frame_matcher_t* matcher, const uint8_t* frame, size_t length, bool is_valid);
+
+//Find out which check a frame fails (it must have failed ow_frame_is_valid(...)):
+static ow_reject_reason_t ow_frame_reject_reason(const ow_frame_matcher_t* matcher, const uint8_t* frame, size_t length);
+
+//Measure the time spent in a callback:
+static bool ow_stats_begin_callback(const ow_stats_t* stats, struct timespec* start);
+static void ow_stats_end_callback(ow_stats_t* stats, const struct timespec* start, bool is_timed);
+
+//Monotonic time helpers:
+static void ow_timespec_add_ns(struct timespec* time, uint64_t ns);
+static bool ow_timespec_until(const struct timespec* deadline, struct timespec* remaining);
+
+//Sleep until the recorded timestamp of a replayed frame has been reached (fails with ECANCELED if the cancel descriptor becomes readable):
+static bool ow_replay_pace(ow_replay_t* replay, uint64_t timestamp);
+
 static bool ow_get_default_device_id(int* dev_id)
 {
 	//Get the device ID of the default adapter:
@@ -132,6 +600,57 @@ static bool ow_open_socket(int dev_id, int* bt_sock)
 	return (*bt_sock >= 0);
 }
 
+static bool ow_open_config_socket(const ow_config_t* config, int* bt_sock)
+{
+	//Do we have to query the default adapter's device ID?
+	int dev_id;
+
+	if (config->dev_id == OW_DEV_ID_AUTOMATIC)
+	{
+		if (!ow_get_default_device_id(&dev_id))
+		{
+			return false;
+		}
+	}
+	else
+	{
+		dev_id = config->dev_id;
+	}
+
+	//Open a socket:
+	return ow_open_socket(dev_id, bt_sock);
+}
+
+static bool ow_config_address(int bt_sock, const ow_config_t* config, struct hci_filter* old_hci_filter, socklen_t old_hci_filter_length, int cancel_fd, bdaddr_t* addr)
+{
+	switch (config->scan_mode)
+	{
+	case OW_SCAN_MODE_NONE:
+
+		*addr = config->addr;
+		return true;
+
+	case OW_SCAN_MODE_AUTOMATIC: return ow_scan_for_address(bt_sock, &automatic_scan_params, old_hci_filter, old_hci_filter_length, cancel_fd, addr);
+	case OW_SCAN_MODE_MANUAL: return ow_scan_for_address(bt_sock, &config->scan_params, old_hci_filter, old_hci_filter_length, cancel_fd, addr);
+
+	default:
+
+		errno = EINVAL;
+		return false;
+	}
+}
+
+static const ow_connect_params* ow_config_connect_params(const ow_config_t* config)
+{
+	switch (config->connect_mode)
+	{
+	case OW_CONNECT_MODE_AUTOMATIC: return &automatic_connect_params;
+	case OW_CONNECT_MODE_MANUAL: return &config->connect_params;
+
+	default: return NULL;
+	}
+}
+
 static bool ow_get_hci_filter(int bt_sock, struct hci_filter* filter, socklen_t* filter_length)
 {
 	//Tell getsockopt(...) how much buffer space there is:
@@ -147,11 +666,24 @@ static bool ow_set_hci_filter(int bt_sock, struct hci_filter* filter, socklen_t
 	return (setsockopt(bt_sock, SOL_HCI, HCI_FILTER, filter, filter_length) == 0);
 }
 
-static bool ow_scan_read_flags(const le_advertising_info* info, uint8_t* flags)
+static bool ow_set_async_filter(int bt_sock)
+{
+	struct hci_filter async_filter;
+
+	hci_filter_clear(&async_filter);
+	hci_filter_set_ptype(HCI_ACLDATA_PKT, &async_filter);
+
+	return ow_set_hci_filter(bt_sock, &async_filter, sizeof(struct hci_filter));
+}
+
+static void ow_scan_parse_ad(const le_advertising_info* info, ow_scan_ad_t* ad)
 {
+	ad->has_flags = false;
+	ad->has_name = false;
+
 	size_t offset = 0;
 
-	//Make sure we don't read too much:
+	//Walk the AD structures once and pick up everything we need on the way (make sure we don't read too much):
 	while (offset < info->length)
 	{
 		uint8_t length = info->data[offset];
@@ -165,21 +697,32 @@ static bool ow_scan_read_flags(const le_advertising_info* info, uint8_t* flags)
 		//Get the type:
 		uint8_t type = info->data[offset + 1];
 
-		//Found the flags:
-		if ((type == OW_SCAN_FILTER_FLAGS_TYPE) && (length >= 2))
+		if ((type == OW_SCAN_FILTER_FLAGS_TYPE) && (length >= 2) && !ad->has_flags)
 		{
-			*flags = info->data[offset + 2];
-			return true;
+			ad->flags = info->data[offset + 2];
+			ad->has_flags = true;
+		}
+		else if (((type == OW_SCAN_SHORT_DEVICE_NAME) || (type == OW_SCAN_DEVICE_NAME)) && !ad->has_name)
+		{
+			//Validate the name length:
+			size_t name_length = length - 1;
+
+			if (name_length <= OW_MAX_NAME_LENGTH)
+			{
+				//Store and terminate the name:
+				memcpy(ad->name, &info->data[offset + 2], name_length);
+				ad->name[name_length] = '\0';
+
+				ad->has_name = true;
+			}
 		}
 
 		//Increment the offset:
 		offset += 1 + length;
 	}
-
-	return false;
 }
 
-static bool ow_scan_filter_matches_info(ow_scan_filter_type_t filter_type, const le_advertising_info* info)
+static bool ow_scan_filter_matches_ad(ow_scan_filter_type_t filter_type, const ow_scan_ad_t* ad)
 {
 	//Match everything?
 	if (filter_type == OW_SCAN_FILTER_TYPE_ALL)
@@ -187,66 +730,66 @@ static bool ow_scan_filter_matches_info(ow_scan_filter_type_t filter_type, const
 		return true;
 	}
 
-	//Read the flags. This can fail (which will be treated as no-match).
-	uint8_t flags;
-
-	if (!ow_scan_read_flags(info, &flags))
+	//Missing flags are treated as no-match:
+	if (!ad->has_flags)
 	{
 		return false;
 	}
 
 	switch (filter_type)
 	{
-	case OW_SCAN_FILTER_TYPE_LIMITED: return (flags & OW_SCAN_FILTER_FLAGS_LIMITED);
-	case OW_SCAN_FILTER_TYPE_GENERAL: return (flags & (OW_SCAN_FILTER_FLAGS_LIMITED | OW_SCAN_FILTER_FLAGS_GENERAL));
+	case OW_SCAN_FILTER_TYPE_LIMITED: return (ad->flags & OW_SCAN_FILTER_FLAGS_LIMITED);
+	case OW_SCAN_FILTER_TYPE_GENERAL: return (ad->flags & (OW_SCAN_FILTER_FLAGS_LIMITED | OW_SCAN_FILTER_FLAGS_GENERAL));
 
 	default: return false;
 	}
 }
 
-static bool ow_scan_parse_friendly_name(const le_advertising_info* info, char* name)
+static const le_advertising_info* ow_scan_match_report(const ow_scan_params* params, const uint8_t* buf, size_t length, ow_scan_ad_t* ad, int8_t* rssi)
 {
-	size_t offset = 0;
-
-	//Make sure we don't read too much:
-	while (offset < info->length)
+	//Not enough bytes?
+	if (length < OW_SCAN_MIN_LENGTH)
 	{
-		uint8_t length = info->data[offset];
+		return NULL;
+	}
 
-		//Validate the length:
-		if ((length == 0) || ((offset + length) >= info->length))
-		{
-			break;
-		}
+	//Retrieve a pointer to the meta struct (we are only interested in advertising reports):
+	const evt_le_meta_event* meta = (const evt_le_meta_event*)(buf + OW_SCAN_META_OFFSET);
 
-		//Get the type:
-		uint8_t type = info->data[offset + 1];
+	if (meta->subevent != OW_SCAN_SUBEVENT_ADVERTISING_INFO)
+	{
+		return NULL;
+	}
 
-		if ((type == OW_SCAN_SHORT_DEVICE_NAME) || (type == OW_SCAN_DEVICE_NAME))
-		{
-			//Validate the name length:
-			size_t name_length = length - 1;
+	//Move forward to the info struct:
+	const le_advertising_info* info = (const le_advertising_info*)(meta->data + 1);
 
-			if (name_length <= OW_MAX_NAME_LENGTH)
-			{
-				//Store the name:
-				memcpy(name, &info->data[offset + 2], name_length);
+	//Make sure there is enough space for the info's data member and the RSSI behind it:
+	if (length < (OW_SCAN_MIN_LENGTH + info->length + 1))
+	{
+		return NULL;
+	}
 
-				//Terminate it:
-				name[name_length] = '\0';
+	//Filtering:
+	ow_scan_parse_ad(info, ad);
 
-				return true;
-			}
-		}
+	if (!ow_scan_filter_matches_ad(params->filter_type, ad))
+	{
+		return NULL;
+	}
 
-		//Increment the offset:
-		offset += 1 + length;
+	//Name match (no name in the parameters matches every named device):
+	if (!ad->has_name || (params->name && (strcmp(ad->name, params->name) != 0)))
+	{
+		return NULL;
 	}
 
-	return false;
+	*rssi = (int8_t)info->data[info->length];
+
+	return info;
 }
 
-static bool ow_scan_for_address(int bt_sock, const ow_scan_params* params, struct hci_filter* old_hci_filter, socklen_t old_hci_filter_length, bdaddr_t* addr)
+static bool ow_scan_enable(int bt_sock, const ow_scan_params* params)
 {
 	//Also ripped from hcitool :) thx, guys
 
@@ -263,16 +806,20 @@ static bool ow_scan_for_address(int bt_sock, const ow_scan_params* params, struc
 	}
 
 	//Adjust the scan parameters:
-	int error;
-
 	if (hci_le_set_scan_parameters(bt_sock, params->active_scan ? 1 : 0, htobs(params->interval), htobs(params->window), params->use_public_addr ? LE_PUBLIC_ADDRESS : LE_RANDOM_ADDRESS, params->use_whitelist ? 1 : 0, params->to) < 0)
 	{
-		error = errno;
-		goto restore_out;
+		return false;
 	}
 
 	//Enable the LE scan:
-	if (hci_le_set_scan_enable(bt_sock, OW_SCAN_ENABLE, params->filter_dup ? 1 : 0, params->to) < 0)
+	return (hci_le_set_scan_enable(bt_sock, OW_SCAN_ENABLE, params->filter_dup ? 1 : 0, params->to) >= 0);
+}
+
+static bool ow_scan_for_address(int bt_sock, const ow_scan_params* params, struct hci_filter* old_hci_filter, socklen_t old_hci_filter_length, int cancel_fd, bdaddr_t* addr)
+{
+	int error;
+
+	if (!ow_scan_enable(bt_sock, params))
 	{
 		error = errno;
 		goto restore_out;
@@ -281,6 +828,33 @@ static bool ow_scan_for_address(int bt_sock, const ow_scan_params* params, struc
 	//Scan until we hit the device:
 	while (1)
 	{
+		//Wait for the socket and the cancel descriptor (if any):
+		if (cancel_fd >= 0)
+		{
+			struct pollfd poll_fds[2] =
+			{
+				{ .fd = bt_sock, .events = POLLIN },
+				{ .fd = cancel_fd, .events = POLLIN }
+			};
+
+			if (poll(poll_fds, 2, -1) < 0)
+			{
+				if (errno == EINTR)
+				{
+					continue;
+				}
+
+				error = errno;
+				goto disable_restore_out;
+			}
+
+			if (poll_fds[1].revents)
+			{
+				error = ECANCELED;
+				goto disable_restore_out;
+			}
+		}
+
 		//Read a new buffer of data:
 		uint8_t buf[HCI_MAX_EVENT_SIZE];
 		int bytes_read = read(bt_sock, buf, HCI_MAX_EVENT_SIZE);
@@ -306,46 +880,12 @@ static bool ow_scan_for_address(int bt_sock, const ow_scan_params* params, struc
 			goto disable_restore_out;
 		}
 
-		//Success case, but not enough bytes?
-		if ((size_t)bytes_read < OW_SCAN_MIN_LENGTH)
-		{
-			continue;
-		}
-
-		//Retrieve a pointer to the meta struct:
-		evt_le_meta_event* meta = (evt_le_meta_event*)(buf + OW_SCAN_META_OFFSET);
-
-		if (meta->subevent != OW_SCAN_SUBEVENT_ADVERTISING_INFO)
-		{
-			error = ENODATA;
-			goto disable_restore_out;
-		}
-
-		//Move forward to the info struct:
-		le_advertising_info* info = (le_advertising_info*)(meta->data + 1);
-
-		//Make sure there is enough space for the info's data member:
-		if ((size_t)bytes_read < (OW_SCAN_MIN_LENGTH + info->length))
-		{
-			continue;
-		}
-
-		//Filtering?
-		if (!ow_scan_filter_matches_info(params->filter_type, info))
-		{
-			continue;
-		}
-
-		//Parse the friendly name of the device:
-		char name[OW_MAX_NAME_LENGTH + 1];
-
-		if (!ow_scan_parse_friendly_name(info, name))
-		{
-			continue;
-		}
-
 		//Match?
-		if (strcmp(name, params->name) == 0)
+		ow_scan_ad_t ad;
+		int8_t rssi;
+		const le_advertising_info* info = ow_scan_match_report(params, buf, bytes_read, &ad, &rssi);
+
+		if (info)
 		{
 			*addr = info->bdaddr;
 			error = 0;
@@ -371,222 +911,72 @@ restore_out:
 	return true;
 }
 
-static bool ow_connect(int bt_sock, bdaddr_t addr, const ow_connect_params* params, uint16_t* hci_handle)
-{
-	return (hci_le_create_conn(bt_sock, htobs(params->interval), htobs(params->window), params->use_whitelist ? 1 : 0, params->use_peer_public_addr ? LE_PUBLIC_ADDRESS : LE_RANDOM_ADDRESS, addr, params->use_own_public_addr ? LE_PUBLIC_ADDRESS : LE_RANDOM_ADDRESS, htobs(params->min_interval), htobs(params->max_interval), htobs(params->latency), htobs(params->supervision_timeout), htobs(params->min_ce_length), htobs(params->max_ce_length), hci_handle, params->to) >= 0);
-}
-
-static bool ow_recv_n_sample(ow_sample_t sample, void* context)
-{
-	//Get the context:
-	ow_recv_n_context_t* recv_n_context = context;
-
-	//Store the sample:
-	recv_n_context->samples[recv_n_context->count++] = sample;
-
-	//More samples to receive?
-	return (recv_n_context->count < recv_n_context->n);
-}
-
-const char* ow_unit_to_str(ow_unit_t unit)
+static size_t ow_scan_hash_addr(const bdaddr_t* addr)
 {
-	switch (unit)
-	{
-	case OW_UNIT_MILLIVOLT:			return "Millivolt";
-	case OW_UNIT_VOLT: 				return "Volt";
-
-	case OW_UNIT_MICROAMPERE: 		return "Microampere";
-	case OW_UNIT_MILLIAMPERE: 		return "Milliampere";
-	case OW_UNIT_AMPERE: 			return "Ampere";
-
-	case OW_UNIT_OHM: 				return "Ohm";
-	case OW_UNIT_KILOOHM: 			return "Kiloohm";
-	case OW_UNIT_MEGAOHM: 			return "Megaohm";
-
-	case OW_UNIT_NANOFARAD: 		return "Nanofarad";
-	case OW_UNIT_MICROFARAD: 		return "Microfarad";
-	case OW_UNIT_MILLIFARAD: 		return "Millifarad";
-	case OW_UNIT_FARAD: 			return "Farad";
-
-	case OW_UNIT_HERTZ: 			return "Hertz";
-	case OW_UNIT_PERCENT: 			return "Percent";
-
-	case OW_UNIT_CELSIUS: 			return "Celsius";
-	case OW_UNIT_FAHRENHEIT: 		return "Fahrenheit";
+	//FNV-1a over the six address bytes:
+	uint32_t hash = 2166136261u;
 
-	case OW_UNIT_NEARFIELD: 		return "Near field";
-
-	default: 						return "Unknown";
-	}
-}
-
-const char* ow_unit_to_short_str(ow_unit_t unit)
-{
-	switch (unit)
+	for (size_t i = 0; i < sizeof(addr->b); i++)
 	{
-	case OW_UNIT_MILLIVOLT:			return "mV";
-	case OW_UNIT_VOLT: 				return "V";
-
-	case OW_UNIT_MICROAMPERE: 		return "µA";
-	case OW_UNIT_MILLIAMPERE: 		return "mA";
-	case OW_UNIT_AMPERE: 			return "A";
-
-	case OW_UNIT_OHM: 				return "Ω";
-	case OW_UNIT_KILOOHM: 			return "kΩ";
-	case OW_UNIT_MEGAOHM: 			return "MΩ";
-
-	case OW_UNIT_NANOFARAD: 		return "nF";
-	case OW_UNIT_MICROFARAD: 		return "µF";
-	case OW_UNIT_MILLIFARAD: 		return "mF";
-	case OW_UNIT_FARAD: 			return "F";
-
-	case OW_UNIT_HERTZ: 			return "Hz";
-	case OW_UNIT_PERCENT: 			return "%";
-
-	case OW_UNIT_CELSIUS: 			return "°C";
-	case OW_UNIT_FAHRENHEIT: 		return "°F";
-
-	case OW_UNIT_NEARFIELD: 		return "NCV";
-
-	default: 						return "?";
+		hash = (hash ^ addr->b[i]) * 16777619u;
 	}
-}
-
-const char* ow_current_type_to_str(ow_current_type_t current_type)
-{
-	switch (current_type)
-	{
-	case OW_CURRENT_TYPE_DC: return "DC";
-	case OW_CURRENT_TYPE_AC: return "AC";
 
-	default: return "?";
-	}
+	return hash;
 }
 
-bool ow_recv(const ow_config_t* config, ow_sample_func_t callback, void* context)
+static int ow_scan_compare_results(const void* a, const void* b)
 {
-	//Do we have to query the default adapter's device ID?
-	int dev_id;
-
-	if (config->dev_id == OW_DEV_ID_AUTOMATIC)
-	{
-		if (!ow_get_default_device_id(&dev_id))
-		{
-			return false;
-		}
-	}
-	else
-	{
-		dev_id = config->dev_id;
-	}
-
-	//Open a socket:
-	int bt_sock;
+	const ow_scan_result_t* result_a = a;
+	const ow_scan_result_t* result_b = b;
 
-	if (!ow_open_socket(dev_id, &bt_sock))
+	//Strongest signal first:
+	if (result_a->rssi != result_b->rssi)
 	{
-		return false;
+		return (result_a->rssi > result_b->rssi) ? -1 : 1;
 	}
 
-	//Query the old HCI filter to restore later:
-	int error;
-	struct hci_filter old_hci_filter;
-	socklen_t old_hci_filter_length;
-
-	if (!ow_get_hci_filter(bt_sock, &old_hci_filter, &old_hci_filter_length))
+	//Then the most recently seen:
+	if (result_a->last_seen.tv_sec != result_b->last_seen.tv_sec)
 	{
-		error = errno;
-		goto close_out;
+		return (result_a->last_seen.tv_sec > result_b->last_seen.tv_sec) ? -1 : 1;
 	}
 
-	//Do we have to scan for the multimeter's address?
-	bdaddr_t addr;
-
-	switch (config->scan_mode)
+	if (result_a->last_seen.tv_nsec != result_b->last_seen.tv_nsec)
 	{
-	case OW_SCAN_MODE_NONE:
-
-		addr = config->addr;
-		break;
-
-	case OW_SCAN_MODE_AUTOMATIC:
-
-		if (!ow_scan_for_address(bt_sock, &automatic_scan_params, &old_hci_filter, old_hci_filter_length, &addr))
-		{
-			error = errno;
-			goto close_out;
-		}
-
-		break;
-
-	case OW_SCAN_MODE_MANUAL:
-
-		if (!ow_scan_for_address(bt_sock, &config->scan_params, &old_hci_filter, old_hci_filter_length, &addr))
-		{
-			error = errno;
-			goto close_out;
-		}
-
-		break;
-
-	default:
-
-		error = EINVAL;
-		goto close_out;
+		return (result_a->last_seen.tv_nsec > result_b->last_seen.tv_nsec) ? -1 : 1;
 	}
 
-	//Connect to the multimeter:
-	uint16_t hci_handle;
-
-	switch (config->connect_mode)
-	{
-	case OW_CONNECT_MODE_AUTOMATIC:
-
-		if (!ow_connect(bt_sock, addr, &automatic_connect_params, &hci_handle))
-		{
-			error = errno;
-			goto close_out;
-		}
-
-		break;
-
-	case OW_CONNECT_MODE_MANUAL:
-
-		if (!ow_connect(bt_sock, addr, &config->connect_params, &hci_handle))
-		{
-			error = errno;
-			goto close_out;
-		}
-
-		break;
-
-	default:
+	return 0;
+}
 
-		error = EINVAL;
-		goto close_out;
-	}
+static bool ow_connect(int bt_sock, bdaddr_t addr, const ow_connect_params* params, uint16_t* hci_handle)
+{
+	return (hci_le_create_conn(bt_sock, htobs(params->interval), htobs(params->window), params->use_whitelist ? 1 : 0, params->use_peer_public_addr ? LE_PUBLIC_ADDRESS : LE_RANDOM_ADDRESS, addr, params->use_own_public_addr ? LE_PUBLIC_ADDRESS : LE_RANDOM_ADDRESS, htobs(params->min_interval), htobs(params->max_interval), htobs(params->latency), htobs(params->supervision_timeout), htobs(params->min_ce_length), htobs(params->max_ce_length), hci_handle, params->to) >= 0);
+}
 
-	//Make sure we only see asynchronous data packets:
-	struct hci_filter async_filter;
+static inline bool ow_frame_is_valid(const ow_frame_matcher_t* matcher, const uint8_t* frame, size_t length)
+{
+	//Exact length and constant header:
+	return (length == OW_SAMPLE_LENGTH) && ow_frame_matches(matcher, frame);
+}
 
-	hci_filter_clear(&async_filter);
-	hci_filter_set_ptype(HCI_ACLDATA_PKT, &async_filter);
+static bool ow_recv_frames(const ow_source_t* source, ow_frame_func_t frame_func, void* context)
+{
+	//Prepare the header template for the HCI handle:
+	ow_frame_matcher_t matcher;
+	ow_frame_matcher_init(&matcher, source->hci_handle);
 
-	if (!ow_set_hci_filter(bt_sock, &async_filter, sizeof(struct hci_filter)))
-	{
-		error = errno;
-		goto disc_close_out;
-	}
+	ow_stats_t* stats = source->stats;
 
 	//Receive until the user signals us to end:
-	ow_sample_t sample;
 	bool shall_continue = true;
 
 	do
 	{
-		//Read a bunch of data from the device:
+		//Read the next frame from the source:
 		uint8_t buf[HCI_MAX_EVENT_SIZE];
-		int bytes_read = read(bt_sock, buf, sizeof(buf));
+		struct timespec timestamp = { 0 };
+		int bytes_read = source->read(source->context, buf, sizeof(buf), &timestamp);
 
 		//Error case?
 		if (bytes_read < 0)
@@ -594,181 +984,2660 @@ bool ow_recv(const ow_config_t* config, ow_sample_func_t callback, void* context
 			//Recoverable cases:
 			if ((errno == EAGAIN) || (errno == EINTR))
 			{
+				if (stats)
+				{
+					OW_STATS_ADD(stats, retries, 1);
+				}
+
 				continue;
 			}
 
 			//Fatal cases:
-			error = errno;
-			goto restore_disc_close_out;
+			return false;
 		}
 
 		//EoF case?
 		if (bytes_read == 0)
 		{
-			error = ENODATA;
-			goto restore_disc_close_out;
+			errno = ENODATA;
+			return false;
 		}
 
-		//Success case, but wrong number of bytes?
-		if ((size_t)bytes_read != OW_SAMPLE_LENGTH)
-		{
-			continue;
-		}
+		ow_fill_timestamps(&timestamp, 1);
 
-		//Validate the data.
-		//HCI packet type:
-		if (buf[0] != HCI_ACLDATA_PKT)
+		if (source->tap)
 		{
-			continue;
+			source->tap(buf, bytes_read, &timestamp, source->tap_context);
 		}
 
-		//Flagged HCI handle:
-		if (((*(uint16_t*)&buf[1]) & 0x0FFF) != hci_handle)
-		{
-			continue;
-		}
+		//Success case, but no valid sample?
+		bool is_valid = ow_frame_is_valid(&matcher, buf, bytes_read);
 
-		//Total length:
-		if (*(uint16_t*)&buf[3] != (OW_SAMPLE_LENGTH - 5))
+		if (stats)
 		{
-			continue;
+			ow_stats_count_frame(stats, &matcher, buf, bytes_read, is_valid);
 		}
 
-		//L2CAP length:
-		if (*(uint16_t*)&buf[5] != (OW_SAMPLE_LENGTH - 9))
+		if (!is_valid)
 		{
 			continue;
 		}
 
-		//L2CAP destination CID:
-		if (*(uint16_t*)&buf[7] != OW_L2CAP_DEST_CID)
+		//Pass the frame on:
+		if (stats)
 		{
-			continue;
-		}
+			struct timespec start;
 
-		//ATT command:
-		if (buf[9] != OW_ATT_OPCODE_HANDLE_VALUE_NOTIFICATION)
+			bool is_timed = ow_stats_begin_callback(stats, &start);
+			shall_continue = frame_func(buf, &timestamp, context);
+			ow_stats_end_callback(stats, &start, is_timed);
+		}
+		else
 		{
-			continue;
+			shall_continue = frame_func(buf, &timestamp, context);
 		}
+	} while (shall_continue);
+
+	return true;
+}
+
+static bool ow_recv_batches(const ow_source_t* source, ow_batch_func_t callback, void* context, size_t max_batch, unsigned long max_latency_us)
+{
+	if (max_batch == 0)
+	{
+		errno = EINVAL;
+		return false;
+	}
+
+	//Allocate the batch:
+	ow_sample_t* batch = malloc(max_batch * sizeof(ow_sample_t));
+
+	if (!batch)
+	{
+		return false;
+	}
+
+	//Switch a pollable source to non-blocking mode, so we can drain it:
+	int error = 0;
+	int old_flags = -1;
+
+	if (source->fd >= 0)
+	{
+		old_flags = fcntl(source->fd, F_GETFL);
 
-		//Handle:
-		if (*(uint16_t*)&buf[10] != OW_ATT_HANDLE)
+		if ((old_flags < 0) || (fcntl(source->fd, F_SETFL, old_flags | O_NONBLOCK) < 0))
 		{
-			continue;
+			error = errno;
+			goto free_out;
 		}
+	}
 
-		//Parse 6 bytes of data (one is unused).
+	//Prepare the header template for the HCI handle:
+	ow_frame_matcher_t matcher;
+	ow_frame_matcher_init(&matcher, source->hci_handle);
 
-		//Get the actual value and the sign bit:
-		uint16_t value_sign =  *(uint16_t*)&buf[16];
+	ow_stats_t* stats = source->stats;
 
-		//Get unit and places:
-		uint16_t unit_places = *(uint16_t*)&buf[12];
+	//The batch is flushed at this point in time:
+	struct timespec deadline;
+	size_t count = 0;
+	bool shall_continue = true;
 
-		//Determine the unit and the current type:
-		switch (unit_places & 0xFFF8)
+	while (shall_continue)
+	{
+		//Wait for frames. If there are pending samples, only as long as the latency bound allows.
+		if (source->fd >= 0)
 		{
-		case 0xF018: sample.unit = OW_UNIT_MILLIVOLT; sample.current_type = OW_CURRENT_TYPE_DC; break;
-		case 0xF058: sample.unit = OW_UNIT_MILLIVOLT; sample.current_type = OW_CURRENT_TYPE_AC; break;
-		case 0xF020: sample.unit = OW_UNIT_VOLT; sample.current_type = OW_CURRENT_TYPE_DC; sample.is_diode_test = false; break;
-		case 0xF060: sample.unit = OW_UNIT_VOLT; sample.current_type = OW_CURRENT_TYPE_AC; sample.is_diode_test = false; break;
-		case 0xF2A0: sample.unit = OW_UNIT_VOLT; sample.current_type = OW_CURRENT_TYPE_DC; sample.is_diode_test = true; break;
-		case 0xF090: sample.unit = OW_UNIT_MICROAMPERE; sample.current_type = OW_CURRENT_TYPE_DC; break;
-		case 0xF0D0: sample.unit = OW_UNIT_MICROAMPERE; sample.current_type = OW_CURRENT_TYPE_AC; break;
-		case 0xF098: sample.unit = OW_UNIT_MILLIAMPERE; sample.current_type = OW_CURRENT_TYPE_DC; break;
-		case 0xF0D8: sample.unit = OW_UNIT_MILLIAMPERE; sample.current_type = OW_CURRENT_TYPE_AC; break;
-		case 0xF0A0: sample.unit = OW_UNIT_AMPERE; sample.current_type = OW_CURRENT_TYPE_DC; break;
-		case 0xF0E0: sample.unit = OW_UNIT_AMPERE; sample.current_type = OW_CURRENT_TYPE_AC; break;
-		case 0xF120: sample.unit = OW_UNIT_OHM; sample.is_continuity_test = false; break;
-		case 0xF2E0: sample.unit = OW_UNIT_OHM; sample.is_continuity_test = true; break;
-		case 0xF128: sample.unit = OW_UNIT_KILOOHM; break;
-		case 0xF130: sample.unit = OW_UNIT_MEGAOHM; break;
-		case 0xF148: sample.unit = OW_UNIT_NANOFARAD; break;
-		case 0xF150: sample.unit = OW_UNIT_MICROFARAD; break;
-		case 0xF158: sample.unit = OW_UNIT_MILLIFARAD; break;
-		case 0xF160: sample.unit = OW_UNIT_FARAD; break;
-		case 0xF1A0: sample.unit = OW_UNIT_HERTZ; break;
-		case 0xF1E0: sample.unit = OW_UNIT_PERCENT; break;
-		case 0xF220: sample.unit = OW_UNIT_CELSIUS; break;
-		case 0xF260: sample.unit = OW_UNIT_FAHRENHEIT; break;
-		case 0xF360: sample.unit = OW_UNIT_NEARFIELD; break;
+			struct pollfd poll_fd = { .fd = source->fd, .events = POLLIN };
+			struct timespec timeout;
 
-		default: sample.unit = OW_UNIT_UNKNOWN;
+			if ((count == 0) || ow_timespec_until(&deadline, &timeout))
+			{
+				if (ppoll(&poll_fd, 1, (count > 0) ? &timeout : NULL, NULL) < 0)
+				{
+					if (errno == EINTR)
+					{
+						if (stats)
+						{
+							OW_STATS_ADD(stats, retries, 1);
+						}
+
+						continue;
+					}
+
+					error = errno;
+					break;
+				}
+			}
 		}
 
-		//Use value, sign bit and decimal places to retrieve the final value:
-		//First, test for an overflow.
-		if (unit_places & (1 << 2))
-		{
-			sample.value = NAN;
-		}
-		else
+		//Drain whatever is ready:
+		int end_error = 0;
+
+		while (count < max_batch)
 		{
-			//Determine the factor to generate the decimal places:
-			double factor;
+			uint8_t bufs[OW_BATCH_READ_COUNT][HCI_MAX_EVENT_SIZE];
+			size_t lengths[OW_BATCH_READ_COUNT];
+			struct timespec timestamps[OW_BATCH_READ_COUNT];
+			size_t wanted = max_batch - count;
+
+			int frames = ow_source_read_frames(source, bufs, (wanted < OW_BATCH_READ_COUNT) ? wanted : OW_BATCH_READ_COUNT, lengths, timestamps);
+
+			//Nothing more ready (or interrupted)?
+			if (frames < 0)
+			{
+				if ((errno != EAGAIN) && (errno != EINTR))
+				{
+					end_error = errno;
+				}
+
+				break;
+			}
 
-			switch (unit_places & 0x0003)
+			for (int i = 0; i < frames; i++)
 			{
-			case 0: factor = 1; break;
-			case 1: factor = 0.1; break;
-			case 2: factor = 0.01; break;
-			case 3: factor = 0.001; break;
+				//EoF case?
+				if (lengths[i] == 0)
+				{
+					end_error = ENODATA;
+					break;
+				}
+
+				if (source->tap)
+				{
+					source->tap(bufs[i], lengths[i], &timestamps[i], source->tap_context);
+				}
+
+				bool is_valid = ow_frame_is_valid(&matcher, bufs[i], lengths[i]);
+
+				if (stats)
+				{
+					ow_stats_count_frame(stats, &matcher, bufs[i], lengths[i], is_valid);
+				}
+
+				if (!is_valid)
+				{
+					continue;
+				}
+
+				//The first sample of a batch starts the latency clock:
+				if (count == 0)
+				{
+					clock_gettime(CLOCK_MONOTONIC, &deadline);
+					ow_timespec_add_ns(&deadline, (uint64_t)max_latency_us * 1000);
+				}
+
+				ow_decode_payload(&bufs[i][OW_PAYLOAD_OFFSET], &batch[count]);
+				batch[count++].timestamp = timestamps[i];
 			}
 
-			//Build the number using the sign bit:
-			sample.value = ((value_sign & 0x8000) ? -1.0 : 1.0) * factor * (double)(value_sign & 0x3FFF);
+			//Sources that can't be polled get one read per round, so the latency bound is checked in between:
+			if ((end_error != 0) || (source->fd < 0))
+			{
+				break;
+			}
 		}
 
-		//Get the flag byte:
-		uint8_t flags = buf[14];
+		//Flush the batch if it is full, its latency bound has expired or the source has ended:
+		struct timespec remaining;
 
-		//Query the flags:
-		sample.is_data_hold = (flags & (1 << 0)) != 0;
-		sample.is_relative = (flags & (1 << 1)) != 0;
-		sample.is_auto_range = (flags & (1 << 2)) != 0;
-		sample.is_low_battery = (flags & (1 << 3)) != 0;
+		if ((count > 0) && ((count == max_batch) || (end_error != 0) || !ow_timespec_until(&deadline, &remaining)))
+		{
+			struct timespec start;
+			bool is_timed = stats && ow_stats_begin_callback(stats, &start);
 
-		//Pass the sample to the callback:
-		shall_continue = callback(sample, context);
-	} while (shall_continue);
+			shall_continue = callback(batch, count, context);
 
-	//Success case:
-	error = 0;
+			if (stats)
+			{
+				ow_stats_end_callback(stats, &start, is_timed);
+			}
 
-restore_disc_close_out:
-	//Restore the old HCI filter:
-	ow_set_hci_filter(bt_sock, &old_hci_filter, old_hci_filter_length);
+			count = 0;
+		}
 
-disc_close_out:
-	//Disconnect:
-	hci_disconnect(bt_sock, hci_handle, HCI_OE_USER_ENDED_CONNECTION, 10000);
+		//Report the end of the source unless the user is done anyway:
+		if (end_error != 0)
+		{
+			if (shall_continue)
+			{
+				error = end_error;
+			}
 
-close_out:
-	//Close the socket:
-	hci_close_dev(bt_sock);
+			break;
+		}
+	}
 
-	if (error == 0)
+	//Restore the descriptor flags:
+	if (source->fd >= 0)
 	{
-		return true;
+		fcntl(source->fd, F_SETFL, old_flags);
 	}
-	else
+
+free_out:
+	free(batch);
+
+	if (error != 0)
 	{
 		errno = error;
 		return false;
 	}
-}
+
+	return true;
+}
+
+static int ow_source_read_frames(const ow_source_t* source, uint8_t (*bufs)[HCI_MAX_EVENT_SIZE], size_t count, size_t* lengths, struct timespec* timestamps)
+{
+	memset(timestamps, 0, count * sizeof(struct timespec));
+
+	//Many frames at once?
+	int frames;
+
+	if (source->read_many)
+	{
+		frames = source->read_many(source->context, bufs[0], HCI_MAX_EVENT_SIZE, count, lengths, timestamps);
+	}
+	else
+	{
+		//A single frame:
+		int bytes_read = source->read(source->context, bufs[0], HCI_MAX_EVENT_SIZE, &timestamps[0]);
+
+		if (bytes_read < 0)
+		{
+			return -1;
+		}
+
+		lengths[0] = bytes_read;
+		frames = 1;
+	}
+
+	if (frames > 0)
+	{
+		ow_fill_timestamps(timestamps, frames);
+	}
+
+	return frames;
+}
+
+static void ow_fill_timestamps(struct timespec* timestamps, size_t count)
+{
+	//Ask the clock at most once:
+	struct timespec now = { 0 };
+
+	for (size_t i = 0; i < count; i++)
+	{
+		if ((timestamps[i].tv_sec != 0) || (timestamps[i].tv_nsec != 0))
+		{
+			continue;
+		}
+
+		if ((now.tv_sec == 0) && (now.tv_nsec == 0))
+		{
+			clock_gettime(CLOCK_REALTIME, &now);
+		}
+
+		timestamps[i] = now;
+	}
+}
+
+static bool ow_run_frame_loop(const ow_source_t* source, void* context)
+{
+	ow_frame_loop_t* loop = context;
+	return ow_recv_frames(source, loop->frame_func, loop->context);
+}
+
+static bool ow_run_batch_loop(const ow_source_t* source, void* context)
+{
+	ow_batch_loop_t* loop = context;
+	return ow_recv_batches(source, loop->callback, loop->context, loop->max_batch, loop->max_latency_us);
+}
+
+static bool ow_recv_n_sample(ow_sample_t sample, void* context)
+{
+	//Get the context:
+	ow_recv_n_context_t* recv_n_context = context;
+
+	//Store the sample:
+	recv_n_context->samples[recv_n_context->count++] = sample;
+
+	//More samples to receive?
+	return (recv_n_context->count < recv_n_context->n);
+}
+
+static bool ow_sample_frame(const uint8_t* frame, const struct timespec* timestamp, void* context)
+{
+	ow_sample_callback_context_t* callback_context = context;
+
+	//Decode the payload and pass the sample to the callback:
+	ow_sample_t sample;
+	ow_decode_payload(&frame[OW_PAYLOAD_OFFSET], &sample);
+	sample.timestamp = *timestamp;
+
+	return callback_context->callback(sample, callback_context->context);
+}
+
+static bool ow_packed_frame(const uint8_t* frame, const struct timespec* timestamp, void* context)
+{
+	//Packed samples have no room for the timestamp:
+	(void)timestamp;
+
+	ow_packed_callback_context_t* callback_context = context;
+
+	//Pack the payload without decoding it:
+	ow_sample_packed_t packed;
+	ow_pack_payload(&frame[OW_PAYLOAD_OFFSET], &packed);
+
+	return callback_context->callback(packed, callback_context->context);
+}
+
+static bool ow_view_frame(const uint8_t* frame, const struct timespec* timestamp, void* context)
+{
+	ow_view_callback_context_t* callback_context = context;
+
+	//The view points right into the receive buffer:
+	ow_frame_view_t view =
+	{
+		.payload = &frame[OW_PAYLOAD_OFFSET],
+		.timestamp = *timestamp
+	};
+
+	return callback_context->callback(&view, callback_context->context);
+}
+
+static bool ow_normalized_batch(const ow_sample_t* samples, size_t count, void* context)
+{
+	ow_normalized_context_t* normalized_context = context;
+
+	ow_normalize(samples, count, normalized_context->normalized);
+	return normalized_context->callback(normalized_context->normalized, count, normalized_context->context);
+}
+
+static bool ow_change_frame(const uint8_t* frame, const struct timespec* timestamp, void* context)
+{
+	ow_change_context_t* change_context = context;
+	const uint8_t* payload = &frame[OW_PAYLOAD_OFFSET];
+
+	//Same payload as before? Extend the run.
+	if (change_context->has_run && (memcmp(change_context->payload, payload, OW_PAYLOAD_LENGTH) == 0))
+	{
+		change_context->last_timestamp = *timestamp;
+		change_context->count++;
+
+		if (change_context->heartbeat_ms == 0)
+		{
+			return true;
+		}
+
+		//Cut the run if it has lasted long enough:
+		int64_t span_ms = (int64_t)(timestamp->tv_sec - change_context->first_timestamp.tv_sec) * 1000 + (timestamp->tv_nsec - change_context->first_timestamp.tv_nsec) / 1000000;
+
+		if (span_ms < (int64_t)change_context->heartbeat_ms)
+		{
+			return true;
+		}
+
+		change_context->has_run = false;
+		return ow_change_deliver(change_context, true);
+	}
+
+	//A new value ends the pending run:
+	bool shall_continue = true;
+
+	if (change_context->has_run)
+	{
+		shall_continue = ow_change_deliver(change_context, false);
+	}
+
+	memcpy(change_context->payload, payload, OW_PAYLOAD_LENGTH);
+	change_context->first_timestamp = *timestamp;
+	change_context->last_timestamp = *timestamp;
+	change_context->count = 1;
+	change_context->has_run = true;
+
+	return shall_continue;
+}
+
+static bool ow_change_deliver(ow_change_context_t* change_context, bool is_heartbeat)
+{
+	ow_sample_run_t run;
+
+	ow_decode_payload(change_context->payload, &run.sample);
+	run.sample.timestamp = change_context->first_timestamp;
+	run.last_timestamp = change_context->last_timestamp;
+	run.count = change_context->count;
+	run.is_heartbeat = is_heartbeat;
+
+	return change_context->callback(&run, change_context->context);
+}
+
+static bool ow_run_change_loop(const ow_source_t* source, void* context)
+{
+	ow_change_context_t* change_context = context;
+
+	if (ow_recv_frames(source, ow_change_frame, change_context))
+	{
+		return true;
+	}
+
+	//Don't lose the last run of a replay:
+	if ((errno == ENODATA) && change_context->has_run)
+	{
+		change_context->has_run = false;
+		ow_change_deliver(change_context, false);
+
+		errno = ENODATA;
+	}
+
+	return false;
+}
+
+static bool ow_multi_frame(const uint8_t* frame, const struct timespec* timestamp, void* context)
+{
+	ow_multi_context_t* multi_context = context;
+
+	//Find the device by the HCI handle (there are only a few of them):
+	uint16_t hci_handle = ow_read_le16(&frame[1]) & 0x0FFF;
+
+	for (size_t i = 0; i < multi_context->count; i++)
+	{
+		ow_multi_device_t* device = &multi_context->devices[i];
+
+		if ((device->hci_handle != hci_handle) || device->is_done)
+		{
+			continue;
+		}
+
+		//Decode the payload and pass the sample to the device's callback:
+		ow_sample_t sample;
+		ow_decode_payload(&frame[OW_PAYLOAD_OFFSET], &sample);
+		sample.timestamp = *timestamp;
+
+		if (!device->callback(sample, device->context))
+		{
+			device->is_done = true;
+			multi_context->active--;
+		}
+
+		break;
+	}
+
+	//Continue as long as any device wants more:
+	return (multi_context->active > 0);
+}
+
+static void ow_pack_payload(const uint8_t* payload, ow_sample_packed_t* packed)
+{
+	packed->unit_places = ow_read_le16(&payload[0]);
+	packed->value_sign = ow_read_le16(&payload[4]) & (OW_VALUE_MAGNITUDE_MASK | OW_VALUE_SIGN_BIT);
+	packed->flags = payload[2] & OW_FLAGS_MASK;
+	memset(packed->reserved, 0, sizeof(packed->reserved));
+}
+
+static bool ow_read_full(int fd, int cancel_fd, void* buf, size_t length)
+{
+	size_t offset = 0;
+
+	while (offset < length)
+	{
+		//Wait for data or the cancel descriptor (a pipe may stall in the middle of a record):
+		if (cancel_fd >= 0)
+		{
+			struct pollfd poll_fds[2] =
+			{
+				{ .fd = fd, .events = POLLIN },
+				{ .fd = cancel_fd, .events = POLLIN }
+			};
+
+			if (poll(poll_fds, 2, -1) < 0)
+			{
+				if (errno == EINTR)
+				{
+					continue;
+				}
+
+				return false;
+			}
+
+			if (poll_fds[1].revents)
+			{
+				errno = ECANCELED;
+				return false;
+			}
+		}
+
+		ssize_t bytes_read = read(fd, (uint8_t*)buf + offset, length - offset);
+
+		//Error case?
+		if (bytes_read < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+
+			return false;
+		}
+
+		//EoF case? A truncated record is a protocol error.
+		if (bytes_read == 0)
+		{
+			errno = (offset == 0) ? 0 : EPROTO;
+			return false;
+		}
+
+		offset += bytes_read;
+	}
+
+	return true;
+}
+
+static uint32_t ow_read_be32(const uint8_t* buf)
+{
+	return ((uint32_t)buf[0] << 24) | ((uint32_t)buf[1] << 16) | ((uint32_t)buf[2] << 8) | (uint32_t)buf[3];
+}
+
+static uint64_t ow_read_be64(const uint8_t* buf)
+{
+	return ((uint64_t)ow_read_be32(buf) << 32) | (uint64_t)ow_read_be32(buf + 4);
+}
+
+static int ow_fd_source_read(void* context, uint8_t* buf, size_t length, struct timespec* timestamp)
+{
+	//The context is the descriptor itself:
+	return ow_read_timestamped((int)(intptr_t)context, buf, length, timestamp);
+}
+
+static int ow_fd_source_read_many(void* context, uint8_t* bufs, size_t stride, size_t count, size_t* lengths, struct timespec* timestamps)
+{
+	int fd = (int)(intptr_t)context;
+
+	if (count > OW_BATCH_READ_COUNT)
+	{
+		count = OW_BATCH_READ_COUNT;
+	}
+
+	//Receive as many datagrams as are ready with a single syscall:
+	struct mmsghdr messages[OW_BATCH_READ_COUNT];
+	struct iovec vectors[OW_BATCH_READ_COUNT];
+	ow_timestamp_control_t controls[OW_BATCH_READ_COUNT];
+
+	memset(messages, 0, count * sizeof(struct mmsghdr));
+
+	for (size_t i = 0; i < count; i++)
+	{
+		vectors[i].iov_base = bufs + i * stride;
+		vectors[i].iov_len = stride;
+
+		messages[i].msg_hdr.msg_iov = &vectors[i];
+		messages[i].msg_hdr.msg_iovlen = 1;
+		messages[i].msg_hdr.msg_control = &controls[i];
+		messages[i].msg_hdr.msg_controllen = sizeof(ow_timestamp_control_t);
+	}
+
+	int received = recvmmsg(fd, messages, count, MSG_DONTWAIT, NULL);
+
+	if (received < 0)
+	{
+		//Not a socket? Fall back to a single read(2).
+		if (errno != ENOTSOCK)
+		{
+			return -1;
+		}
+
+		int bytes_read = read(fd, bufs, stride);
+
+		if (bytes_read < 0)
+		{
+			return -1;
+		}
+
+		lengths[0] = bytes_read;
+		return 1;
+	}
+
+	for (int i = 0; i < received; i++)
+	{
+		lengths[i] = messages[i].msg_len;
+		ow_message_timestamp(&messages[i].msg_hdr, &timestamps[i]);
+	}
+
+	return received;
+}
+
+static void ow_enable_timestamps(int fd)
+{
+	//Only sockets can do this:
+	int domain;
+	socklen_t domain_length = sizeof(domain);
+
+	if (getsockopt(fd, SOL_SOCKET, SO_DOMAIN, &domain, &domain_length) != 0)
+	{
+		return;
+	}
+
+	//Raw HCI sockets have their own option (SO_TIMESTAMPNS is ignored there):
+	int enable = 1;
+
+	if (domain == AF_BLUETOOTH)
+	{
+		setsockopt(fd, SOL_HCI, HCI_TIME_STAMP, &enable, sizeof(enable));
+	}
+	else
+	{
+		setsockopt(fd, SOL_SOCKET, SO_TIMESTAMPNS, &enable, sizeof(enable));
+	}
+}
+
+static int ow_read_timestamped(int fd, uint8_t* buf, size_t length, struct timespec* timestamp)
+{
+	struct iovec vector = { .iov_base = buf, .iov_len = length };
+	ow_timestamp_control_t control;
+
+	struct msghdr message =
+	{
+		.msg_iov = &vector,
+		.msg_iovlen = 1,
+		.msg_control = &control,
+		.msg_controllen = sizeof(control)
+	};
+
+	ssize_t bytes_read = recvmsg(fd, &message, 0);
+
+	if (bytes_read < 0)
+	{
+		//Not a socket? Then there is no timestamp either.
+		return (errno == ENOTSOCK) ? read(fd, buf, length) : -1;
+	}
+
+	ow_message_timestamp(&message, timestamp);
+	return (int)bytes_read;
+}
+
+static void ow_message_timestamp(struct msghdr* message, struct timespec* timestamp)
+{
+	for (struct cmsghdr* control = CMSG_FIRSTHDR(message); control; control = CMSG_NXTHDR(message, control))
+	{
+		//Generic sockets (SO_TIMESTAMPNS):
+		if ((control->cmsg_level == SOL_SOCKET) && (control->cmsg_type == SCM_TIMESTAMPNS))
+		{
+			memcpy(timestamp, CMSG_DATA(control), sizeof(struct timespec));
+			return;
+		}
+
+		//Raw HCI sockets (HCI_TIME_STAMP, microseconds only):
+		if ((control->cmsg_level == SOL_HCI) && (control->cmsg_type == HCI_CMSG_TSTAMP))
+		{
+			struct timeval time;
+			memcpy(&time, CMSG_DATA(control), sizeof(struct timeval));
+
+			timestamp->tv_sec = time.tv_sec;
+			timestamp->tv_nsec = (long)time.tv_usec * 1000;
+
+			return;
+		}
+	}
+}
+
+static int ow_replay_source_read(void* context, uint8_t* buf, size_t length, struct timespec* receive_time)
+{
+	ow_replay_t* replay = context;
+
+	//Datagram replays deliver one frame per read(2):
+	if (replay->format == OW_REPLAY_FORMAT_DATAGRAM)
+	{
+		//With a cancel descriptor, wait for it and the replay here (the source can't be polled then):
+		if (replay->cancel_fd >= 0)
+		{
+			struct pollfd poll_fds[2] =
+			{
+				{ .fd = replay->fd, .events = POLLIN },
+				{ .fd = replay->cancel_fd, .events = POLLIN }
+			};
+
+			//EINTR goes to the receive loop:
+			if (poll(poll_fds, 2, -1) < 0)
+			{
+				return -1;
+			}
+
+			if (poll_fds[1].revents)
+			{
+				errno = ECANCELED;
+				return -1;
+			}
+		}
+
+		return ow_read_timestamped(replay->fd, buf, length, receive_time);
+	}
+
+	//btsnoop: Read the record header first.
+	uint8_t header[OW_BTSNOOP_RECORD_HEADER_LENGTH];
+
+	if (!ow_read_full(replay->fd, replay->cancel_fd, header, sizeof(header)))
+	{
+		//Map a clean EoF to a zero-length read:
+		return (errno == 0) ? 0 : -1;
+	}
+
+	uint32_t included_length = ow_read_be32(&header[4]);
+	uint64_t timestamp = ow_read_be64(&header[16]);
+
+	//Read as much of the frame as fits into the buffer:
+	size_t frame_length = (included_length < length) ? included_length : length;
+
+	if (!ow_read_full(replay->fd, replay->cancel_fd, buf, frame_length))
+	{
+		if (errno == 0)
+		{
+			errno = EPROTO;
+		}
+
+		return -1;
+	}
+
+	//Skip the rest of oversized frames:
+	for (size_t remaining = included_length - frame_length; remaining > 0;)
+	{
+		uint8_t skip[256];
+		size_t skip_length = (remaining < sizeof(skip)) ? remaining : sizeof(skip);
+
+		if (!ow_read_full(replay->fd, replay->cancel_fd, skip, skip_length))
+		{
+			if (errno == 0)
+			{
+				errno = EPROTO;
+			}
+
+			return -1;
+		}
+
+		remaining -= skip_length;
+	}
+
+	//Wait for the frame's turn if we replay at the recorded pace:
+	if ((replay->pacing == OW_REPLAY_PACING_RECORDED) && !ow_replay_pace(replay, timestamp))
+	{
+		return -1;
+	}
+
+	//The frame carries its recorded receive time:
+	if (timestamp >= OW_BTSNOOP_EPOCH_OFFSET_US)
+	{
+		uint64_t unix_timestamp = timestamp - OW_BTSNOOP_EPOCH_OFFSET_US;
+
+		receive_time->tv_sec = (time_t)(unix_timestamp / 1000000);
+		receive_time->tv_nsec = (long)(unix_timestamp % 1000000) * 1000;
+	}
+
+	return (int)frame_length;
+}
+
+static void ow_stats_count_frame(ow_stats_t* stats, const ow_frame_matcher_t* matcher, const uint8_t* frame, size_t length, bool is_valid)
+{
+	OW_STATS_ADD(stats, frames_read, 1);
+	OW_STATS_ADD(stats, bytes_read, length);
+
+	if (!is_valid)
+	{
+		OW_STATS_ADD(stats, rejected[ow_frame_reject_reason(matcher, frame, length)], 1);
+		return;
+	}
+
+	//Look at the unit word without decoding the whole payload:
+	uint16_t unit_places = ow_read_le16(&frame[OW_PAYLOAD_OFFSET]);
+
+	OW_STATS_ADD(stats, samples, 1);
+
+	if (!(ow_unit_codes[unit_places >> 3].attributes & OW_UNIT_CODE_ATTR_KNOWN))
+	{
+		OW_STATS_ADD(stats, unknown_units, 1);
+	}
+
+	if (unit_places & OW_OVERFLOW_BIT)
+	{
+		OW_STATS_ADD(stats, overflows, 1);
+	}
+}
+
+static ow_reject_reason_t ow_frame_reject_reason(const ow_frame_matcher_t* matcher, const uint8_t* frame, size_t length)
+{
+	if (length != OW_SAMPLE_LENGTH)
+	{
+		return OW_REJECT_REASON_LENGTH;
+	}
+
+	//Redo the masked compare and find the first byte that differs:
+	uint64_t diff_lo = (ow_load64(&frame[0]) & matcher->mask_lo) ^ matcher->expected_lo;
+	uint32_t diff_hi = (ow_load32(&frame[8]) & matcher->mask_hi) ^ matcher->expected_hi;
+
+	uint8_t diff[OW_HEADER_LENGTH];
+
+	memcpy(&diff[0], &diff_lo, sizeof(diff_lo));
+	memcpy(&diff[8], &diff_hi, sizeof(diff_hi));
+
+	for (size_t i = 0; i < OW_HEADER_LENGTH; i++)
+	{
+		if (diff[i] != 0)
+		{
+			return ow_header_reject_reasons[i];
+		}
+	}
+
+	//Can't happen for invalid frames:
+	return OW_REJECT_REASON_LENGTH;
+}
+
+static bool ow_stats_begin_callback(const ow_stats_t* stats, struct timespec* start)
+{
+	if ((stats->callbacks % OW_STATS_TIMING_INTERVAL) != 0)
+	{
+		return false;
+	}
+
+	clock_gettime(CLOCK_MONOTONIC, start);
+	return true;
+}
+
+static void ow_stats_end_callback(ow_stats_t* stats, const struct timespec* start, bool is_timed)
+{
+	if (is_timed)
+	{
+		struct timespec end;
+		clock_gettime(CLOCK_MONOTONIC, &end);
+
+		OW_STATS_ADD(stats, timed_callbacks, 1);
+		OW_STATS_ADD(stats, callback_ns, (uint64_t)((int64_t)(end.tv_sec - start->tv_sec) * 1000000000 + (end.tv_nsec - start->tv_nsec)));
+	}
+
+	OW_STATS_ADD(stats, callbacks, 1);
+}
+
+static void ow_timespec_add_ns(struct timespec* time, uint64_t ns)
+{
+	time->tv_sec += (time_t)(ns / 1000000000);
+	time->tv_nsec += (long)(ns % 1000000000);
+
+	if (time->tv_nsec >= 1000000000)
+	{
+		time->tv_sec++;
+		time->tv_nsec -= 1000000000;
+	}
+}
+
+static bool ow_timespec_until(const struct timespec* deadline, struct timespec* remaining)
+{
+	struct timespec now;
+	clock_gettime(CLOCK_MONOTONIC, &now);
+
+	//Already passed?
+	if ((now.tv_sec > deadline->tv_sec) || ((now.tv_sec == deadline->tv_sec) && (now.tv_nsec >= deadline->tv_nsec)))
+	{
+		remaining->tv_sec = 0;
+		remaining->tv_nsec = 0;
+
+		return false;
+	}
+
+	remaining->tv_sec = deadline->tv_sec - now.tv_sec;
+	remaining->tv_nsec = deadline->tv_nsec - now.tv_nsec;
+
+	if (remaining->tv_nsec < 0)
+	{
+		remaining->tv_sec--;
+		remaining->tv_nsec += 1000000000;
+	}
+
+	return true;
+}
+
+static bool ow_replay_pace(ow_replay_t* replay, uint64_t timestamp)
+{
+	//The first frame defines the origin of the timeline:
+	if (!replay->has_origin)
+	{
+		if (clock_gettime(CLOCK_MONOTONIC, &replay->origin_time) != 0)
+		{
+			return false;
+		}
+
+		replay->origin_timestamp = timestamp;
+		replay->has_origin = true;
+
+		return true;
+	}
+
+	//Frames with timestamps from the past are delivered immediately:
+	if (timestamp <= replay->origin_timestamp)
+	{
+		return true;
+	}
+
+	//Calculate the absolute point in time for this frame (timestamps are in microseconds):
+	struct timespec target = replay->origin_time;
+	ow_timespec_add_ns(&target, (timestamp - replay->origin_timestamp) * 1000);
+
+	//Sleep (resume after signals), but wake up for the cancel descriptor (poll(2) ignores it if it is -1):
+	struct timespec remaining;
+
+	while (ow_timespec_until(&target, &remaining))
+	{
+		struct pollfd poll_fd = { .fd = replay->cancel_fd, .events = POLLIN };
+		int result = ppoll(&poll_fd, 1, &remaining, NULL);
+
+		if ((result < 0) && (errno != EINTR))
+		{
+			return false;
+		}
+
+		if (result > 0)
+		{
+			errno = ECANCELED;
+			return false;
+		}
+	}
+
+	return true;
+}
+
+static uint16_t ow_read_le16(const uint8_t* buf)
+{
+	return (uint16_t)buf[0] | ((uint16_t)buf[1] << 8);
+}
+
+static uint64_t ow_load64(const uint8_t* buf)
+{
+	//memcpy(...) compiles to a single unaligned load without violating strict aliasing:
+	uint64_t value;
+	memcpy(&value, buf, sizeof(value));
+
+	return value;
+}
+
+static uint32_t ow_load32(const uint8_t* buf)
+{
+	uint32_t value;
+	memcpy(&value, buf, sizeof(value));
+
+	return value;
+}
+
+static void ow_frame_matcher_init(ow_frame_matcher_t* matcher, uint16_t hci_handle)
+{
+	//The 12 constant bytes of a notification frame:
+	uint8_t expected[OW_HEADER_LENGTH] =
+	{
+		//HCI packet type:
+		HCI_ACLDATA_PKT,
+
+		//Flagged HCI handle (the flags are masked below):
+		hci_handle & 0xFF, (hci_handle >> 8) & 0x0F,
+
+		//Total length:
+		OW_SAMPLE_LENGTH - 5, 0x00,
+
+		//L2CAP length:
+		OW_SAMPLE_LENGTH - 9, 0x00,
+
+		//L2CAP destination CID:
+		OW_L2CAP_DEST_CID & 0xFF, OW_L2CAP_DEST_CID >> 8,
+
+		//ATT command:
+		OW_ATT_OPCODE_HANDLE_VALUE_NOTIFICATION,
+
+		//ATT handle:
+		OW_ATT_HANDLE & 0xFF, OW_ATT_HANDLE >> 8
+	};
+
+	//Compare everything, but the flag nibble of the handle (and the whole handle if any handle is fine):
+	uint8_t mask[OW_HEADER_LENGTH];
+	memset(mask, 0xFF, sizeof(mask));
+
+	mask[2] = 0x0F;
+
+	if (hci_handle == OW_HCI_HANDLE_ANY)
+	{
+		mask[1] = 0x00;
+		mask[2] = 0x00;
+	}
+
+	for (size_t i = 0; i < OW_HEADER_LENGTH; i++)
+	{
+		expected[i] &= mask[i];
+	}
+
+	//Load both in the same byte order as the frames:
+	matcher->expected_lo = ow_load64(&expected[0]);
+	matcher->expected_hi = ow_load32(&expected[8]);
+	matcher->mask_lo = ow_load64(&mask[0]);
+	matcher->mask_hi = ow_load32(&mask[8]);
+}
+
+static inline bool ow_frame_matches(const ow_frame_matcher_t* matcher, const uint8_t* frame)
+{
+	//Two masked compares instead of seven branches:
+	uint64_t diff_lo = (ow_load64(&frame[0]) & matcher->mask_lo) ^ matcher->expected_lo;
+	uint32_t diff_hi = (ow_load32(&frame[8]) & matcher->mask_hi) ^ matcher->expected_hi;
+
+	return (diff_lo | diff_hi) == 0;
+}
+
+void ow_decode_payload(const uint8_t* payload, ow_sample_t* sample)
+{
+	//Get the actual value and the sign bit:
+	uint16_t value_sign = ow_read_le16(&payload[4]);
+
+	//Get unit and places:
+	uint16_t unit_places = ow_read_le16(&payload[0]);
+
+	//Look up unit, current type and test modes by the 13-bit unit code:
+	ow_unit_code_info_t info = ow_unit_codes[unit_places >> 3];
+
+	sample->unit = (info.attributes & OW_UNIT_CODE_ATTR_KNOWN) ? (ow_unit_t)info.unit : OW_UNIT_UNKNOWN;
+	sample->current_type = (info.attributes & OW_UNIT_CODE_ATTR_AC) ? OW_CURRENT_TYPE_AC : OW_CURRENT_TYPE_DC;
+	sample->is_diode_test = (info.attributes & OW_UNIT_CODE_ATTR_DIODE) != 0;
+	sample->is_continuity_test = (info.attributes & OW_UNIT_CODE_ATTR_CONTINUITY) != 0;
+
+	//Keep the raw fields:
+	sample->unit_code = unit_places & OW_UNIT_CODE_MASK;
+	sample->magnitude = value_sign & OW_VALUE_MAGNITUDE_MASK;
+	sample->places = unit_places & OW_PLACES_MASK;
+	sample->is_negative = (value_sign & OW_VALUE_SIGN_BIT) != 0;
+	sample->is_overflow = (unit_places & OW_OVERFLOW_BIT) != 0;
+
+	//Use value, sign bit and decimal places to retrieve the final value:
+	//First, test for an overflow.
+	if (sample->is_overflow)
+	{
+		sample->value = NAN;
+	}
+	else
+	{
+		//Divide by the power of ten for the decimal places.
+		//Unlike multiplying with 0.1 etc., this gives the double that is closest to the displayed value (e. g. exactly 0.3 for "0.3").
+		double value = (double)sample->magnitude / ow_place_divisors[sample->places];
+
+		//Build the number using the sign bit:
+		sample->value = sample->is_negative ? -value : value;
+	}
+
+	//Get the flag byte:
+	uint8_t flags = payload[2];
+
+	//Query the flags:
+	sample->is_data_hold = (flags & OW_FLAG_DATA_HOLD) != 0;
+	sample->is_relative = (flags & OW_FLAG_RELATIVE) != 0;
+	sample->is_auto_range = (flags & OW_FLAG_AUTO_RANGE) != 0;
+	sample->is_low_battery = (flags & OW_FLAG_LOW_BATTERY) != 0;
+
+	//The receive time is up to the caller:
+	sample->timestamp.tv_sec = 0;
+	sample->timestamp.tv_nsec = 0;
+}
+
+ow_unit_t ow_unit_code_to_unit(uint16_t unit_code)
+{
+	ow_unit_code_info_t info = ow_unit_codes[unit_code >> 3];
+	return (info.attributes & OW_UNIT_CODE_ATTR_KNOWN) ? (ow_unit_t)info.unit : OW_UNIT_UNKNOWN;
+}
+
+ow_current_type_t ow_unit_code_to_current_type(uint16_t unit_code)
+{
+	return (ow_unit_codes[unit_code >> 3].attributes & OW_UNIT_CODE_ATTR_AC) ? OW_CURRENT_TYPE_AC : OW_CURRENT_TYPE_DC;
+}
+
+bool ow_unit_code_is_diode_test(uint16_t unit_code)
+{
+	return (ow_unit_codes[unit_code >> 3].attributes & OW_UNIT_CODE_ATTR_DIODE) != 0;
+}
+
+bool ow_unit_code_is_continuity_test(uint16_t unit_code)
+{
+	return (ow_unit_codes[unit_code >> 3].attributes & OW_UNIT_CODE_ATTR_CONTINUITY) != 0;
+}
+
+void ow_frame_view_decode(const ow_frame_view_t* view, ow_sample_t* sample)
+{
+	ow_decode_payload(view->payload, sample);
+	sample->timestamp = view->timestamp;
+}
+
+const char* ow_unit_to_str(ow_unit_t unit)
+{
+	return ((unsigned int)unit < OW_UNIT_UNKNOWN) ? ow_unit_strs[unit] : "Unknown";
+}
+
+const char* ow_unit_to_short_str(ow_unit_t unit)
+{
+	return ((unsigned int)unit < OW_UNIT_UNKNOWN) ? ow_unit_short_strs[unit] : "?";
+}
+
+int ow_unit_to_si_exponent(ow_unit_t unit)
+{
+	return ((unsigned int)unit < OW_UNIT_UNKNOWN) ? ow_unit_si_exponents[unit] : 0;
+}
+
+ow_unit_t ow_unit_to_base_unit(ow_unit_t unit)
+{
+	return ((unsigned int)unit < OW_UNIT_UNKNOWN) ? (ow_unit_t)ow_unit_base_units[unit] : unit;
+}
+
+double ow_unit_to_base_value(ow_unit_t unit, double value)
+{
+	const ow_unit_scale_t* scale = &ow_unit_base_scales[((unsigned int)unit < OW_UNIT_UNKNOWN) ? unit : OW_UNIT_UNKNOWN];
+
+	return value * scale->multiplier / scale->divisor;
+}
+
+ow_quantity_t ow_unit_to_quantity(ow_unit_t unit)
+{
+	return ((unsigned int)unit < OW_UNIT_UNKNOWN) ? ow_unit_quantities[unit] : OW_QUANTITY_UNKNOWN;
+}
+
+const char* ow_quantity_to_str(ow_quantity_t quantity)
+{
+	return ((unsigned int)quantity < OW_QUANTITY_UNKNOWN) ? ow_quantity_strs[quantity] : "Unknown";
+}
+
+ow_unit_t ow_quantity_to_unit(ow_quantity_t quantity)
+{
+	return ((unsigned int)quantity < OW_QUANTITY_UNKNOWN) ? ow_quantity_units[quantity] : OW_UNIT_UNKNOWN;
+}
+
+void ow_normalize(const ow_sample_t* samples, size_t count, ow_normalized_sample_t* normalized)
+{
+	for (size_t i = 0; i < count; i++)
+	{
+		//Clamp the index instead of branching (compiles to a conditional move):
+		unsigned int unit = (unsigned int)samples[i].unit;
+		unit = (unit < OW_UNIT_UNKNOWN) ? unit : OW_UNIT_UNKNOWN;
+
+		const ow_unit_scale_t* scale = &ow_unit_scales[unit];
+
+		//Relative values are differences, so the offset (of Fahrenheit) must not be applied (multiplied away instead of branching):
+		double offset = scale->offset * !samples[i].is_relative;
+
+		//NaN (overflow) stays NaN:
+		normalized[i].quantity = ow_unit_quantities[unit];
+		normalized[i].current_type = samples[i].current_type;
+		normalized[i].value = (samples[i].value + offset) * scale->multiplier / scale->divisor;
+		normalized[i].is_continuity_test = samples[i].is_continuity_test;
+		normalized[i].is_diode_test = samples[i].is_diode_test;
+		normalized[i].is_relative = samples[i].is_relative;
+		normalized[i].timestamp = samples[i].timestamp;
+	}
+}
+
+const char* ow_reject_reason_to_str(ow_reject_reason_t reason)
+{
+	return (reason < OW_REJECT_REASON_COUNT) ? ow_reject_reason_strs[reason] : "Unknown";
+}
+
+void ow_get_stats(const ow_stats_t* stats, ow_stats_t* snapshot)
+{
+	snapshot->frames_read = __atomic_load_n(&stats->frames_read, __ATOMIC_RELAXED);
+	snapshot->bytes_read = __atomic_load_n(&stats->bytes_read, __ATOMIC_RELAXED);
+
+	for (size_t i = 0; i < OW_REJECT_REASON_COUNT; i++)
+	{
+		snapshot->rejected[i] = __atomic_load_n(&stats->rejected[i], __ATOMIC_RELAXED);
+	}
+
+	snapshot->retries = __atomic_load_n(&stats->retries, __ATOMIC_RELAXED);
+	snapshot->samples = __atomic_load_n(&stats->samples, __ATOMIC_RELAXED);
+	snapshot->unknown_units = __atomic_load_n(&stats->unknown_units, __ATOMIC_RELAXED);
+	snapshot->overflows = __atomic_load_n(&stats->overflows, __ATOMIC_RELAXED);
+	snapshot->callbacks = __atomic_load_n(&stats->callbacks, __ATOMIC_RELAXED);
+	snapshot->timed_callbacks = __atomic_load_n(&stats->timed_callbacks, __ATOMIC_RELAXED);
+	snapshot->callback_ns = __atomic_load_n(&stats->callback_ns, __ATOMIC_RELAXED);
+}
+
+const char* ow_current_type_to_str(ow_current_type_t current_type)
+{
+	switch (current_type)
+	{
+	case OW_CURRENT_TYPE_DC: return "DC";
+	case OW_CURRENT_TYPE_AC: return "AC";
+
+	default: return "?";
+	}
+}
+
+static bool ow_session_connect(ow_session_t* session, const ow_config_t* config)
+{
+	//Open a socket on the configured adapter:
+	int bt_sock;
+
+	if (!ow_open_config_socket(config, &bt_sock))
+	{
+		return false;
+	}
+
+	//Query the old HCI filter to restore later:
+	int error;
+	struct hci_filter old_hci_filter;
+	socklen_t old_hci_filter_length;
+
+	if (!ow_get_hci_filter(bt_sock, &old_hci_filter, &old_hci_filter_length))
+	{
+		error = errno;
+		goto close_out;
+	}
+
+	//Do we have to scan for the multimeter's address?
+	bdaddr_t addr;
+
+	if (!ow_config_address(bt_sock, config, &old_hci_filter, old_hci_filter_length, -1, &addr))
+	{
+		error = errno;
+		goto close_out;
+	}
+
+	//Connect to the multimeter:
+	const ow_connect_params* connect_params = ow_config_connect_params(config);
+	uint16_t hci_handle;
+
+	if (!connect_params || !ow_connect(bt_sock, addr, connect_params, &hci_handle))
+	{
+		error = connect_params ? errno : EINVAL;
+		goto close_out;
+	}
+
+	//Make sure we only see asynchronous data packets:
+	if (!ow_set_async_filter(bt_sock))
+	{
+		error = errno;
+		goto disc_close_out;
+	}
+
+	//Success case:
+	session->is_connected = true;
+	session->bt_sock = bt_sock;
+	session->hci_handle = hci_handle;
+	session->old_hci_filter = old_hci_filter;
+	session->old_hci_filter_length = old_hci_filter_length;
+	session->old_fd_flags = -1;
+
+	ow_source_init_fd(&session->source, bt_sock, hci_handle);
+	session->source.stats = config->stats;
+	session->source.tap = config->tap;
+	session->source.tap_context = config->tap_context;
+
+	return true;
+
+disc_close_out:
+	//Disconnect:
+	hci_disconnect(bt_sock, hci_handle, HCI_OE_USER_ENDED_CONNECTION, 10000);
+
+close_out:
+	//Close the socket:
+	hci_close_dev(bt_sock);
+
+	errno = error;
+	return false;
+}
+
+static bool ow_recv_config(const ow_config_t* config, ow_source_run_func_t run_func, void* context)
+{
+	//Connect (blocking):
+	ow_session_t session;
+
+	if (!ow_session_connect(&session, config))
+	{
+		return false;
+	}
+
+	//Receive from the HCI socket until the user signals us to end:
+	bool success = run_func(&session.source, context);
+	int error = errno;
+
+	//Restore the filter, disconnect and close:
+	ow_session_close(&session);
+
+	if (!success)
+	{
+		errno = error;
+		return false;
+	}
+
+	return true;
+}
+
+bool ow_scan(int dev_id, const ow_scan_params* params, unsigned long deadline_ms, ow_scan_result_t* results, size_t max_results, size_t* count)
+{
+	*count = 0;
+
+	if (max_results == 0)
+	{
+		errno = EINVAL;
+		return false;
+	}
+
+	if (!params)
+	{
+		params = &automatic_scan_params;
+	}
+
+	//The deduplication table maps addresses to result indices (+ 1, so 0 marks a free slot).
+	//It is kept at most half full, so probing stays short.
+	size_t slot_count = 1;
+
+	while (slot_count < (2 * max_results))
+	{
+		slot_count <<= 1;
+	}
+
+	size_t* slots = calloc(slot_count, sizeof(size_t));
+
+	if (!slots)
+	{
+		return false;
+	}
+
+	//Open a socket on the given adapter:
+	int error = 0;
+	int bt_sock;
+
+	if ((dev_id == OW_DEV_ID_AUTOMATIC) && !ow_get_default_device_id(&dev_id))
+	{
+		error = errno;
+		goto free_out;
+	}
+
+	if (!ow_open_socket(dev_id, &bt_sock))
+	{
+		error = errno;
+		goto free_out;
+	}
+
+	//Query the old HCI filter to restore later:
+	struct hci_filter old_hci_filter;
+	socklen_t old_hci_filter_length;
+
+	if (!ow_get_hci_filter(bt_sock, &old_hci_filter, &old_hci_filter_length))
+	{
+		error = errno;
+		goto close_out;
+	}
+
+	if (!ow_scan_enable(bt_sock, params))
+	{
+		error = errno;
+		goto restore_close_out;
+	}
+
+	//Collect advertisements until the deadline:
+	struct timespec deadline;
+	struct timespec remaining;
+
+	clock_gettime(CLOCK_MONOTONIC, &deadline);
+	ow_timespec_add_ns(&deadline, (uint64_t)deadline_ms * 1000000);
+
+	while (ow_timespec_until(&deadline, &remaining))
+	{
+		struct pollfd poll_fd = { .fd = bt_sock, .events = POLLIN };
+		int ready = ppoll(&poll_fd, 1, &remaining, NULL);
+
+		if (ready < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+
+			error = errno;
+			goto disable_restore_close_out;
+		}
+
+		if (ready == 0)
+		{
+			continue;
+		}
+
+		//Read a new buffer of data:
+		uint8_t buf[HCI_MAX_EVENT_SIZE];
+		int bytes_read = read(bt_sock, buf, HCI_MAX_EVENT_SIZE);
+
+		if (bytes_read < 0)
+		{
+			if ((errno == EAGAIN) || (errno == EINTR))
+			{
+				continue;
+			}
+
+			error = errno;
+			goto disable_restore_close_out;
+		}
+
+		if (bytes_read == 0)
+		{
+			error = ENODATA;
+			goto disable_restore_close_out;
+		}
+
+		//One of ours?
+		ow_scan_ad_t ad;
+		int8_t rssi;
+		const le_advertising_info* info = ow_scan_match_report(params, buf, bytes_read, &ad, &rssi);
+
+		if (!info)
+		{
+			continue;
+		}
+
+		//Look the address up (linear probing):
+		size_t slot = ow_scan_hash_addr(&info->bdaddr) & (slot_count - 1);
+
+		while ((slots[slot] != 0) && (bacmp(&results[slots[slot] - 1].addr, &info->bdaddr) != 0))
+		{
+			slot = (slot + 1) & (slot_count - 1);
+		}
+
+		ow_scan_result_t* result;
+
+		if (slots[slot] != 0)
+		{
+			result = &results[slots[slot] - 1];
+		}
+		else
+		{
+			//A new meter, but no more space for it?
+			if (*count == max_results)
+			{
+				continue;
+			}
+
+			result = &results[*count];
+			slots[slot] = ++(*count);
+
+			result->addr = info->bdaddr;
+			result->addr_type = info->bdaddr_type;
+			result->seen_count = 0;
+		}
+
+		//Update the meter:
+		strcpy(result->name, ad.name);
+		result->rssi = rssi;
+		clock_gettime(CLOCK_MONOTONIC, &result->last_seen);
+		result->seen_count++;
+	}
+
+	//Rank the meters:
+	qsort(results, *count, sizeof(ow_scan_result_t), ow_scan_compare_results);
+
+disable_restore_close_out:
+	//Disable the LE scan:
+	hci_le_set_scan_enable(bt_sock, OW_SCAN_DISABLE, params->filter_dup ? 1 : 0, params->to);
+
+restore_close_out:
+	//Go back to the old HCI filter:
+	ow_set_hci_filter(bt_sock, &old_hci_filter, old_hci_filter_length);
+
+close_out:
+	//Close the socket:
+	hci_close_dev(bt_sock);
+
+free_out:
+	free(slots);
+
+	if (error != 0)
+	{
+		errno = error;
+		return false;
+	}
+
+	return true;
+}
+
+bool ow_recv(const ow_config_t* config, ow_sample_func_t callback, void* context)
+{
+	ow_sample_callback_context_t callback_context =
+	{
+		.callback = callback,
+		.context = context
+	};
+
+	ow_frame_loop_t loop =
+	{
+		.frame_func = ow_sample_frame,
+		.context = &callback_context
+	};
+
+	return ow_recv_config(config, ow_run_frame_loop, &loop);
+}
 
 bool ow_recv_n(const ow_config_t* config, ow_sample_t* samples, int n)
 {
-	//Initialize the context for receiving:
-	ow_recv_n_context_t context =
+	//Initialize the context for receiving:
+	ow_recv_n_context_t context =
+	{
+		.samples = samples,
+		.n = n,
+		.count = 0
+	};
+
+	//Receive using our internal sample func and the context:
+	return ow_recv(config, ow_recv_n_sample, &context);
+}
+
+bool ow_recv_source(const ow_source_t* source, ow_sample_func_t callback, void* context)
+{
+	ow_sample_callback_context_t callback_context =
+	{
+		.callback = callback,
+		.context = context
+	};
+
+	return ow_recv_frames(source, ow_sample_frame, &callback_context);
+}
+
+bool ow_recv_n_source(const ow_source_t* source, ow_sample_t* samples, int n)
+{
+	//Initialize the context for receiving:
+	ow_recv_n_context_t context =
+	{
+		.samples = samples,
+		.n = n,
+		.count = 0
+	};
+
+	//Receive using our internal sample func and the context:
+	return ow_recv_source(source, ow_recv_n_sample, &context);
+}
+
+bool ow_recv_packed(const ow_config_t* config, ow_sample_packed_func_t callback, void* context)
+{
+	ow_packed_callback_context_t callback_context =
+	{
+		.callback = callback,
+		.context = context
+	};
+
+	ow_frame_loop_t loop =
+	{
+		.frame_func = ow_packed_frame,
+		.context = &callback_context
+	};
+
+	return ow_recv_config(config, ow_run_frame_loop, &loop);
+}
+
+bool ow_recv_packed_source(const ow_source_t* source, ow_sample_packed_func_t callback, void* context)
+{
+	ow_packed_callback_context_t callback_context =
+	{
+		.callback = callback,
+		.context = context
+	};
+
+	return ow_recv_frames(source, ow_packed_frame, &callback_context);
+}
+
+bool ow_recv_view(const ow_config_t* config, ow_frame_view_func_t callback, void* context)
+{
+	ow_view_callback_context_t callback_context =
+	{
+		.callback = callback,
+		.context = context
+	};
+
+	ow_frame_loop_t loop =
+	{
+		.frame_func = ow_view_frame,
+		.context = &callback_context
+	};
+
+	return ow_recv_config(config, ow_run_frame_loop, &loop);
+}
+
+bool ow_recv_view_source(const ow_source_t* source, ow_frame_view_func_t callback, void* context)
+{
+	ow_view_callback_context_t callback_context =
+	{
+		.callback = callback,
+		.context = context
+	};
+
+	return ow_recv_frames(source, ow_view_frame, &callback_context);
+}
+
+bool ow_recv_batch(const ow_config_t* config, ow_batch_func_t callback, void* context, size_t max_batch, unsigned long max_latency_us)
+{
+	ow_batch_loop_t loop =
+	{
+		.callback = callback,
+		.context = context,
+		.max_batch = max_batch,
+		.max_latency_us = max_latency_us
+	};
+
+	return ow_recv_config(config, ow_run_batch_loop, &loop);
+}
+
+bool ow_recv_batch_source(const ow_source_t* source, ow_batch_func_t callback, void* context, size_t max_batch, unsigned long max_latency_us)
+{
+	return ow_recv_batches(source, callback, context, max_batch, max_latency_us);
+}
+
+bool ow_recv_normalized(const ow_config_t* config, ow_normalized_batch_func_t callback, void* context, size_t max_batch, unsigned long max_latency_us)
+{
+	if (max_batch == 0)
+	{
+		errno = EINVAL;
+		return false;
+	}
+
+	ow_normalized_context_t normalized_context =
+	{
+		.callback = callback,
+		.context = context,
+		.normalized = malloc(max_batch * sizeof(ow_normalized_sample_t))
+	};
+
+	if (!normalized_context.normalized)
+	{
+		return false;
+	}
+
+	bool result = ow_recv_batch(config, ow_normalized_batch, &normalized_context, max_batch, max_latency_us);
+
+	//Keep errno:
+	int error = errno;
+	free(normalized_context.normalized);
+	errno = error;
+
+	return result;
+}
+
+bool ow_recv_normalized_source(const ow_source_t* source, ow_normalized_batch_func_t callback, void* context, size_t max_batch, unsigned long max_latency_us)
+{
+	if (max_batch == 0)
+	{
+		errno = EINVAL;
+		return false;
+	}
+
+	ow_normalized_context_t normalized_context =
+	{
+		.callback = callback,
+		.context = context,
+		.normalized = malloc(max_batch * sizeof(ow_normalized_sample_t))
+	};
+
+	if (!normalized_context.normalized)
+	{
+		return false;
+	}
+
+	bool result = ow_recv_batches(source, ow_normalized_batch, &normalized_context, max_batch, max_latency_us);
+
+	//Keep errno:
+	int error = errno;
+	free(normalized_context.normalized);
+	errno = error;
+
+	return result;
+}
+
+bool ow_recv_changes(const ow_config_t* config, ow_sample_run_func_t callback, void* context, unsigned long heartbeat_ms)
+{
+	ow_change_context_t change_context =
+	{
+		.callback = callback,
+		.context = context,
+		.heartbeat_ms = heartbeat_ms,
+		.has_run = false
+	};
+
+	return ow_recv_config(config, ow_run_change_loop, &change_context);
+}
+
+bool ow_recv_changes_source(const ow_source_t* source, ow_sample_run_func_t callback, void* context, unsigned long heartbeat_ms)
+{
+	ow_change_context_t change_context =
+	{
+		.callback = callback,
+		.context = context,
+		.heartbeat_ms = heartbeat_ms,
+		.has_run = false
+	};
+
+	return ow_run_change_loop(source, &change_context);
+}
+
+static uint64_t ow_decimal_magnitude(int64_t mantissa)
+{
+	return (mantissa < 0) ? ((uint64_t)(-(mantissa + 1)) + 1) : (uint64_t)mantissa;
+}
+
+static bool ow_decimal_scale_up(uint64_t magnitude, int64_t digits, uint64_t* result)
+{
+	if (magnitude == 0)
+	{
+		*result = 0;
+		return true;
+	}
+
+	if ((digits > OW_DECIMAL_MAX_DIGITS) || (magnitude > (UINT64_MAX / ow_decimal_powers[digits])))
+	{
+		return false;
+	}
+
+	*result = magnitude * ow_decimal_powers[digits];
+	return true;
+}
+
+static int ow_decimal_compare_magnitudes(uint64_t a, int32_t a_exponent, uint64_t b, int32_t b_exponent)
+{
+	//Bring the one with the larger exponent down to the other one. If that overflows, it is the larger one.
+	uint64_t scaled;
+
+	if (a_exponent >= b_exponent)
+	{
+		if (!ow_decimal_scale_up(a, (int64_t)a_exponent - b_exponent, &scaled))
+		{
+			return 1;
+		}
+
+		return (scaled < b) ? -1 : (scaled > b) ? 1 : 0;
+	}
+
+	if (!ow_decimal_scale_up(b, (int64_t)b_exponent - a_exponent, &scaled))
+	{
+		return -1;
+	}
+
+	return (a < scaled) ? -1 : (a > scaled) ? 1 : 0;
+}
+
+static void ow_decimal_put(char* buf, size_t size, size_t* position, char c)
+{
+	if ((*position + 1) < size)
+	{
+		buf[*position] = c;
+	}
+
+	(*position)++;
+}
+
+bool ow_sample_to_decimal(const ow_sample_t* sample, ow_decimal_t* decimal)
+{
+	if (sample->is_overflow)
+	{
+		return false;
+	}
+
+	decimal->mantissa = sample->is_negative ? -(int64_t)sample->magnitude : (int64_t)sample->magnitude;
+	decimal->exponent = -(int32_t)sample->places;
+
+	return true;
+}
+
+bool ow_sample_to_si_decimal(const ow_sample_t* sample, ow_decimal_t* decimal)
+{
+	if (!ow_sample_to_decimal(sample, decimal))
+	{
+		return false;
+	}
+
+	decimal->exponent += ow_unit_to_si_exponent(sample->unit);
+	return true;
+}
+
+int ow_decimal_compare(const ow_decimal_t* a, const ow_decimal_t* b)
+{
+	//Different signs (or zeros) decide on their own:
+	int a_sign = (a->mantissa > 0) - (a->mantissa < 0);
+	int b_sign = (b->mantissa > 0) - (b->mantissa < 0);
+
+	if (a_sign != b_sign)
+	{
+		return (a_sign < b_sign) ? -1 : 1;
+	}
+
+	if (a_sign == 0)
+	{
+		return 0;
+	}
+
+	int result = ow_decimal_compare_magnitudes(ow_decimal_magnitude(a->mantissa), a->exponent, ow_decimal_magnitude(b->mantissa), b->exponent);
+	return (a_sign > 0) ? result : -result;
+}
+
+bool ow_decimal_rescale(const ow_decimal_t* decimal, int32_t exponent, int64_t* mantissa)
+{
+	uint64_t magnitude = ow_decimal_magnitude(decimal->mantissa);
+	int64_t digits = (int64_t)decimal->exponent - exponent;
+
+	if (digits >= 0)
+	{
+		//More digits: The mantissa must not overflow.
+		if (!ow_decimal_scale_up(magnitude, digits, &magnitude))
+		{
+			errno = ERANGE;
+			return false;
+		}
+	}
+	else
+	{
+		//Fewer digits: Only zeros may be dropped.
+		if ((magnitude != 0) && ((-digits > OW_DECIMAL_MAX_DIGITS) || ((magnitude % ow_decimal_powers[-digits]) != 0)))
+		{
+			errno = ERANGE;
+			return false;
+		}
+
+		magnitude = (-digits > OW_DECIMAL_MAX_DIGITS) ? 0 : (magnitude / ow_decimal_powers[-digits]);
+	}
+
+	//Back to a signed mantissa (one more for negative numbers):
+	if (decimal->mantissa < 0)
+	{
+		if (magnitude > ((uint64_t)INT64_MAX + 1))
+		{
+			errno = ERANGE;
+			return false;
+		}
+
+		*mantissa = (magnitude == ((uint64_t)INT64_MAX + 1)) ? INT64_MIN : -(int64_t)magnitude;
+	}
+	else
+	{
+		if (magnitude > (uint64_t)INT64_MAX)
+		{
+			errno = ERANGE;
+			return false;
+		}
+
+		*mantissa = (int64_t)magnitude;
+	}
+
+	return true;
+}
+
+size_t ow_decimal_format(const ow_decimal_t* decimal, char* buf, size_t size)
+{
+	//The digits of the mantissa, least significant first:
+	char digits[OW_DECIMAL_MAX_DIGITS + 1];
+	size_t digit_count = 0;
+	uint64_t magnitude = ow_decimal_magnitude(decimal->mantissa);
+
+	do
+	{
+		digits[digit_count++] = (char)('0' + (magnitude % 10));
+		magnitude /= 10;
+	} while (magnitude > 0);
+
+	size_t position = 0;
+
+	if (decimal->mantissa < 0)
+	{
+		ow_decimal_put(buf, size, &position, '-');
+	}
+
+	if (decimal->exponent >= 0)
+	{
+		//An integer, padded with zeros:
+		for (size_t i = digit_count; i > 0; i--)
+		{
+			ow_decimal_put(buf, size, &position, digits[i - 1]);
+		}
+
+		for (int32_t i = 0; i < decimal->exponent; i++)
+		{
+			ow_decimal_put(buf, size, &position, '0');
+		}
+	}
+	else
+	{
+		//Decimal places, with a leading zero if there are no integer digits:
+		uint64_t places = (uint64_t)(-(int64_t)decimal->exponent);
+
+		if (digit_count <= places)
+		{
+			ow_decimal_put(buf, size, &position, '0');
+			ow_decimal_put(buf, size, &position, '.');
+
+			for (uint64_t i = digit_count; i < places; i++)
+			{
+				ow_decimal_put(buf, size, &position, '0');
+			}
+
+			for (size_t i = digit_count; i > 0; i--)
+			{
+				ow_decimal_put(buf, size, &position, digits[i - 1]);
+			}
+		}
+		else
+		{
+			for (size_t i = digit_count; i > 0; i--)
+			{
+				ow_decimal_put(buf, size, &position, digits[i - 1]);
+
+				if ((i - 1) == places)
+				{
+					ow_decimal_put(buf, size, &position, '.');
+				}
+			}
+		}
+	}
+
+	//Terminate (truncated if necessary):
+	if (size > 0)
+	{
+		buf[(position < size) ? position : (size - 1)] = '\0';
+	}
+
+	return position;
+}
+
+void ow_sample_pack(const ow_sample_t* sample, ow_sample_packed_t* packed)
+{
+	packed->unit_places = (sample->unit_code & OW_UNIT_CODE_MASK) | (sample->is_overflow ? OW_OVERFLOW_BIT : 0) | (sample->places & OW_PLACES_MASK);
+	packed->value_sign = (sample->magnitude & OW_VALUE_MAGNITUDE_MASK) | (sample->is_negative ? OW_VALUE_SIGN_BIT : 0);
+	packed->flags = (sample->is_data_hold ? OW_FLAG_DATA_HOLD : 0) | (sample->is_relative ? OW_FLAG_RELATIVE : 0) | (sample->is_auto_range ? OW_FLAG_AUTO_RANGE : 0) | (sample->is_low_battery ? OW_FLAG_LOW_BATTERY : 0);
+	memset(packed->reserved, 0, sizeof(packed->reserved));
+}
+
+void ow_sample_unpack(const ow_sample_packed_t* packed, ow_sample_t* sample)
+{
+	//Rebuild the payload and run it through the regular decoder:
+	uint8_t payload[OW_PAYLOAD_LENGTH] =
+	{
+		packed->unit_places & 0xFF, packed->unit_places >> 8,
+		packed->flags,
+		0x00,
+		packed->value_sign & 0xFF, packed->value_sign >> 8
+	};
+
+	ow_decode_payload(payload, sample);
+}
+
+void ow_source_init_fd(ow_source_t* source, int fd, uint16_t hci_handle)
+{
+	ow_enable_timestamps(fd);
+
+	source->read = ow_fd_source_read;
+	source->read_many = ow_fd_source_read_many;
+	source->context = (void*)(intptr_t)fd;
+	source->fd = fd;
+	source->hci_handle = hci_handle;
+	source->stats = NULL;
+	source->tap = NULL;
+	source->tap_context = NULL;
+}
+
+bool ow_replay_init(ow_replay_t* replay, int fd, ow_replay_format_t format, ow_replay_pacing_t pacing, int cancel_fd, uint16_t hci_handle, ow_source_t* source)
+{
+	//Only btsnoop captures carry timestamps to pace by:
+	if ((format != OW_REPLAY_FORMAT_DATAGRAM) && (format != OW_REPLAY_FORMAT_BTSNOOP))
+	{
+		errno = EINVAL;
+		return false;
+	}
+
+	if ((pacing == OW_REPLAY_PACING_RECORDED) && (format != OW_REPLAY_FORMAT_BTSNOOP))
+	{
+		errno = EINVAL;
+		return false;
+	}
+
+	//Validate the btsnoop file header:
+	if (format == OW_REPLAY_FORMAT_BTSNOOP)
+	{
+		uint8_t header[OW_BTSNOOP_HEADER_LENGTH];
+
+		if (!ow_read_full(fd, cancel_fd, header, sizeof(header)))
+		{
+			if (errno == 0)
+			{
+				errno = EPROTO;
+			}
+
+			return false;
+		}
+
+		if ((memcmp(header, OW_BTSNOOP_MAGIC, sizeof(OW_BTSNOOP_MAGIC)) != 0) || (ow_read_be32(&header[8]) != OW_BTSNOOP_VERSION) || (ow_read_be32(&header[12]) != OW_BTSNOOP_DATALINK_H4))
+		{
+			errno = EPROTO;
+			return false;
+		}
+	}
+
+	//Initialize the replay state:
+	replay->fd = fd;
+	replay->format = format;
+	replay->pacing = pacing;
+	replay->cancel_fd = cancel_fd;
+	replay->has_origin = false;
+
+	//Datagrams get their receive time from the kernel, btsnoop records have their own:
+	if (format == OW_REPLAY_FORMAT_DATAGRAM)
+	{
+		ow_enable_timestamps(fd);
+	}
+
+	//Hook it up as frame source:
+	//Datagram replays can be polled (unless they wait for the cancel descriptor themselves), btsnoop records have to be read in one go:
+	source->read = ow_replay_source_read;
+	source->read_many = NULL;
+	source->context = replay;
+	source->fd = ((format == OW_REPLAY_FORMAT_DATAGRAM) && (cancel_fd < 0)) ? fd : -1;
+	source->hci_handle = hci_handle;
+	source->stats = NULL;
+	source->tap = NULL;
+	source->tap_context = NULL;
+
+	return true;
+}
+
+bool ow_decode_frame(const uint8_t* frame, size_t length, uint16_t hci_handle, ow_sample_t* sample)
+{
+	//Validate length and header:
+	if (length != OW_SAMPLE_LENGTH)
+	{
+		return false;
+	}
+
+	ow_frame_matcher_t matcher;
+	ow_frame_matcher_init(&matcher, hci_handle);
+
+	if (!ow_frame_matches(&matcher, frame))
+	{
+		return false;
+	}
+
+	ow_decode_payload(&frame[OW_PAYLOAD_OFFSET], sample);
+	return true;
+}
+
+size_t ow_decode_frames(const uint8_t* frames, size_t count, uint16_t hci_handle, ow_sample_t* out, size_t* rejected)
+{
+	ow_frame_matcher_t matcher;
+	ow_frame_matcher_init(&matcher, hci_handle);
+
+	//Decode every frame into the next free slot, but only advance on a match.
+	//This keeps the loop free of data-dependent branches.
+	size_t accepted = 0;
+
+	for (size_t i = 0; i < count; i++)
+	{
+		const uint8_t* frame = &frames[i * OW_SAMPLE_LENGTH];
+
+		ow_decode_payload(&frame[OW_PAYLOAD_OFFSET], &out[accepted]);
+		accepted += ow_frame_matches(&matcher, frame);
+	}
+
+	if (rejected)
+	{
+		*rejected = count - accepted;
+	}
+
+	return accepted;
+}
+
+bool ow_session_open(ow_session_t* session, const ow_config_t* config)
+{
+	if (!ow_session_connect(session, config))
+	{
+		return false;
+	}
+
+	//Switch the socket to non-blocking mode:
+	int flags = fcntl(session->bt_sock, F_GETFL);
+
+	if ((flags < 0) || (fcntl(session->bt_sock, F_SETFL, flags | O_NONBLOCK) < 0))
+	{
+		int error = errno;
+		ow_session_close(session);
+
+		errno = error;
+		return false;
+	}
+
+	return true;
+}
+
+bool ow_session_open_source(ow_session_t* session, const ow_source_t* source)
+{
+	session->is_connected = false;
+	session->source = *source;
+	session->old_fd_flags = -1;
+
+	//Switch a pollable source to non-blocking mode (restored on close):
+	if (source->fd >= 0)
+	{
+		int flags = fcntl(source->fd, F_GETFL);
+
+		if ((flags < 0) || (fcntl(source->fd, F_SETFL, flags | O_NONBLOCK) < 0))
+		{
+			return false;
+		}
+
+		session->old_fd_flags = flags;
+	}
+
+	return true;
+}
+
+int ow_session_fd(const ow_session_t* session)
+{
+	return session->source.fd;
+}
+
+bool ow_session_process(ow_session_t* session, ow_sample_t* samples, size_t max_samples, size_t* count)
+{
+	//Prepare the header template for the HCI handle:
+	ow_frame_matcher_t matcher;
+	ow_frame_matcher_init(&matcher, session->source.hci_handle);
+
+	ow_stats_t* stats = session->source.stats;
+
+	//Decode whatever is ready (without blocking) until the samples are full:
+	*count = 0;
+
+	while (*count < max_samples)
+	{
+		uint8_t bufs[OW_BATCH_READ_COUNT][HCI_MAX_EVENT_SIZE];
+		size_t lengths[OW_BATCH_READ_COUNT];
+		struct timespec timestamps[OW_BATCH_READ_COUNT];
+		size_t wanted = max_samples - *count;
+
+		int frames = ow_source_read_frames(&session->source, bufs, (wanted < OW_BATCH_READ_COUNT) ? wanted : OW_BATCH_READ_COUNT, lengths, timestamps);
+
+		//Error case?
+		if (frames < 0)
+		{
+			//Nothing more ready:
+			if ((errno == EAGAIN) || (errno == EINTR))
+			{
+				if (stats && (errno == EINTR))
+				{
+					OW_STATS_ADD(stats, retries, 1);
+				}
+
+				return true;
+			}
+
+			//Fatal cases (deliver what we have first):
+			return (*count > 0);
+		}
+
+		for (int i = 0; i < frames; i++)
+		{
+			//EoF case? Deliver what we have first, the next call reports it.
+			if (lengths[i] == 0)
+			{
+				if (*count > 0)
+				{
+					return true;
+				}
+
+				errno = ENODATA;
+				return false;
+			}
+
+			if (session->source.tap)
+			{
+				session->source.tap(bufs[i], lengths[i], &timestamps[i], session->source.tap_context);
+			}
+
+			bool is_valid = ow_frame_is_valid(&matcher, bufs[i], lengths[i]);
+
+			if (stats)
+			{
+				ow_stats_count_frame(stats, &matcher, bufs[i], lengths[i], is_valid);
+			}
+
+			if (is_valid)
+			{
+				ow_decode_payload(&bufs[i][OW_PAYLOAD_OFFSET], &samples[*count]);
+				samples[(*count)++].timestamp = timestamps[i];
+			}
+		}
+
+		//Sources that can't be polled get one read per call:
+		if (session->source.fd < 0)
+		{
+			break;
+		}
+	}
+
+	return true;
+}
+
+void ow_session_close(ow_session_t* session)
+{
+	//Restore the descriptor flags of a source:
+	if (session->old_fd_flags >= 0)
+	{
+		fcntl(session->source.fd, F_SETFL, session->old_fd_flags);
+	}
+
+	if (!session->is_connected)
+	{
+		return;
+	}
+
+	//Restore the old HCI filter:
+	ow_set_hci_filter(session->bt_sock, &session->old_hci_filter, session->old_hci_filter_length);
+
+	//Disconnect:
+	hci_disconnect(session->bt_sock, session->hci_handle, HCI_OE_USER_ENDED_CONNECTION, 10000);
+
+	//Close the socket:
+	hci_close_dev(session->bt_sock);
+
+	session->is_connected = false;
+}
+
+bool ow_recv_multi(const ow_config_t* config, ow_multi_device_t* devices, size_t count)
+{
+	//Open a socket on the configured adapter:
+	int bt_sock;
+
+	if (!ow_open_config_socket(config, &bt_sock))
 	{
-		.samples = samples,
-		.n = n,
-		.count = 0
+		return false;
+	}
+
+	//Query the old HCI filter to restore later:
+	int error;
+	struct hci_filter old_hci_filter;
+	socklen_t old_hci_filter_length;
+
+	if (!ow_get_hci_filter(bt_sock, &old_hci_filter, &old_hci_filter_length))
+	{
+		error = errno;
+		goto close_out;
+	}
+
+	//Connect to all multimeters:
+	const ow_connect_params* connect_params = ow_config_connect_params(config);
+	size_t connected = 0;
+
+	if (!connect_params)
+	{
+		error = EINVAL;
+		goto close_out;
+	}
+
+	for (; connected < count; connected++)
+	{
+		if (!ow_connect(bt_sock, devices[connected].addr, connect_params, &devices[connected].hci_handle))
+		{
+			error = errno;
+			goto disc_close_out;
+		}
+	}
+
+	//Make sure we only see asynchronous data packets:
+	if (!ow_set_async_filter(bt_sock))
+	{
+		error = errno;
+		goto disc_close_out;
+	}
+
+	//Receive from the HCI socket until all callbacks are done:
+	ow_source_t source;
+	ow_source_init_fd(&source, bt_sock, OW_HCI_HANDLE_ANY);
+	source.stats = config->stats;
+	source.tap = config->tap;
+	source.tap_context = config->tap_context;
+
+	if (!ow_recv_multi_source(&source, devices, count))
+	{
+		error = errno;
+		goto restore_disc_close_out;
+	}
+
+	//Success case:
+	error = 0;
+
+restore_disc_close_out:
+	//Restore the old HCI filter:
+	ow_set_hci_filter(bt_sock, &old_hci_filter, old_hci_filter_length);
+
+disc_close_out:
+	//Disconnect everything we have connected:
+	for (size_t i = 0; i < connected; i++)
+	{
+		hci_disconnect(bt_sock, devices[i].hci_handle, HCI_OE_USER_ENDED_CONNECTION, 10000);
+	}
+
+close_out:
+	//Close the socket:
+	hci_close_dev(bt_sock);
+
+	if (error == 0)
+	{
+		return true;
+	}
+	else
+	{
+		errno = error;
+		return false;
+	}
+}
+
+bool ow_recv_multi_source(const ow_source_t* source, ow_multi_device_t* devices, size_t count)
+{
+	//Every device starts out active:
+	for (size_t i = 0; i < count; i++)
+	{
+		devices[i].is_done = false;
+	}
+
+	if (count == 0)
+	{
+		return true;
+	}
+
+	ow_multi_context_t multi_context =
+	{
+		.devices = devices,
+		.count = count,
+		.active = count
 	};
 
-	//Receive using our internal sample func and the context:
-	return ow_recv(config, ow_recv_n_sample, &context);
+	//Validate the headers once for all devices, then demultiplex by handle:
+	ow_source_t any_source = *source;
+	any_source.hci_handle = OW_HCI_HANDLE_ANY;
+
+	return ow_recv_frames(&any_source, ow_multi_frame, &multi_context);
+}
+
+static bool ow_persistent_read_cache(const ow_persistent_t* persistent, bdaddr_t* addr)
+{
+	if (!persistent->params.cache_path)
+	{
+		return false;
+	}
+
+	FILE* file = fopen(persistent->params.cache_path, "r");
+
+	if (!file)
+	{
+		return false;
+	}
+
+	//A single line with the address:
+	char line[OW_CACHE_LINE_LENGTH + 1];
+	bool success = fgets(line, sizeof(line), file) && (strlen(line) >= OW_ADDR_STR_LENGTH);
+
+	fclose(file);
+
+	if (success)
+	{
+		line[OW_ADDR_STR_LENGTH] = '\0';
+		success = (str2ba(line, addr) == 0);
+	}
+
+	return success;
+}
+
+static void ow_persistent_write_cache(const ow_persistent_t* persistent, bdaddr_t addr)
+{
+	if (!persistent->params.cache_path)
+	{
+		return;
+	}
+
+	//Write to a temporary file first and rename it, so readers never see half a cache:
+	char tmp_path[PATH_MAX];
+
+	if (snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", persistent->params.cache_path) >= (int)sizeof(tmp_path))
+	{
+		return;
+	}
+
+	FILE* file = fopen(tmp_path, "w");
+
+	if (!file)
+	{
+		return;
+	}
+
+	char addr_str[OW_ADDR_STR_LENGTH + 1];
+	ba2str(&addr, addr_str);
+
+	bool success = (fprintf(file, "%s\n", addr_str) > 0);
+	success = (fclose(file) == 0) && success;
+
+	if (!success || (rename(tmp_path, persistent->params.cache_path) != 0))
+	{
+		unlink(tmp_path);
+	}
+}
+
+static bool ow_persistent_reconnect(ow_persistent_t* persistent)
+{
+	const ow_connect_params* connect_params = ow_config_connect_params(&persistent->config);
+
+	if (!connect_params)
+	{
+		errno = EINVAL;
+		return false;
+	}
+
+	unsigned int backoff_ms = persistent->params.min_backoff_ms;
+
+	for (unsigned int attempt = 1;; attempt++)
+	{
+		if (ow_connect(persistent->bt_sock, persistent->addr, connect_params, &persistent->hci_handle))
+		{
+			persistent->is_connected = true;
+			return true;
+		}
+
+		//Give up?
+		if ((persistent->params.max_attempts != 0) && (attempt >= persistent->params.max_attempts))
+		{
+			return false;
+		}
+
+		//Wait a bit longer every time (polling a negative descriptor just sleeps):
+		struct timespec deadline;
+		struct timespec remaining;
+
+		clock_gettime(CLOCK_MONOTONIC, &deadline);
+		ow_timespec_add_ns(&deadline, (uint64_t)backoff_ms * 1000000);
+
+		while (ow_timespec_until(&deadline, &remaining))
+		{
+			struct pollfd poll_fd = { .fd = persistent->params.cancel_fd, .events = POLLIN };
+			int result = ppoll(&poll_fd, 1, &remaining, NULL);
+
+			if ((result < 0) && (errno != EINTR))
+			{
+				return false;
+			}
+
+			if (result > 0)
+			{
+				errno = ECANCELED;
+				return false;
+			}
+		}
+
+		backoff_ms = ((backoff_ms * 2) < persistent->params.max_backoff_ms) ? (backoff_ms * 2) : persistent->params.max_backoff_ms;
+	}
+}
+
+static int ow_persistent_source_read(void* context, uint8_t* buf, size_t length, struct timespec* timestamp)
+{
+	ow_persistent_t* persistent = context;
+
+	while (1)
+	{
+		//With a cancel descriptor, wait for it and the socket here (the source can't be polled then):
+		if (persistent->params.cancel_fd >= 0)
+		{
+			struct pollfd poll_fds[2] =
+			{
+				{ .fd = persistent->bt_sock, .events = POLLIN },
+				{ .fd = persistent->params.cancel_fd, .events = POLLIN }
+			};
+
+			//EINTR goes to the receive loop:
+			if (poll(poll_fds, 2, -1) < 0)
+			{
+				return -1;
+			}
+
+			if (poll_fds[1].revents)
+			{
+				errno = ECANCELED;
+				return -1;
+			}
+		}
+
+		int bytes_read = ow_read_timestamped(persistent->bt_sock, buf, length, timestamp);
+
+		//Errors, EoF and EAGAIN go to the receive loop:
+		if (bytes_read <= 0)
+		{
+			return bytes_read;
+		}
+
+		//Has our connection been terminated (e. g. by a supervision timeout)?
+		if (((size_t)bytes_read >= OW_DISCONN_COMPLETE_LENGTH) && (buf[0] == HCI_EVENT_PKT) && (buf[1] == EVT_DISCONN_COMPLETE) && ((ow_read_le16(&buf[4]) & 0x0FFF) == persistent->hci_handle))
+		{
+			persistent->is_connected = false;
+
+			if (!ow_persistent_reconnect(persistent))
+			{
+				return -1;
+			}
+
+			persistent->reconnects++;
+			continue;
+		}
+
+		//Only pass on data of the current connection:
+		if ((bytes_read >= 3) && (buf[0] == HCI_ACLDATA_PKT) && ((ow_read_le16(&buf[1]) & 0x0FFF) == persistent->hci_handle))
+		{
+			return bytes_read;
+		}
+	}
+}
+
+bool ow_persistent_open(ow_persistent_t* persistent, const ow_config_t* config, const ow_persist_params* params, ow_source_t* source)
+{
+	persistent->config = *config;
+	persistent->params = params ? *params : automatic_persist_params;
+	persistent->is_connected = false;
+	persistent->reconnects = 0;
+
+	if ((persistent->params.min_backoff_ms == 0) || (persistent->params.max_backoff_ms < persistent->params.min_backoff_ms))
+	{
+		errno = EINVAL;
+		return false;
+	}
+
+	const ow_connect_params* connect_params = ow_config_connect_params(config);
+
+	if (!connect_params)
+	{
+		errno = EINVAL;
+		return false;
+	}
+
+	//Open a socket on the configured adapter:
+	if (!ow_open_config_socket(config, &persistent->bt_sock))
+	{
+		return false;
+	}
+
+	//Query the old HCI filter to restore later:
+	int error;
+
+	if (!ow_get_hci_filter(persistent->bt_sock, &persistent->old_hci_filter, &persistent->old_hci_filter_length))
+	{
+		error = errno;
+		goto close_out;
+	}
+
+	//Try the cached address first (it only matters if we would have to scan otherwise):
+	bool is_connected = false;
+
+	if ((config->scan_mode != OW_SCAN_MODE_NONE) && ow_persistent_read_cache(persistent, &persistent->addr))
+	{
+		is_connected = ow_connect(persistent->bt_sock, persistent->addr, connect_params, &persistent->hci_handle);
+	}
+
+	//No (working) cache? Resolve the address the usual way and remember it:
+	if (!is_connected)
+	{
+		if (!ow_config_address(persistent->bt_sock, config, &persistent->old_hci_filter, persistent->old_hci_filter_length, persistent->params.cancel_fd, &persistent->addr))
+		{
+			error = errno;
+			goto close_out;
+		}
+
+		if (!ow_connect(persistent->bt_sock, persistent->addr, connect_params, &persistent->hci_handle))
+		{
+			error = errno;
+			goto close_out;
+		}
+
+		if (config->scan_mode != OW_SCAN_MODE_NONE)
+		{
+			ow_persistent_write_cache(persistent, persistent->addr);
+		}
+	}
+
+	persistent->is_connected = true;
+	ow_enable_timestamps(persistent->bt_sock);
+
+	//We want to see asynchronous data packets and the termination of our connection:
+	struct hci_filter filter;
+
+	hci_filter_clear(&filter);
+	hci_filter_set_ptype(HCI_ACLDATA_PKT, &filter);
+	hci_filter_set_ptype(HCI_EVENT_PKT, &filter);
+	hci_filter_set_event(EVT_DISCONN_COMPLETE, &filter);
+
+	if (!ow_set_hci_filter(persistent->bt_sock, &filter, sizeof(struct hci_filter)))
+	{
+		error = errno;
+		goto disc_close_out;
+	}
+
+	//The read func filters by the current connection itself, because reconnects change the handle:
+	source->read = ow_persistent_source_read;
+	source->read_many = NULL;
+	source->context = persistent;
+	source->fd = (persistent->params.cancel_fd >= 0) ? -1 : persistent->bt_sock;
+	source->hci_handle = OW_HCI_HANDLE_ANY;
+	source->stats = config->stats;
+	source->tap = config->tap;
+	source->tap_context = config->tap_context;
+
+	return true;
+
+disc_close_out:
+	//Disconnect:
+	hci_disconnect(persistent->bt_sock, persistent->hci_handle, HCI_OE_USER_ENDED_CONNECTION, 10000);
+
+close_out:
+	//Close the socket:
+	hci_close_dev(persistent->bt_sock);
+
+	errno = error;
+	return false;
+}
+
+void ow_persistent_close(ow_persistent_t* persistent)
+{
+	//Restore the old HCI filter:
+	ow_set_hci_filter(persistent->bt_sock, &persistent->old_hci_filter, persistent->old_hci_filter_length);
+
+	//Disconnect (if a reconnect has failed, there is nothing to disconnect):
+	if (persistent->is_connected)
+	{
+		hci_disconnect(persistent->bt_sock, persistent->hci_handle, HCI_OE_USER_ENDED_CONNECTION, 10000);
+	}
+
+	//Close the socket:
+	hci_close_dev(persistent->bt_sock);
 }
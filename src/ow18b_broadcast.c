@@ -0,0 +1,210 @@
+#include "ow18b_broadcast.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <errno.h>
+
+//Keep the publisher's state apart from the fixed fields:
+#define OW_BROADCAST_CACHE_LINE_SIZE 64
+
+//A slot of the ring.
+//The sequence works like a seqlock: It is "2 * position + 1" while the sample for a position is written and "2 * position + 2" afterwards.
+//Readers compare it before and after copying the sample, so they notice if the publisher has lapped them.
+typedef struct __ow_broadcast_slot_t__
+{
+	uint64_t sequence;
+	ow_sample_t sample;
+} ow_broadcast_slot_t;
+
+struct __ow_broadcast_t__
+{
+	//Written by the publisher only (the position of the next sample):
+	uint64_t head __attribute__((aligned(OW_BROADCAST_CACHE_LINE_SIZE)));
+
+	//Set once by "ow_broadcast_stop(...)":
+	bool shall_stop;
+
+	//Fixed after creation:
+	ow_broadcast_slot_t* slots __attribute__((aligned(OW_BROADCAST_CACHE_LINE_SIZE)));
+	size_t capacity;
+	size_t mask;
+};
+
+//The sequence of a slot once the sample at "position" is complete:
+static inline uint64_t ow_broadcast_sequence(uint64_t position);
+
+//Where a subscriber continues after it has fallen behind by more than the capacity.
+//Resuming at the oldest slot would put it right where the publisher writes next, so it would be lapped again and again.
+//Instead, it skips to the newer half of the ring.
+static inline uint64_t ow_broadcast_resume_position(const ow_broadcast_t* broadcast, uint64_t head);
+
+static inline uint64_t ow_broadcast_sequence(uint64_t position)
+{
+	return 2 * position + 2;
+}
+
+static inline uint64_t ow_broadcast_resume_position(const ow_broadcast_t* broadcast, uint64_t head)
+{
+	return head - (broadcast->capacity / 2);
+}
+
+ow_broadcast_t* ow_broadcast_create(size_t capacity)
+{
+	if (capacity == 0)
+	{
+		errno = EINVAL;
+		return NULL;
+	}
+
+	//Round the capacity up to a power of two, so wrapping is a mask:
+	size_t rounded_capacity = 1;
+
+	while (rounded_capacity < capacity)
+	{
+		rounded_capacity <<= 1;
+	}
+
+	//The struct is cache line aligned:
+	ow_broadcast_t* broadcast;
+	int error = posix_memalign((void**)&broadcast, OW_BROADCAST_CACHE_LINE_SIZE, sizeof(ow_broadcast_t));
+
+	if (error != 0)
+	{
+		errno = error;
+		return NULL;
+	}
+
+	memset(broadcast, 0, sizeof(ow_broadcast_t));
+
+	broadcast->capacity = rounded_capacity;
+	broadcast->mask = rounded_capacity - 1;
+
+	//A zero sequence matches no position, so empty slots are never read:
+	broadcast->slots = calloc(rounded_capacity, sizeof(ow_broadcast_slot_t));
+
+	if (!broadcast->slots)
+	{
+		free(broadcast);
+		return NULL;
+	}
+
+	return broadcast;
+}
+
+void ow_broadcast_publish(ow_broadcast_t* broadcast, const ow_sample_t* samples, size_t count)
+{
+	uint64_t head = broadcast->head;
+
+	for (size_t i = 0; i < count; i++)
+	{
+		ow_broadcast_slot_t* slot = &broadcast->slots[head & broadcast->mask];
+
+		//Mark the slot as being written before touching the sample.
+		//A reader that sees the mark also sees the head that has lapped it.
+		__atomic_store_n(&slot->sequence, ow_broadcast_sequence(head) - 1, __ATOMIC_RELEASE);
+		__atomic_thread_fence(__ATOMIC_RELEASE);
+
+		slot->sample = samples[i];
+
+		__atomic_store_n(&slot->sequence, ow_broadcast_sequence(head), __ATOMIC_RELEASE);
+
+		//Every sample is visible right away, so a lapped reader knows where the publisher is:
+		head++;
+		__atomic_store_n(&broadcast->head, head, __ATOMIC_RELEASE);
+	}
+}
+
+bool ow_broadcast_sample_func(ow_sample_t sample, void* context)
+{
+	return ow_broadcast_batch_func(&sample, 1, context);
+}
+
+bool ow_broadcast_batch_func(const ow_sample_t* samples, size_t count, void* context)
+{
+	ow_broadcast_t* broadcast = context;
+
+	if (__atomic_load_n(&broadcast->shall_stop, __ATOMIC_ACQUIRE))
+	{
+		return false;
+	}
+
+	ow_broadcast_publish(broadcast, samples, count);
+	return true;
+}
+
+void ow_broadcast_stop(ow_broadcast_t* broadcast)
+{
+	__atomic_store_n(&broadcast->shall_stop, true, __ATOMIC_RELEASE);
+}
+
+void ow_broadcast_get_stats(const ow_broadcast_t* broadcast, ow_broadcast_stats_t* stats)
+{
+	stats->capacity = broadcast->capacity;
+	stats->published = __atomic_load_n(&broadcast->head, __ATOMIC_ACQUIRE);
+}
+
+void ow_broadcast_destroy(ow_broadcast_t* broadcast)
+{
+	free(broadcast->slots);
+	free(broadcast);
+}
+
+void ow_broadcast_subscribe(ow_broadcast_t* broadcast, ow_subscriber_t* subscriber)
+{
+	subscriber->broadcast = broadcast;
+	subscriber->position = __atomic_load_n(&broadcast->head, __ATOMIC_ACQUIRE);
+	subscriber->received = 0;
+	subscriber->dropped = 0;
+}
+
+size_t ow_subscriber_poll(ow_subscriber_t* subscriber, ow_sample_t* samples, size_t max_samples)
+{
+	ow_broadcast_t* broadcast = subscriber->broadcast;
+	uint64_t head = __atomic_load_n(&broadcast->head, __ATOMIC_ACQUIRE);
+	uint64_t position = subscriber->position;
+	size_t count = 0;
+
+	//Too far behind? Older samples have been overwritten already.
+	if ((head - position) > broadcast->capacity)
+	{
+		uint64_t resume = ow_broadcast_resume_position(broadcast, head);
+
+		subscriber->dropped += resume - position;
+		position = resume;
+	}
+
+	while ((count < max_samples) && (position != head))
+	{
+		const ow_broadcast_slot_t* slot = &broadcast->slots[position & broadcast->mask];
+		uint64_t sequence = ow_broadcast_sequence(position);
+
+		if (__atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE) == sequence)
+		{
+			samples[count] = slot->sample;
+
+			//Has the publisher started to overwrite the slot while we were copying?
+			__atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+			if (__atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE) == sequence)
+			{
+				count++;
+				position++;
+
+				continue;
+			}
+		}
+
+		//We have been lapped:
+		head = __atomic_load_n(&broadcast->head, __ATOMIC_ACQUIRE);
+
+		uint64_t resume = ow_broadcast_resume_position(broadcast, head);
+		subscriber->dropped += resume - position;
+		position = resume;
+	}
+
+	subscriber->position = position;
+	subscriber->received += count;
+
+	return count;
+}
@@ -0,0 +1,20 @@
+#ifndef __OW18B_BTSNOOP_H__
+#define __OW18B_BTSNOOP_H__
+
+//Internal: The btsnoop file format, shared by the replay reader and the capture writer.
+
+//btsnoop file format (big-endian, see RFC 1761 for the record layout):
+#define OW_BTSNOOP_MAGIC "btsnoop"
+#define OW_BTSNOOP_HEADER_LENGTH 16
+#define OW_BTSNOOP_RECORD_HEADER_LENGTH 24
+#define OW_BTSNOOP_VERSION 1
+#define OW_BTSNOOP_DATALINK_H4 1002
+
+//Record flags (received resp. a command or event rather than data):
+#define OW_BTSNOOP_FLAG_RECEIVED 0x01
+#define OW_BTSNOOP_FLAG_COMMAND_EVENT 0x02
+
+//btsnoop timestamps count microseconds since midnight, January 1st, 0 AD:
+#define OW_BTSNOOP_EPOCH_OFFSET_US 0x00E03AB44A676000ULL
+
+#endif
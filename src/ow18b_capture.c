@@ -0,0 +1,334 @@
+#include "ow18b_capture.h"
+#include "ow18b_btsnoop.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include <sys/eventfd.h>
+
+//Keep producer and writer state on separate cache lines:
+#define OW_CAPTURE_CACHE_LINE_SIZE 64
+
+//How often the writer thread looks for new frames:
+#define OW_CAPTURE_FLUSH_INTERVAL_MS 20
+
+//The H4 packet type of events (which are marked as such in the record flags):
+#define OW_CAPTURE_PACKET_TYPE_EVENT 0x04
+
+struct __ow_capture_t__
+{
+	//Written by the receive loop only:
+	size_t head __attribute__((aligned(OW_CAPTURE_CACHE_LINE_SIZE)));
+	size_t cached_tail;
+	uint64_t frames;
+	uint64_t dropped;
+
+	//Written by the writer thread only:
+	size_t tail __attribute__((aligned(OW_CAPTURE_CACHE_LINE_SIZE)));
+	uint64_t bytes_written;
+	int error;
+
+	//Fixed after open:
+	uint8_t* ring __attribute__((aligned(OW_CAPTURE_CACHE_LINE_SIZE)));
+	size_t capacity;
+	size_t mask;
+
+	//The file, the writer thread and an eventfd to wake it up for stopping:
+	int fd;
+	pthread_t thread;
+	int wake_fd;
+	bool shall_stop;
+};
+
+//Encode big-endian integers into a byte buffer:
+static void ow_capture_write_be32(uint8_t* buf, uint32_t value);
+static void ow_capture_write_be64(uint8_t* buf, uint64_t value);
+
+//Write the whole buffer (retries on short writes and EINTR).
+//Sets errno on error.
+static bool ow_capture_write_full(int fd, const uint8_t* buf, size_t length);
+
+//Copy bytes into the ring at the given position (wrapping around):
+static void ow_capture_put(ow_capture_t* capture, size_t position, const uint8_t* buf, size_t length);
+
+//Write everything that is queued to the file:
+static void ow_capture_drain(ow_capture_t* capture);
+
+//The writer thread:
+static void* ow_capture_run(void* context);
+
+static void ow_capture_write_be32(uint8_t* buf, uint32_t value)
+{
+	for (int i = 0; i < 4; i++)
+	{
+		buf[i] = (uint8_t)(value >> (24 - 8 * i));
+	}
+}
+
+static void ow_capture_write_be64(uint8_t* buf, uint64_t value)
+{
+	ow_capture_write_be32(buf, (uint32_t)(value >> 32));
+	ow_capture_write_be32(&buf[4], (uint32_t)value);
+}
+
+static bool ow_capture_write_full(int fd, const uint8_t* buf, size_t length)
+{
+	while (length > 0)
+	{
+		ssize_t bytes_written = write(fd, buf, length);
+
+		if (bytes_written < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+
+			return false;
+		}
+
+		buf += bytes_written;
+		length -= (size_t)bytes_written;
+	}
+
+	return true;
+}
+
+static void ow_capture_put(ow_capture_t* capture, size_t position, const uint8_t* buf, size_t length)
+{
+	size_t offset = position & capture->mask;
+	size_t first_length = capture->capacity - offset;
+
+	if (first_length > length)
+	{
+		first_length = length;
+	}
+
+	memcpy(&capture->ring[offset], buf, first_length);
+	memcpy(capture->ring, &buf[first_length], length - first_length);
+}
+
+static void ow_capture_drain(ow_capture_t* capture)
+{
+	size_t head = __atomic_load_n(&capture->head, __ATOMIC_ACQUIRE);
+	size_t tail = capture->tail;
+
+	while (tail != head)
+	{
+		//Up to the end of the ring at once:
+		size_t offset = tail & capture->mask;
+		size_t length = head - tail;
+
+		if (length > (capture->capacity - offset))
+		{
+			length = capture->capacity - offset;
+		}
+
+		//After an error, frames are still taken out of the ring, so the receive loop doesn't notice:
+		if (capture->error == 0)
+		{
+			if (ow_capture_write_full(capture->fd, &capture->ring[offset], length))
+			{
+				__atomic_store_n(&capture->bytes_written, capture->bytes_written + length, __ATOMIC_RELAXED);
+			}
+			else
+			{
+				__atomic_store_n(&capture->error, errno, __ATOMIC_RELAXED);
+			}
+		}
+
+		tail += length;
+		__atomic_store_n(&capture->tail, tail, __ATOMIC_RELEASE);
+	}
+}
+
+static void* ow_capture_run(void* context)
+{
+	ow_capture_t* capture = context;
+
+	while (!__atomic_load_n(&capture->shall_stop, __ATOMIC_ACQUIRE))
+	{
+		//Sleep until the next flush, unless we are told to stop:
+		struct pollfd poll_fd = { .fd = capture->wake_fd, .events = POLLIN };
+		poll(&poll_fd, 1, OW_CAPTURE_FLUSH_INTERVAL_MS);
+
+		ow_capture_drain(capture);
+	}
+
+	//Frames that have been queued before stopping:
+	ow_capture_drain(capture);
+
+	return NULL;
+}
+
+ow_capture_t* ow_capture_open(const char* path, size_t buffer_size)
+{
+	if (buffer_size == 0)
+	{
+		errno = EINVAL;
+		return NULL;
+	}
+
+	//Round the capacity up to a power of two, so wrapping is a mask:
+	size_t capacity = 1;
+
+	while (capacity < buffer_size)
+	{
+		capacity <<= 1;
+	}
+
+	//The struct is cache line aligned:
+	ow_capture_t* capture;
+	int error = posix_memalign((void**)&capture, OW_CAPTURE_CACHE_LINE_SIZE, sizeof(ow_capture_t));
+
+	if (error != 0)
+	{
+		errno = error;
+		return NULL;
+	}
+
+	memset(capture, 0, sizeof(ow_capture_t));
+
+	capture->capacity = capacity;
+	capture->mask = capacity - 1;
+	capture->ring = malloc(capacity);
+
+	if (!capture->ring)
+	{
+		error = errno;
+		goto free_out;
+	}
+
+	capture->fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+
+	if (capture->fd < 0)
+	{
+		error = errno;
+		goto free_out;
+	}
+
+	//The file header goes out right away, so even an empty capture is a valid file:
+	uint8_t header[OW_BTSNOOP_HEADER_LENGTH];
+
+	memcpy(header, OW_BTSNOOP_MAGIC, sizeof(OW_BTSNOOP_MAGIC));
+	ow_capture_write_be32(&header[8], OW_BTSNOOP_VERSION);
+	ow_capture_write_be32(&header[12], OW_BTSNOOP_DATALINK_H4);
+
+	if (!ow_capture_write_full(capture->fd, header, sizeof(header)))
+	{
+		error = errno;
+		goto close_out;
+	}
+
+	capture->bytes_written = sizeof(header);
+
+	//The wakeup descriptor for stopping:
+	capture->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+	if (capture->wake_fd < 0)
+	{
+		error = errno;
+		goto close_out;
+	}
+
+	error = pthread_create(&capture->thread, NULL, ow_capture_run, capture);
+
+	if (error != 0)
+	{
+		close(capture->wake_fd);
+		goto close_out;
+	}
+
+	return capture;
+
+close_out:
+	close(capture->fd);
+
+free_out:
+	free(capture->ring);
+	free(capture);
+
+	errno = error;
+	return NULL;
+}
+
+void ow_capture_tap(const uint8_t* frame, size_t length, const struct timespec* timestamp, void* context)
+{
+	ow_capture_t* capture = context;
+	size_t head = capture->head;
+	size_t record_length = OW_BTSNOOP_RECORD_HEADER_LENGTH + length;
+
+	//Full? Only then we have to look at the writer's cache line.
+	if ((head + record_length - capture->cached_tail) > capture->capacity)
+	{
+		capture->cached_tail = __atomic_load_n(&capture->tail, __ATOMIC_ACQUIRE);
+
+		if ((head + record_length - capture->cached_tail) > capture->capacity)
+		{
+			__atomic_store_n(&capture->dropped, capture->dropped + 1, __ATOMIC_RELAXED);
+			return;
+		}
+	}
+
+	//Record header: original length, included length, flags, cumulative drops, timestamp.
+	uint8_t header[OW_BTSNOOP_RECORD_HEADER_LENGTH];
+	uint64_t timestamp_us = (uint64_t)timestamp->tv_sec * 1000000 + (uint64_t)timestamp->tv_nsec / 1000 + OW_BTSNOOP_EPOCH_OFFSET_US;
+	uint32_t flags = OW_BTSNOOP_FLAG_RECEIVED | (((length > 0) && (frame[0] == OW_CAPTURE_PACKET_TYPE_EVENT)) ? OW_BTSNOOP_FLAG_COMMAND_EVENT : 0);
+
+	ow_capture_write_be32(header, (uint32_t)length);
+	ow_capture_write_be32(&header[4], (uint32_t)length);
+	ow_capture_write_be32(&header[8], flags);
+	ow_capture_write_be32(&header[12], (uint32_t)capture->dropped);
+	ow_capture_write_be64(&header[16], timestamp_us);
+
+	ow_capture_put(capture, head, header, sizeof(header));
+	ow_capture_put(capture, head + sizeof(header), frame, length);
+
+	//Make the record visible to the writer:
+	__atomic_store_n(&capture->head, head + record_length, __ATOMIC_RELEASE);
+	__atomic_store_n(&capture->frames, capture->frames + 1, __ATOMIC_RELAXED);
+}
+
+void ow_capture_get_stats(const ow_capture_t* capture, ow_capture_stats_t* stats)
+{
+	stats->frames = __atomic_load_n(&capture->frames, __ATOMIC_RELAXED);
+	stats->dropped = __atomic_load_n(&capture->dropped, __ATOMIC_RELAXED);
+	stats->bytes_written = __atomic_load_n(&capture->bytes_written, __ATOMIC_RELAXED);
+}
+
+bool ow_capture_close(ow_capture_t* capture)
+{
+	//Wake up the writer thread and wait until it has written everything:
+	__atomic_store_n(&capture->shall_stop, true, __ATOMIC_RELEASE);
+
+	uint64_t one = 1;
+	ssize_t written = write(capture->wake_fd, &one, sizeof(one));
+	(void)written;
+
+	pthread_join(capture->thread, NULL);
+
+	int error = capture->error;
+
+	if ((close(capture->fd) != 0) && (error == 0))
+	{
+		error = errno;
+	}
+
+	close(capture->wake_fd);
+	free(capture->ring);
+	free(capture);
+
+	if (error != 0)
+	{
+		errno = error;
+		return false;
+	}
+
+	return true;
+}
@@ -0,0 +1,552 @@
+#include "ow18b_codec.h"
+
+#include <errno.h>
+#include <string.h>
+
+//The block format:
+//
+//version (1 byte), count (varint), timestamp resolution (varint)
+//first timestamp (zigzag varint, if count >= 1), first timestamp delta (zigzag varint, if count >= 2)
+//unit word runs: (run length (varint), unit word (varint))... until "count" is covered
+//flag runs: (run length (varint), flags (1 byte))... until "count" is covered
+//magnitude groups: deltas of the signed magnitudes (zigzag, bit-packed), "count" values
+//timestamp groups: deltas of the timestamp deltas (zigzag, bit-packed), "count - 2" values
+//
+//Bit-packed values come in groups of up to OW_CODEC_GROUP_LENGTH: a width byte, followed by ceil(width * n / 8) bytes (LSB first).
+//A group of identical deltas (e. g. a stable reading) has width 0 and takes a single byte.
+#define OW_CODEC_VERSION 1
+#define OW_CODEC_GROUP_LENGTH 128
+
+//The magnitude is 14 bits (see "Internal data format" in the README):
+#define OW_CODEC_MAGNITUDE_MASK 0x3FFF
+#define OW_CODEC_SIGN_BIT 0x8000
+
+//Appends to a caller-provided buffer (writes beyond the end are counted, but dropped):
+typedef struct __ow_codec_writer_t__
+{
+	uint8_t* buf;
+	size_t size;
+	size_t length;
+} ow_codec_writer_t;
+
+//Consumes a block (reads beyond the end set "is_damaged" and return zeros):
+typedef struct __ow_codec_reader_t__
+{
+	const uint8_t* buf;
+	size_t length;
+	size_t position;
+	bool is_damaged;
+} ow_codec_reader_t;
+
+//Map signed values to unsigned ones with small absolute values staying small and back:
+static uint64_t ow_codec_zigzag(int64_t value);
+static int64_t ow_codec_unzigzag(uint64_t value);
+
+//Map a sign-magnitude value word to a signed integer (-0 is kept apart from 0) and back:
+static int64_t ow_codec_signed_magnitude(uint16_t value_sign);
+static bool ow_codec_value_sign(int64_t value, uint16_t* value_sign);
+
+//Quantize a timestamp to the resolution (rounding down):
+static int64_t ow_codec_quantize(int64_t timestamp_ns, uint32_t resolution_ns);
+
+//Primitive writes:
+static void ow_codec_put_byte(ow_codec_writer_t* writer, uint8_t byte);
+static void ow_codec_put_varint(ow_codec_writer_t* writer, uint64_t value);
+
+//Bit-pack up to OW_CODEC_GROUP_LENGTH values:
+static void ow_codec_put_group(ow_codec_writer_t* writer, const uint64_t* values, size_t count);
+
+//Primitive reads:
+static uint8_t ow_codec_get_byte(ow_codec_reader_t* reader);
+static uint64_t ow_codec_get_varint(ow_codec_reader_t* reader);
+
+//Unpack a group of "count" values:
+static void ow_codec_get_group(ow_codec_reader_t* reader, uint64_t* values, size_t count);
+
+//Read the header of a block:
+static void ow_codec_get_header(ow_codec_reader_t* reader, uint64_t* count, uint64_t* resolution_ns);
+
+static uint64_t ow_codec_zigzag(int64_t value)
+{
+	return ((uint64_t)value << 1) ^ (uint64_t)(value >> 63);
+}
+
+static int64_t ow_codec_unzigzag(uint64_t value)
+{
+	return (int64_t)((value >> 1) ^ (~(value & 1) + 1));
+}
+
+static int64_t ow_codec_signed_magnitude(uint16_t value_sign)
+{
+	int64_t magnitude = value_sign & OW_CODEC_MAGNITUDE_MASK;
+	return (value_sign & OW_CODEC_SIGN_BIT) ? (-magnitude - 1) : magnitude;
+}
+
+static bool ow_codec_value_sign(int64_t value, uint16_t* value_sign)
+{
+	if ((value > OW_CODEC_MAGNITUDE_MASK) || (value < -OW_CODEC_MAGNITUDE_MASK - 1))
+	{
+		return false;
+	}
+
+	*value_sign = (value < 0) ? (uint16_t)((-value - 1) | OW_CODEC_SIGN_BIT) : (uint16_t)value;
+	return true;
+}
+
+static int64_t ow_codec_quantize(int64_t timestamp_ns, uint32_t resolution_ns)
+{
+	int64_t quotient = timestamp_ns / resolution_ns;
+
+	if (((timestamp_ns % resolution_ns) != 0) && (timestamp_ns < 0))
+	{
+		quotient--;
+	}
+
+	return quotient;
+}
+
+static void ow_codec_put_byte(ow_codec_writer_t* writer, uint8_t byte)
+{
+	if (writer->length < writer->size)
+	{
+		writer->buf[writer->length] = byte;
+	}
+
+	writer->length++;
+}
+
+static void ow_codec_put_varint(ow_codec_writer_t* writer, uint64_t value)
+{
+	//Seven bits per byte, the high bit tells if more follow:
+	while (value >= 0x80)
+	{
+		ow_codec_put_byte(writer, (uint8_t)(value | 0x80));
+		value >>= 7;
+	}
+
+	ow_codec_put_byte(writer, (uint8_t)value);
+}
+
+static void ow_codec_put_group(ow_codec_writer_t* writer, const uint64_t* values, size_t count)
+{
+	//The width of the largest value:
+	uint64_t all = 0;
+
+	for (size_t i = 0; i < count; i++)
+	{
+		all |= values[i];
+	}
+
+	unsigned int width = (all == 0) ? 0 : (64 - (unsigned int)__builtin_clzll(all));
+	ow_codec_put_byte(writer, (uint8_t)width);
+
+	if (width == 0)
+	{
+		return;
+	}
+
+	//Collect the bits in a word and write it out whenever it is full:
+	uint64_t word = 0;
+	unsigned int bits = 0;
+
+	for (size_t i = 0; i < count; i++)
+	{
+		word |= values[i] << bits;
+
+		if ((bits + width) >= 64)
+		{
+			for (unsigned int j = 0; j < 64; j += 8)
+			{
+				ow_codec_put_byte(writer, (uint8_t)(word >> j));
+			}
+
+			//The bits of the value that haven't fit:
+			word = (bits == 0) ? 0 : (values[i] >> (64 - bits));
+			bits = bits + width - 64;
+		}
+		else
+		{
+			bits += width;
+		}
+	}
+
+	for (unsigned int j = 0; j < bits; j += 8)
+	{
+		ow_codec_put_byte(writer, (uint8_t)(word >> j));
+	}
+}
+
+static uint8_t ow_codec_get_byte(ow_codec_reader_t* reader)
+{
+	if (reader->position >= reader->length)
+	{
+		reader->is_damaged = true;
+		return 0;
+	}
+
+	return reader->buf[reader->position++];
+}
+
+static uint64_t ow_codec_get_varint(ow_codec_reader_t* reader)
+{
+	uint64_t value = 0;
+
+	for (unsigned int shift = 0; shift < 64; shift += 7)
+	{
+		uint8_t byte = ow_codec_get_byte(reader);
+		value |= (uint64_t)(byte & 0x7F) << shift;
+
+		if (!(byte & 0x80))
+		{
+			return value;
+		}
+	}
+
+	//More than ten bytes:
+	reader->is_damaged = true;
+	return 0;
+}
+
+static void ow_codec_get_group(ow_codec_reader_t* reader, uint64_t* values, size_t count)
+{
+	unsigned int width = ow_codec_get_byte(reader);
+
+	if (width > 64)
+	{
+		reader->is_damaged = true;
+		width = 0;
+	}
+
+	if (width == 0)
+	{
+		memset(values, 0, count * sizeof(uint64_t));
+		return;
+	}
+
+	//Make sure all bytes of the group are there, so the loop below doesn't have to check:
+	size_t length = (width * count + 7) / 8;
+
+	if ((reader->length - reader->position) < length)
+	{
+		reader->is_damaged = true;
+		memset(values, 0, count * sizeof(uint64_t));
+		return;
+	}
+
+	const uint8_t* bytes = &reader->buf[reader->position];
+	uint64_t mask = (width == 64) ? UINT64_MAX : ((UINT64_C(1) << width) - 1);
+
+	//Take bits from the front, refilling the word byte by byte:
+	uint64_t word = 0;
+	unsigned int bits = 0;
+	size_t next = 0;
+
+	for (size_t i = 0; i < count; i++)
+	{
+		uint64_t value = 0;
+		unsigned int have = 0;
+
+		while (have < width)
+		{
+			if (bits == 0)
+			{
+				word = bytes[next++];
+				bits = 8;
+			}
+
+			unsigned int take = ((width - have) < bits) ? (width - have) : bits;
+
+			value |= (word & ((UINT64_C(1) << take) - 1)) << have;
+			word >>= take;
+			bits -= take;
+			have += take;
+		}
+
+		values[i] = value & mask;
+	}
+
+	reader->position += length;
+}
+
+static void ow_codec_get_header(ow_codec_reader_t* reader, uint64_t* count, uint64_t* resolution_ns)
+{
+	if (ow_codec_get_byte(reader) != OW_CODEC_VERSION)
+	{
+		reader->is_damaged = true;
+	}
+
+	*count = ow_codec_get_varint(reader);
+	*resolution_ns = ow_codec_get_varint(reader);
+
+	if ((*resolution_ns == 0) || (*resolution_ns > UINT32_MAX))
+	{
+		reader->is_damaged = true;
+	}
+}
+
+size_t ow_codec_max_length(size_t count)
+{
+	//Header, one run of each kind per record, three magnitude bytes, eight timestamp bytes and a width byte per group:
+	return 40 + count * (13 + 3 + 8) + 2 * (count / OW_CODEC_GROUP_LENGTH + 1);
+}
+
+bool ow_codec_encode(const ow_log_record_t* records, size_t count, const ow_codec_params* params, uint8_t* buf, size_t size, size_t* length)
+{
+	uint32_t resolution_ns = params ? params->timestamp_resolution_ns : 1;
+
+	if (resolution_ns == 0)
+	{
+		errno = EINVAL;
+		return false;
+	}
+
+	ow_codec_writer_t writer = { .buf = buf, .size = size, .length = 0 };
+
+	ow_codec_put_byte(&writer, OW_CODEC_VERSION);
+	ow_codec_put_varint(&writer, count);
+	ow_codec_put_varint(&writer, resolution_ns);
+
+	//The timestamps are differences from here on, wrap-around included:
+	if (count >= 1)
+	{
+		ow_codec_put_varint(&writer, ow_codec_zigzag(ow_codec_quantize(records[0].timestamp_ns, resolution_ns)));
+	}
+
+	if (count >= 2)
+	{
+		uint64_t delta = (uint64_t)ow_codec_quantize(records[1].timestamp_ns, resolution_ns) - (uint64_t)ow_codec_quantize(records[0].timestamp_ns, resolution_ns);
+		ow_codec_put_varint(&writer, ow_codec_zigzag((int64_t)delta));
+	}
+
+	//Unit words and flags barely change, so they are run-length encoded:
+	for (size_t i = 0; i < count;)
+	{
+		size_t j = i + 1;
+
+		while ((j < count) && (records[j].sample.unit_places == records[i].sample.unit_places))
+		{
+			j++;
+		}
+
+		ow_codec_put_varint(&writer, j - i);
+		ow_codec_put_varint(&writer, records[i].sample.unit_places);
+		i = j;
+	}
+
+	for (size_t i = 0; i < count;)
+	{
+		size_t j = i + 1;
+
+		while ((j < count) && (records[j].sample.flags == records[i].sample.flags))
+		{
+			j++;
+		}
+
+		ow_codec_put_varint(&writer, j - i);
+		ow_codec_put_byte(&writer, records[i].sample.flags);
+		i = j;
+	}
+
+	//Magnitudes as deltas:
+	uint64_t values[OW_CODEC_GROUP_LENGTH];
+	int64_t last_magnitude = 0;
+
+	for (size_t i = 0; i < count; i += OW_CODEC_GROUP_LENGTH)
+	{
+		size_t group_count = ((count - i) < OW_CODEC_GROUP_LENGTH) ? (count - i) : OW_CODEC_GROUP_LENGTH;
+
+		for (size_t j = 0; j < group_count; j++)
+		{
+			int64_t magnitude = ow_codec_signed_magnitude(records[i + j].sample.value_sign);
+
+			values[j] = ow_codec_zigzag(magnitude - last_magnitude);
+			last_magnitude = magnitude;
+		}
+
+		ow_codec_put_group(&writer, values, group_count);
+	}
+
+	//Timestamps as deltas of deltas (0 for a steady rate):
+	uint64_t last_timestamp = 0, last_delta = 0;
+
+	if (count >= 2)
+	{
+		last_timestamp = (uint64_t)ow_codec_quantize(records[1].timestamp_ns, resolution_ns);
+		last_delta = last_timestamp - (uint64_t)ow_codec_quantize(records[0].timestamp_ns, resolution_ns);
+	}
+
+	for (size_t i = 2; i < count; i += OW_CODEC_GROUP_LENGTH)
+	{
+		size_t group_count = ((count - i) < OW_CODEC_GROUP_LENGTH) ? (count - i) : OW_CODEC_GROUP_LENGTH;
+
+		for (size_t j = 0; j < group_count; j++)
+		{
+			uint64_t timestamp = (uint64_t)ow_codec_quantize(records[i + j].timestamp_ns, resolution_ns);
+			uint64_t delta = timestamp - last_timestamp;
+
+			values[j] = ow_codec_zigzag((int64_t)(delta - last_delta));
+
+			last_timestamp = timestamp;
+			last_delta = delta;
+		}
+
+		ow_codec_put_group(&writer, values, group_count);
+	}
+
+	if (writer.length > size)
+	{
+		errno = ENOBUFS;
+		return false;
+	}
+
+	*length = writer.length;
+	return true;
+}
+
+bool ow_codec_count(const uint8_t* buf, size_t length, size_t* count)
+{
+	ow_codec_reader_t reader = { .buf = buf, .length = length, .position = 0, .is_damaged = false };
+
+	uint64_t block_count, resolution_ns;
+	ow_codec_get_header(&reader, &block_count, &resolution_ns);
+
+	if (reader.is_damaged || (block_count > SIZE_MAX))
+	{
+		errno = EINVAL;
+		return false;
+	}
+
+	*count = (size_t)block_count;
+	return true;
+}
+
+bool ow_codec_decode(const uint8_t* buf, size_t length, ow_log_record_t* records, size_t max_records, size_t* count)
+{
+	ow_codec_reader_t reader = { .buf = buf, .length = length, .position = 0, .is_damaged = false };
+
+	uint64_t block_count, resolution_ns;
+	ow_codec_get_header(&reader, &block_count, &resolution_ns);
+
+	if (reader.is_damaged)
+	{
+		errno = EINVAL;
+		return false;
+	}
+
+	if (block_count > max_records)
+	{
+		errno = ENOBUFS;
+		return false;
+	}
+
+	size_t record_count = (size_t)block_count;
+
+	//Timestamps are completed once the deltas of deltas are known:
+	uint64_t first = 0, delta = 0;
+
+	if (record_count >= 1)
+	{
+		first = (uint64_t)ow_codec_unzigzag(ow_codec_get_varint(&reader));
+	}
+
+	if (record_count >= 2)
+	{
+		delta = (uint64_t)ow_codec_unzigzag(ow_codec_get_varint(&reader));
+	}
+
+	//Unit word runs:
+	for (size_t i = 0; (i < record_count) && !reader.is_damaged;)
+	{
+		uint64_t run = ow_codec_get_varint(&reader);
+		uint64_t unit_places = ow_codec_get_varint(&reader);
+
+		if ((run == 0) || (run > (record_count - i)) || (unit_places > UINT16_MAX))
+		{
+			reader.is_damaged = true;
+			break;
+		}
+
+		for (size_t j = 0; j < run; j++)
+		{
+			records[i++].sample.unit_places = (uint16_t)unit_places;
+		}
+	}
+
+	//Flag runs:
+	for (size_t i = 0; (i < record_count) && !reader.is_damaged;)
+	{
+		uint64_t run = ow_codec_get_varint(&reader);
+		uint8_t flags = ow_codec_get_byte(&reader);
+
+		if ((run == 0) || (run > (record_count - i)))
+		{
+			reader.is_damaged = true;
+			break;
+		}
+
+		for (size_t j = 0; j < run; j++)
+		{
+			records[i].sample.flags = flags;
+			memset(records[i].sample.reserved, 0, sizeof(records[i].sample.reserved));
+			i++;
+		}
+	}
+
+	//Magnitudes:
+	uint64_t values[OW_CODEC_GROUP_LENGTH];
+	int64_t last_magnitude = 0;
+
+	for (size_t i = 0; (i < record_count) && !reader.is_damaged; i += OW_CODEC_GROUP_LENGTH)
+	{
+		size_t group_count = ((record_count - i) < OW_CODEC_GROUP_LENGTH) ? (record_count - i) : OW_CODEC_GROUP_LENGTH;
+		ow_codec_get_group(&reader, values, group_count);
+
+		for (size_t j = 0; j < group_count; j++)
+		{
+			last_magnitude += ow_codec_unzigzag(values[j]);
+
+			if (!ow_codec_value_sign(last_magnitude, &records[i + j].sample.value_sign))
+			{
+				reader.is_damaged = true;
+				break;
+			}
+		}
+	}
+
+	//Timestamps:
+	uint64_t timestamp = first;
+
+	if (record_count >= 1)
+	{
+		records[0].timestamp_ns = (int64_t)(first * resolution_ns);
+	}
+
+	if (record_count >= 2)
+	{
+		timestamp += delta;
+		records[1].timestamp_ns = (int64_t)(timestamp * resolution_ns);
+	}
+
+	for (size_t i = 2; (i < record_count) && !reader.is_damaged; i += OW_CODEC_GROUP_LENGTH)
+	{
+		size_t group_count = ((record_count - i) < OW_CODEC_GROUP_LENGTH) ? (record_count - i) : OW_CODEC_GROUP_LENGTH;
+		ow_codec_get_group(&reader, values, group_count);
+
+		for (size_t j = 0; j < group_count; j++)
+		{
+			delta += (uint64_t)ow_codec_unzigzag(values[j]);
+			timestamp += delta;
+			records[i + j].timestamp_ns = (int64_t)(timestamp * resolution_ns);
+		}
+	}
+
+	//Everything has to be consumed exactly:
+	if (reader.is_damaged || (reader.position != reader.length))
+	{
+		errno = EINVAL;
+		return false;
+	}
+
+	*count = record_count;
+	return true;
+}
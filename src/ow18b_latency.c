@@ -0,0 +1,184 @@
+#include "ow18b_latency.h"
+
+#include <math.h>
+#include <string.h>
+
+//The number of buckets per power of two:
+#define OW_HISTOGRAM_SUB_COUNT (1 << OW_HISTOGRAM_SUB_BITS)
+
+//Map a duration to its bucket resp. a bucket to the largest duration it holds:
+static size_t ow_histogram_bucket(uint64_t ns);
+static uint64_t ow_histogram_bucket_upper(size_t bucket);
+
+//The signed difference between two points in time in nanoseconds:
+static int64_t ow_timespec_diff_ns(const struct timespec* end, const struct timespec* start);
+
+static size_t ow_histogram_bucket(uint64_t ns)
+{
+	//Small values get a bucket each:
+	if (ns < OW_HISTOGRAM_SUB_COUNT)
+	{
+		return (size_t)ns;
+	}
+
+	//Otherwise, the highest bit selects the group and the bits below it the bucket inside:
+	unsigned int shift = (63 - (unsigned int)__builtin_clzll(ns)) - OW_HISTOGRAM_SUB_BITS;
+
+	return ((size_t)(shift + 1) << OW_HISTOGRAM_SUB_BITS) | (size_t)((ns >> shift) & (OW_HISTOGRAM_SUB_COUNT - 1));
+}
+
+static uint64_t ow_histogram_bucket_upper(size_t bucket)
+{
+	if (bucket < OW_HISTOGRAM_SUB_COUNT)
+	{
+		return bucket;
+	}
+
+	unsigned int shift = (unsigned int)(bucket >> OW_HISTOGRAM_SUB_BITS) - 1;
+	uint64_t next = (uint64_t)(OW_HISTOGRAM_SUB_COUNT + (bucket & (OW_HISTOGRAM_SUB_COUNT - 1)) + 1);
+
+	//The last bucket ends at the largest representable value:
+	if (next > (UINT64_MAX >> shift))
+	{
+		return UINT64_MAX;
+	}
+
+	return (next << shift) - 1;
+}
+
+static int64_t ow_timespec_diff_ns(const struct timespec* end, const struct timespec* start)
+{
+	return (int64_t)(end->tv_sec - start->tv_sec) * 1000000000 + (int64_t)(end->tv_nsec - start->tv_nsec);
+}
+
+void ow_histogram_init(ow_histogram_t* histogram)
+{
+	memset(histogram, 0, sizeof(ow_histogram_t));
+	histogram->min_ns = UINT64_MAX;
+}
+
+void ow_histogram_record(ow_histogram_t* histogram, uint64_t ns)
+{
+	histogram->buckets[ow_histogram_bucket(ns)]++;
+	histogram->count++;
+	histogram->sum_ns += ns;
+
+	if (ns < histogram->min_ns)
+	{
+		histogram->min_ns = ns;
+	}
+
+	if (ns > histogram->max_ns)
+	{
+		histogram->max_ns = ns;
+	}
+}
+
+void ow_histogram_merge(ow_histogram_t* histogram, const ow_histogram_t* source)
+{
+	for (size_t i = 0; i < OW_HISTOGRAM_BUCKET_COUNT; i++)
+	{
+		histogram->buckets[i] += source->buckets[i];
+	}
+
+	histogram->count += source->count;
+	histogram->sum_ns += source->sum_ns;
+
+	if (source->min_ns < histogram->min_ns)
+	{
+		histogram->min_ns = source->min_ns;
+	}
+
+	if (source->max_ns > histogram->max_ns)
+	{
+		histogram->max_ns = source->max_ns;
+	}
+}
+
+uint64_t ow_histogram_quantile(const ow_histogram_t* histogram, double quantile)
+{
+	if (histogram->count == 0)
+	{
+		return 0;
+	}
+
+	//The rank of the wanted value (at least the first one):
+	double rank = ceil(quantile * (double)histogram->count);
+	uint64_t wanted = (rank < 1.0) ? 1 : (rank > (double)histogram->count) ? histogram->count : (uint64_t)rank;
+
+	//Walk the buckets until we have seen enough values:
+	uint64_t seen = 0;
+
+	for (size_t i = 0; i < OW_HISTOGRAM_BUCKET_COUNT; i++)
+	{
+		seen += histogram->buckets[i];
+
+		if (seen >= wanted)
+		{
+			//The bucket bound can't exceed what we have actually seen:
+			uint64_t upper = ow_histogram_bucket_upper(i);
+			return (upper < histogram->max_ns) ? upper : histogram->max_ns;
+		}
+	}
+
+	return histogram->max_ns;
+}
+
+uint64_t ow_histogram_mean(const ow_histogram_t* histogram)
+{
+	return (histogram->count > 0) ? (histogram->sum_ns / histogram->count) : 0;
+}
+
+void ow_latency_init(ow_latency_t* latency)
+{
+	ow_histogram_init(&latency->latency);
+	ow_histogram_init(&latency->jitter);
+
+	latency->clock_anomalies = 0;
+	latency->has_last = false;
+	latency->has_last_interval = false;
+}
+
+void ow_latency_record(ow_latency_t* latency, const ow_sample_t* sample)
+{
+	//Latency from the receive time until now:
+	struct timespec now;
+	clock_gettime(CLOCK_REALTIME, &now);
+
+	int64_t latency_ns = ow_timespec_diff_ns(&now, &sample->timestamp);
+
+	if (latency_ns >= 0)
+	{
+		ow_histogram_record(&latency->latency, (uint64_t)latency_ns);
+	}
+	else
+	{
+		latency->clock_anomalies++;
+	}
+
+	//Jitter: How much does this inter-arrival time differ from the previous one?
+	if (latency->has_last)
+	{
+		int64_t interval_ns = ow_timespec_diff_ns(&sample->timestamp, &latency->last_timestamp);
+
+		if (interval_ns >= 0)
+		{
+			if (latency->has_last_interval)
+			{
+				int64_t jitter_ns = interval_ns - (int64_t)latency->last_interval_ns;
+				ow_histogram_record(&latency->jitter, (uint64_t)((jitter_ns < 0) ? -jitter_ns : jitter_ns));
+			}
+
+			latency->last_interval_ns = (uint64_t)interval_ns;
+			latency->has_last_interval = true;
+		}
+		else
+		{
+			latency->clock_anomalies++;
+			latency->has_last_interval = false;
+		}
+	}
+
+	latency->last_timestamp = sample->timestamp;
+	latency->has_last = true;
+}
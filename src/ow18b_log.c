@@ -0,0 +1,811 @@
+#include "ow18b_log.h"
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+//The segment file format:
+#define OW_LOG_MAGIC "OW18BLOG"
+#define OW_LOG_MAGIC_LENGTH 8
+#define OW_LOG_VERSION 1
+
+//Segment files are called "<sequence>.owl", their indices "<sequence>.owi":
+#define OW_LOG_SEQUENCE_DIGITS 8
+#define OW_LOG_DATA_SUFFIX ".owl"
+#define OW_LOG_INDEX_SUFFIX ".owi"
+#define OW_LOG_NAME_LENGTH (OW_LOG_SEQUENCE_DIGITS + 4)
+
+//How many records the writer buffers before writing them out (4 KiB):
+#define OW_LOG_BUFFER_RECORDS 256
+
+//The header at the start of each segment file (records start right behind it):
+typedef struct __ow_log_header_t__
+{
+	char magic[OW_LOG_MAGIC_LENGTH];
+	uint32_t version;
+	uint32_t record_size;
+	uint32_t index_interval;
+	uint32_t reserved[3];
+} ow_log_header_t;
+
+//An entry of the sparse time index:
+typedef struct __ow_log_index_entry_t__
+{
+	int64_t timestamp_ns;
+	uint64_t record;
+} ow_log_index_entry_t;
+
+//Records must not be padded and have to stay aligned behind the header:
+_Static_assert(sizeof(ow_log_record_t) == 16, "ow_log_record_t must be 16 bytes");
+_Static_assert((sizeof(ow_log_header_t) % sizeof(ow_log_record_t)) == 0, "ow_log_header_t must keep records aligned");
+
+struct __ow_log_t__
+{
+	//Where the segments go and how they look:
+	char dir_path[PATH_MAX];
+	ow_log_params params;
+
+	//The current segment:
+	unsigned int sequence;
+	int data_fd;
+	int index_fd;
+	uint64_t segment_records;
+
+	//Keep timestamps sorted:
+	bool has_last_timestamp;
+	int64_t last_timestamp_ns;
+
+	//Records and index entries that have not been written yet:
+	ow_log_record_t records[OW_LOG_BUFFER_RECORDS];
+	size_t record_count;
+	ow_log_index_entry_t index_entries[OW_LOG_BUFFER_RECORDS];
+	size_t index_entry_count;
+
+	//The first error of a sample callback (reported on close):
+	int error;
+};
+
+//A mapped segment:
+typedef struct __ow_log_segment_t__
+{
+	void* data_map;
+	size_t data_length;
+	const ow_log_record_t* records;
+	size_t record_count;
+
+	void* index_map;
+	size_t index_length;
+	const ow_log_index_entry_t* index_entries;
+	size_t index_entry_count;
+} ow_log_segment_t;
+
+struct __ow_log_reader_t__
+{
+	ow_log_segment_t* segments;
+	size_t segment_count;
+};
+
+//The parameters for log writers that don't provide their own (16 MiB segments, one index entry per 16 KiB):
+static ow_log_params automatic_log_params =
+{
+	.segment_records = 1 << 20,
+	.index_interval = 1024
+};
+
+//Parse the sequence number of a segment file name (fails for other files):
+static bool ow_log_parse_sequence(const char* name, unsigned int* sequence);
+
+//Build the path of a segment file:
+static bool ow_log_segment_path(const char* dir_path, unsigned int sequence, const char* suffix, char* path);
+
+//Find the highest sequence number in a log directory ("found" tells if there is one).
+//Sets errno on error.
+static bool ow_log_last_sequence(const char* dir_path, unsigned int* sequence, bool* found);
+
+//Create the next segment (and its index) of a log writer.
+//On error, nothing is left behind and both descriptors are -1, so the segment can be started again. Sets errno on error.
+static bool ow_log_start_segment(ow_log_t* log);
+
+//Close the current segment of a log writer (its descriptors become -1):
+static void ow_log_end_segment(ow_log_t* log);
+
+//Write out full buffers and start the next segment if the current one is full resp. if starting it has failed before.
+//After a failure, this is retried by the next append, so the buffers never overflow and segments never grow past their size.
+//Sets errno on error.
+static bool ow_log_make_room(ow_log_t* log);
+
+//Write a whole buffer, retrying on short writes.
+//Sets errno on error.
+static bool ow_log_write_full(int fd, const void* buf, size_t length);
+
+//Only select segment data files:
+static int ow_log_select_segment(const struct dirent* entry);
+
+//Map a segment and its index ("is_valid" tells if the file is a segment at all).
+//Sets errno on error.
+static bool ow_log_map_segment(const char* dir_path, const char* name, ow_log_segment_t* segment, bool* is_valid);
+
+//Unmap a segment and its index:
+static void ow_log_unmap_segment(ow_log_segment_t* segment);
+
+//Find the first record of a segment with timestamp >= t0:
+static size_t ow_log_lower_bound(const ow_log_segment_t* segment, int64_t t0);
+
+static bool ow_log_parse_sequence(const char* name, unsigned int* sequence)
+{
+	//Exact length and suffix:
+	if ((strlen(name) != OW_LOG_NAME_LENGTH) || (strcmp(&name[OW_LOG_SEQUENCE_DIGITS], OW_LOG_DATA_SUFFIX) != 0))
+	{
+		return false;
+	}
+
+	//Only digits before the suffix:
+	unsigned int value = 0;
+
+	for (size_t i = 0; i < OW_LOG_SEQUENCE_DIGITS; i++)
+	{
+		if ((name[i] < '0') || (name[i] > '9'))
+		{
+			return false;
+		}
+
+		value = value * 10 + (unsigned int)(name[i] - '0');
+	}
+
+	*sequence = value;
+	return true;
+}
+
+static bool ow_log_segment_path(const char* dir_path, unsigned int sequence, const char* suffix, char* path)
+{
+	if (snprintf(path, PATH_MAX, "%s/%0*u%s", dir_path, OW_LOG_SEQUENCE_DIGITS, sequence, suffix) >= PATH_MAX)
+	{
+		errno = ENAMETOOLONG;
+		return false;
+	}
+
+	return true;
+}
+
+static bool ow_log_last_sequence(const char* dir_path, unsigned int* sequence, bool* found)
+{
+	DIR* dir = opendir(dir_path);
+
+	if (!dir)
+	{
+		return false;
+	}
+
+	*found = false;
+	*sequence = 0;
+
+	struct dirent* entry;
+
+	while ((entry = readdir(dir)))
+	{
+		unsigned int entry_sequence;
+
+		if (ow_log_parse_sequence(entry->d_name, &entry_sequence) && (!*found || (entry_sequence > *sequence)))
+		{
+			*sequence = entry_sequence;
+			*found = true;
+		}
+	}
+
+	closedir(dir);
+	return true;
+}
+
+static bool ow_log_start_segment(ow_log_t* log)
+{
+	char path[PATH_MAX];
+
+	//Create the data file (never overwrite anything):
+	if (!ow_log_segment_path(log->dir_path, log->sequence, OW_LOG_DATA_SUFFIX, path))
+	{
+		return false;
+	}
+
+	log->index_fd = -1;
+	log->data_fd = open(path, O_WRONLY | O_CREAT | O_EXCL | O_APPEND | O_CLOEXEC, 0644);
+
+	if (log->data_fd < 0)
+	{
+		return false;
+	}
+
+	//Write its header:
+	ow_log_header_t header;
+
+	memset(&header, 0, sizeof(header));
+	memcpy(header.magic, OW_LOG_MAGIC, OW_LOG_MAGIC_LENGTH);
+	header.version = OW_LOG_VERSION;
+	header.record_size = sizeof(ow_log_record_t);
+	header.index_interval = log->params.index_interval;
+
+	int error;
+
+	if (!ow_log_write_full(log->data_fd, &header, sizeof(header)))
+	{
+		error = errno;
+		goto unlink_out;
+	}
+
+	//Create the index file:
+	char index_path[PATH_MAX];
+
+	if (!ow_log_segment_path(log->dir_path, log->sequence, OW_LOG_INDEX_SUFFIX, index_path))
+	{
+		error = errno;
+		goto unlink_out;
+	}
+
+	log->index_fd = open(index_path, O_WRONLY | O_CREAT | O_TRUNC | O_APPEND | O_CLOEXEC, 0644);
+
+	if (log->index_fd < 0)
+	{
+		error = errno;
+		goto unlink_out;
+	}
+
+	log->segment_records = 0;
+	return true;
+
+unlink_out:
+	//Don't leave a data file without an index behind (and let a retry create it again):
+	close(log->data_fd);
+	unlink(path);
+
+	log->data_fd = -1;
+
+	errno = error;
+	return false;
+}
+
+static void ow_log_end_segment(ow_log_t* log)
+{
+	close(log->data_fd);
+	close(log->index_fd);
+
+	log->data_fd = -1;
+	log->index_fd = -1;
+	log->sequence++;
+}
+
+static bool ow_log_write_full(int fd, const void* buf, size_t length)
+{
+	const uint8_t* bytes = buf;
+
+	while (length > 0)
+	{
+		ssize_t written = write(fd, bytes, length);
+
+		if (written < 0)
+		{
+			if (errno == EINTR)
+			{
+				continue;
+			}
+
+			return false;
+		}
+
+		bytes += written;
+		length -= (size_t)written;
+	}
+
+	return true;
+}
+
+static int ow_log_select_segment(const struct dirent* entry)
+{
+	unsigned int sequence;
+	return ow_log_parse_sequence(entry->d_name, &sequence);
+}
+
+static bool ow_log_map_segment(const char* dir_path, const char* name, ow_log_segment_t* segment, bool* is_valid)
+{
+	memset(segment, 0, sizeof(ow_log_segment_t));
+	*is_valid = false;
+
+	//Map the data file:
+	char path[PATH_MAX];
+
+	if (snprintf(path, sizeof(path), "%s/%s", dir_path, name) >= (int)sizeof(path))
+	{
+		errno = ENAMETOOLONG;
+		return false;
+	}
+
+	int fd = open(path, O_RDONLY | O_CLOEXEC);
+
+	if (fd < 0)
+	{
+		return false;
+	}
+
+	struct stat stat_buf;
+
+	if (fstat(fd, &stat_buf) != 0)
+	{
+		int error = errno;
+		close(fd);
+
+		errno = error;
+		return false;
+	}
+
+	//Too short for a header and a record? Then there is nothing to map.
+	if ((size_t)stat_buf.st_size < (sizeof(ow_log_header_t) + sizeof(ow_log_record_t)))
+	{
+		close(fd);
+		return true;
+	}
+
+	segment->data_length = (size_t)stat_buf.st_size;
+	segment->data_map = mmap(NULL, segment->data_length, PROT_READ, MAP_SHARED, fd, 0);
+
+	close(fd);
+
+	if (segment->data_map == MAP_FAILED)
+	{
+		segment->data_map = NULL;
+		return false;
+	}
+
+	//Validate the header:
+	const ow_log_header_t* header = segment->data_map;
+
+	if ((memcmp(header->magic, OW_LOG_MAGIC, OW_LOG_MAGIC_LENGTH) != 0) || (header->version != OW_LOG_VERSION) || (header->record_size != sizeof(ow_log_record_t)))
+	{
+		ow_log_unmap_segment(segment);
+		return true;
+	}
+
+	//A partially written last record (e. g. after a crash) is ignored:
+	segment->records = (const ow_log_record_t*)((const uint8_t*)segment->data_map + sizeof(ow_log_header_t));
+	segment->record_count = (segment->data_length - sizeof(ow_log_header_t)) / sizeof(ow_log_record_t);
+
+	*is_valid = true;
+
+	//Map the index (a missing or empty index only makes queries touch more pages):
+	size_t name_length = strlen(path);
+	memcpy(&path[name_length - strlen(OW_LOG_INDEX_SUFFIX)], OW_LOG_INDEX_SUFFIX, strlen(OW_LOG_INDEX_SUFFIX));
+
+	fd = open(path, O_RDONLY | O_CLOEXEC);
+
+	if (fd < 0)
+	{
+		return true;
+	}
+
+	if ((fstat(fd, &stat_buf) == 0) && ((size_t)stat_buf.st_size >= sizeof(ow_log_index_entry_t)))
+	{
+		void* index_map = mmap(NULL, (size_t)stat_buf.st_size, PROT_READ, MAP_SHARED, fd, 0);
+
+		if (index_map != MAP_FAILED)
+		{
+			segment->index_map = index_map;
+			segment->index_length = (size_t)stat_buf.st_size;
+			segment->index_entries = index_map;
+			segment->index_entry_count = segment->index_length / sizeof(ow_log_index_entry_t);
+
+			//The index can be ahead of the records after a crash:
+			while ((segment->index_entry_count > 0) && (segment->index_entries[segment->index_entry_count - 1].record >= segment->record_count))
+			{
+				segment->index_entry_count--;
+			}
+		}
+	}
+
+	close(fd);
+	return true;
+}
+
+static void ow_log_unmap_segment(ow_log_segment_t* segment)
+{
+	if (segment->data_map)
+	{
+		munmap(segment->data_map, segment->data_length);
+	}
+
+	if (segment->index_map)
+	{
+		munmap(segment->index_map, segment->index_length);
+	}
+
+	memset(segment, 0, sizeof(ow_log_segment_t));
+}
+
+static size_t ow_log_lower_bound(const ow_log_segment_t* segment, int64_t t0)
+{
+	//Narrow the range down with the index first, so only a few pages of records are touched:
+	size_t low = 0;
+	size_t high = segment->record_count;
+
+	size_t index_low = 0;
+	size_t index_high = segment->index_entry_count;
+
+	while (index_low < index_high)
+	{
+		size_t middle = index_low + (index_high - index_low) / 2;
+
+		if (segment->index_entries[middle].timestamp_ns < t0)
+		{
+			index_low = middle + 1;
+		}
+		else
+		{
+			index_high = middle;
+		}
+	}
+
+	//All entries before "index_low" are too old, the entry at "index_low" is not:
+	if (index_low > 0)
+	{
+		low = segment->index_entries[index_low - 1].record;
+	}
+
+	if (index_low < segment->index_entry_count)
+	{
+		high = segment->index_entries[index_low].record;
+	}
+
+	//Then search the records in between:
+	while (low < high)
+	{
+		size_t middle = low + (high - low) / 2;
+
+		if (segment->records[middle].timestamp_ns < t0)
+		{
+			low = middle + 1;
+		}
+		else
+		{
+			high = middle;
+		}
+	}
+
+	return low;
+}
+
+ow_log_t* ow_log_open(const char* dir_path, const ow_log_params* params)
+{
+	if (!params)
+	{
+		params = &automatic_log_params;
+	}
+
+	if ((params->segment_records == 0) || (params->index_interval == 0))
+	{
+		errno = EINVAL;
+		return NULL;
+	}
+
+	ow_log_t* log = malloc(sizeof(ow_log_t));
+
+	if (!log)
+	{
+		return NULL;
+	}
+
+	memset(log, 0, sizeof(ow_log_t));
+	log->params = *params;
+
+	if (snprintf(log->dir_path, sizeof(log->dir_path), "%s", dir_path) >= (int)sizeof(log->dir_path))
+	{
+		free(log);
+
+		errno = ENAMETOOLONG;
+		return NULL;
+	}
+
+	//Continue behind the last segment:
+	unsigned int last_sequence;
+	bool found;
+	int error;
+
+	if (!ow_log_last_sequence(dir_path, &last_sequence, &found))
+	{
+		error = errno;
+		goto free_out;
+	}
+
+	log->sequence = found ? (last_sequence + 1) : 0;
+
+	if (!ow_log_start_segment(log))
+	{
+		error = errno;
+		goto free_out;
+	}
+
+	return log;
+
+free_out:
+	free(log);
+
+	errno = error;
+	return NULL;
+}
+
+static bool ow_log_make_room(ow_log_t* log)
+{
+	//Starting the segment has failed before? Its records are all written, so try again:
+	if ((log->data_fd < 0) && !ow_log_start_segment(log))
+	{
+		return false;
+	}
+
+	bool is_segment_full = (log->segment_records >= log->params.segment_records);
+
+	if ((log->record_count == OW_LOG_BUFFER_RECORDS) || (log->index_entry_count == OW_LOG_BUFFER_RECORDS) || is_segment_full)
+	{
+		if (!ow_log_flush(log))
+		{
+			return false;
+		}
+	}
+
+	if (is_segment_full)
+	{
+		ow_log_end_segment(log);
+
+		//The next append tries again if this fails:
+		if (!ow_log_start_segment(log))
+		{
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool ow_log_append(ow_log_t* log, int64_t timestamp_ns, const ow_sample_t* sample)
+{
+	//Retry whatever has failed before (this does nothing if the last append has succeeded):
+	if (!ow_log_make_room(log))
+	{
+		return false;
+	}
+
+	//Keep the segment sorted:
+	if (log->has_last_timestamp && (timestamp_ns < log->last_timestamp_ns))
+	{
+		timestamp_ns = log->last_timestamp_ns;
+	}
+
+	log->has_last_timestamp = true;
+	log->last_timestamp_ns = timestamp_ns;
+
+	//Sparse index:
+	if ((log->segment_records % log->params.index_interval) == 0)
+	{
+		ow_log_index_entry_t* entry = &log->index_entries[log->index_entry_count++];
+
+		entry->timestamp_ns = timestamp_ns;
+		entry->record = log->segment_records;
+	}
+
+	//Buffer the record:
+	ow_log_record_t* record = &log->records[log->record_count++];
+
+	record->timestamp_ns = timestamp_ns;
+	ow_sample_pack(sample, &record->sample);
+
+	log->segment_records++;
+
+	//Write out full buffers and full segments:
+	return ow_log_make_room(log);
+}
+
+bool ow_log_sample_func(ow_sample_t sample, void* context)
+{
+	return ow_log_batch_func(&sample, 1, context);
+}
+
+bool ow_log_batch_func(const ow_sample_t* samples, size_t count, void* context)
+{
+	ow_log_t* log = context;
+
+	//Once broken, stay broken:
+	if (log->error != 0)
+	{
+		return false;
+	}
+
+	//Samples without receive time (e. g. decoded by hand) get the current time:
+	struct timespec now = { 0 };
+
+	for (size_t i = 0; i < count; i++)
+	{
+		const struct timespec* timestamp = &samples[i].timestamp;
+
+		if ((timestamp->tv_sec == 0) && (timestamp->tv_nsec == 0))
+		{
+			if ((now.tv_sec == 0) && (now.tv_nsec == 0))
+			{
+				clock_gettime(CLOCK_REALTIME, &now);
+			}
+
+			timestamp = &now;
+		}
+
+		if (!ow_log_append(log, (int64_t)timestamp->tv_sec * 1000000000 + timestamp->tv_nsec, &samples[i]))
+		{
+			log->error = errno;
+			return false;
+		}
+	}
+
+	return true;
+}
+
+bool ow_log_flush(ow_log_t* log)
+{
+	//A segment that is still to be started has nothing buffered yet:
+	if (log->data_fd < 0)
+	{
+		return true;
+	}
+
+	//Records first, so the index never points behind the data:
+	if (!ow_log_write_full(log->data_fd, log->records, log->record_count * sizeof(ow_log_record_t)))
+	{
+		return false;
+	}
+
+	log->record_count = 0;
+
+	if (!ow_log_write_full(log->index_fd, log->index_entries, log->index_entry_count * sizeof(ow_log_index_entry_t)))
+	{
+		return false;
+	}
+
+	log->index_entry_count = 0;
+
+	return true;
+}
+
+bool ow_log_close(ow_log_t* log)
+{
+	int error = log->error;
+
+	if (log->data_fd >= 0)
+	{
+		if (!ow_log_flush(log) && (error == 0))
+		{
+			error = errno;
+		}
+
+		ow_log_end_segment(log);
+	}
+
+	free(log);
+
+	if (error != 0)
+	{
+		errno = error;
+		return false;
+	}
+
+	return true;
+}
+
+ow_log_reader_t* ow_log_reader_open(const char* dir_path)
+{
+	ow_log_reader_t* reader = malloc(sizeof(ow_log_reader_t));
+
+	if (!reader)
+	{
+		return NULL;
+	}
+
+	//The zero-padded sequence numbers make alphabetical order the order of writing:
+	struct dirent** entries;
+	int entry_count = scandir(dir_path, &entries, ow_log_select_segment, alphasort);
+
+	if (entry_count < 0)
+	{
+		int error = errno;
+		free(reader);
+
+		errno = error;
+		return NULL;
+	}
+
+	reader->segment_count = 0;
+	reader->segments = calloc(entry_count > 0 ? (size_t)entry_count : 1, sizeof(ow_log_segment_t));
+
+	int error = 0;
+
+	if (!reader->segments)
+	{
+		error = errno;
+	}
+
+	for (int i = 0; i < entry_count; i++)
+	{
+		if (error == 0)
+		{
+			bool is_valid;
+
+			if (!ow_log_map_segment(dir_path, entries[i]->d_name, &reader->segments[reader->segment_count], &is_valid))
+			{
+				error = errno;
+			}
+			else if (is_valid)
+			{
+				reader->segment_count++;
+			}
+		}
+
+		free(entries[i]);
+	}
+
+	free(entries);
+
+	if (error != 0)
+	{
+		ow_log_reader_close(reader);
+
+		errno = error;
+		return NULL;
+	}
+
+	return reader;
+}
+
+size_t ow_log_query(const ow_log_reader_t* reader, int64_t t0, int64_t t1, ow_log_record_func_t callback, void* context)
+{
+	size_t count = 0;
+
+	for (size_t i = 0; i < reader->segment_count; i++)
+	{
+		const ow_log_segment_t* segment = &reader->segments[i];
+
+		//Skip segments that don't overlap:
+		if ((segment->records[0].timestamp_ns > t1) || (segment->records[segment->record_count - 1].timestamp_ns < t0))
+		{
+			continue;
+		}
+
+		//Provide the records up to t1:
+		for (size_t record = ow_log_lower_bound(segment, t0); (record < segment->record_count) && (segment->records[record].timestamp_ns <= t1); record++)
+		{
+			count++;
+
+			if (!callback(&segment->records[record], context))
+			{
+				return count;
+			}
+		}
+	}
+
+	return count;
+}
+
+void ow_log_reader_close(ow_log_reader_t* reader)
+{
+	if (reader->segments)
+	{
+		for (size_t i = 0; i < reader->segment_count; i++)
+		{
+			ow_log_unmap_segment(&reader->segments[i]);
+		}
+
+		free(reader->segments);
+	}
+
+	free(reader);
+}
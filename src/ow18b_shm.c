@@ -0,0 +1,528 @@
+//For memfd_create(...):
+#define _GNU_SOURCE
+
+#include "ow18b_shm.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+//Keep the fixed fields apart from the head the readers keep polling:
+#define OW_SHM_CACHE_LINE_SIZE 64
+
+//"OWSR" in memory order on little-endian machines:
+#define OW_SHM_MAGIC 0x5253574F
+
+//The start of the shared memory (followed by the slots):
+typedef struct __ow_shm_header_t__
+{
+	//Fixed after creation:
+	uint32_t magic;
+	uint32_t version;
+	uint64_t capacity;
+
+	//The position of the next sample (written by the publisher only):
+	uint64_t head __attribute__((aligned(OW_SHM_CACHE_LINE_SIZE)));
+
+	//Set once when the publisher is done:
+	int32_t error;
+	uint32_t is_finished;
+} ow_shm_header_t;
+
+//A slot of the ring.
+//The sequence works like a seqlock: It is "2 * position + 1" while the sample for a position is written and "2 * position + 2" afterwards.
+//The sample is stored packed with its receive time, so the layout doesn't depend on the compiler of the reader.
+typedef struct __ow_shm_slot_t__
+{
+	uint64_t sequence;
+	int64_t timestamp_ns;
+	ow_sample_packed_t sample;
+} ow_shm_slot_t;
+
+struct __ow_shm_ring_t__
+{
+	//The memfd and a read-only descriptor of it for the clients:
+	int fd;
+	int read_only_fd;
+
+	//The mapping:
+	ow_shm_header_t* header;
+	ow_shm_slot_t* slots;
+	size_t mapping_length;
+	uint64_t mask;
+};
+
+struct __ow_shm_client_t__
+{
+	//The read-only mapping:
+	const ow_shm_header_t* header;
+	const ow_shm_slot_t* slots;
+	size_t mapping_length;
+	uint64_t capacity;
+	uint64_t mask;
+
+	//The position of the next sample to read and the counters:
+	uint64_t position;
+	uint64_t received;
+	uint64_t dropped;
+};
+
+//The sequence of a slot once the sample at "position" is complete:
+static inline uint64_t ow_shm_sequence(uint64_t position);
+
+//Where a client continues after it has fallen behind by more than the capacity (the newer half of the ring, see ow18b_broadcast.c):
+static inline uint64_t ow_shm_resume_position(uint64_t capacity, uint64_t head);
+
+//The size of the shared memory for the given capacity:
+static size_t ow_shm_mapping_length(uint64_t capacity);
+
+//Ask the daemon for the ring of a meter and receive its descriptor.
+//Sets errno on error.
+static bool ow_shm_request(const char* socket_path, const char* name, int* ring_fd);
+
+static inline uint64_t ow_shm_sequence(uint64_t position)
+{
+	return 2 * position + 2;
+}
+
+static inline uint64_t ow_shm_resume_position(uint64_t capacity, uint64_t head)
+{
+	return head - (capacity / 2);
+}
+
+static size_t ow_shm_mapping_length(uint64_t capacity)
+{
+	return sizeof(ow_shm_header_t) + capacity * sizeof(ow_shm_slot_t);
+}
+
+static bool ow_shm_request(const char* socket_path, const char* name, int* ring_fd)
+{
+	struct sockaddr_un addr = { .sun_family = AF_UNIX };
+
+	if (strlen(socket_path) >= sizeof(addr.sun_path))
+	{
+		errno = ENAMETOOLONG;
+		return false;
+	}
+
+	strcpy(addr.sun_path, socket_path);
+
+	int sock = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+
+	if (sock < 0)
+	{
+		return false;
+	}
+
+	int error = 0;
+
+	if (connect(sock, (struct sockaddr*)&addr, sizeof(addr)) != 0)
+	{
+		error = errno;
+		goto close_out;
+	}
+
+	//Send the request:
+	ow_shm_request_t request = { .version = OW_SHM_VERSION };
+	strcpy(request.name, name);
+
+	if (send(sock, &request, sizeof(request), MSG_NOSIGNAL) != (ssize_t)sizeof(request))
+	{
+		error = (errno != 0) ? errno : EPROTO;
+		goto close_out;
+	}
+
+	//Receive the reply and the descriptor:
+	ow_shm_reply_t reply;
+	struct iovec iov = { .iov_base = &reply, .iov_len = sizeof(reply) };
+
+	union
+	{
+		struct cmsghdr header;
+		uint8_t buf[CMSG_SPACE(sizeof(int))];
+	} control;
+
+	struct msghdr msg =
+	{
+		.msg_iov = &iov,
+		.msg_iovlen = 1,
+		.msg_control = control.buf,
+		.msg_controllen = sizeof(control.buf)
+	};
+
+	ssize_t length = recvmsg(sock, &msg, MSG_CMSG_CLOEXEC);
+
+	if (length < 0)
+	{
+		error = errno;
+		goto close_out;
+	}
+
+	if (length != (ssize_t)sizeof(reply))
+	{
+		error = EPROTO;
+		goto close_out;
+	}
+
+	if (reply.error != 0)
+	{
+		error = reply.error;
+		goto close_out;
+	}
+
+	struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+
+	if (!cmsg || (cmsg->cmsg_level != SOL_SOCKET) || (cmsg->cmsg_type != SCM_RIGHTS) || (cmsg->cmsg_len != CMSG_LEN(sizeof(int))))
+	{
+		error = EPROTO;
+		goto close_out;
+	}
+
+	memcpy(ring_fd, CMSG_DATA(cmsg), sizeof(int));
+
+close_out:
+	close(sock);
+
+	if (error != 0)
+	{
+		errno = error;
+		return false;
+	}
+
+	return true;
+}
+
+ow_shm_ring_t* ow_shm_ring_create(const char* name, size_t capacity)
+{
+	if (capacity == 0)
+	{
+		errno = EINVAL;
+		return NULL;
+	}
+
+	//Round the capacity up to a power of two, so wrapping is a mask:
+	uint64_t rounded_capacity = 1;
+
+	while (rounded_capacity < capacity)
+	{
+		rounded_capacity <<= 1;
+	}
+
+	if (rounded_capacity > ((SIZE_MAX - sizeof(ow_shm_header_t)) / sizeof(ow_shm_slot_t)))
+	{
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	ow_shm_ring_t* ring = malloc(sizeof(ow_shm_ring_t));
+
+	if (!ring)
+	{
+		return NULL;
+	}
+
+	ring->mapping_length = ow_shm_mapping_length(rounded_capacity);
+	ring->mask = rounded_capacity - 1;
+
+	int error;
+	ring->fd = memfd_create(name, MFD_CLOEXEC | MFD_ALLOW_SEALING);
+
+	if (ring->fd < 0)
+	{
+		error = errno;
+		goto free_out;
+	}
+
+	//Fix the size, so no reader can be surprised by a shrinking mapping:
+	if ((ftruncate(ring->fd, (off_t)ring->mapping_length) != 0) || (fcntl(ring->fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW | F_SEAL_SEAL) != 0))
+	{
+		error = errno;
+		goto close_out;
+	}
+
+	//Clients only get a read-only descriptor, so they can't disturb each other:
+	char path[64];
+	snprintf(path, sizeof(path), "/proc/self/fd/%d", ring->fd);
+
+	ring->read_only_fd = open(path, O_RDONLY | O_CLOEXEC);
+
+	if (ring->read_only_fd < 0)
+	{
+		error = errno;
+		goto close_out;
+	}
+
+	//The memfd starts zeroed, so no slot matches any position yet:
+	void* mapping = mmap(NULL, ring->mapping_length, PROT_READ | PROT_WRITE, MAP_SHARED, ring->fd, 0);
+
+	if (mapping == MAP_FAILED)
+	{
+		error = errno;
+		close(ring->read_only_fd);
+		goto close_out;
+	}
+
+	ring->header = mapping;
+	ring->slots = (ow_shm_slot_t*)&ring->header[1];
+
+	ring->header->magic = OW_SHM_MAGIC;
+	ring->header->version = OW_SHM_VERSION;
+	ring->header->capacity = rounded_capacity;
+
+	return ring;
+
+close_out:
+	close(ring->fd);
+
+free_out:
+	free(ring);
+
+	errno = error;
+	return NULL;
+}
+
+void ow_shm_ring_publish(ow_shm_ring_t* ring, const ow_sample_t* samples, size_t count)
+{
+	ow_shm_header_t* header = ring->header;
+	uint64_t head = header->head;
+
+	for (size_t i = 0; i < count; i++)
+	{
+		ow_shm_slot_t* slot = &ring->slots[head & ring->mask];
+
+		//Mark the slot as being written before touching the sample:
+		__atomic_store_n(&slot->sequence, ow_shm_sequence(head) - 1, __ATOMIC_RELEASE);
+		__atomic_thread_fence(__ATOMIC_RELEASE);
+
+		slot->timestamp_ns = (int64_t)samples[i].timestamp.tv_sec * 1000000000 + samples[i].timestamp.tv_nsec;
+		ow_sample_pack(&samples[i], &slot->sample);
+
+		__atomic_store_n(&slot->sequence, ow_shm_sequence(head), __ATOMIC_RELEASE);
+
+		head++;
+		__atomic_store_n(&header->head, head, __ATOMIC_RELEASE);
+	}
+}
+
+void ow_shm_ring_finish(ow_shm_ring_t* ring, int error)
+{
+	__atomic_store_n(&ring->header->error, error, __ATOMIC_RELAXED);
+	__atomic_store_n(&ring->header->is_finished, 1, __ATOMIC_RELEASE);
+}
+
+bool ow_shm_ring_reply(const ow_shm_ring_t* ring, int socket_fd, int error)
+{
+	ow_shm_reply_t reply = { .error = error };
+	struct iovec iov = { .iov_base = &reply, .iov_len = sizeof(reply) };
+
+	union
+	{
+		struct cmsghdr header;
+		uint8_t buf[CMSG_SPACE(sizeof(int))];
+	} control;
+
+	struct msghdr msg =
+	{
+		.msg_iov = &iov,
+		.msg_iovlen = 1
+	};
+
+	//Only a successful reply carries the descriptor:
+	if ((error == 0) && ring)
+	{
+		memset(&control, 0, sizeof(control));
+
+		msg.msg_control = control.buf;
+		msg.msg_controllen = sizeof(control.buf);
+
+		struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+		cmsg->cmsg_level = SOL_SOCKET;
+		cmsg->cmsg_type = SCM_RIGHTS;
+		cmsg->cmsg_len = CMSG_LEN(sizeof(int));
+		memcpy(CMSG_DATA(cmsg), &ring->read_only_fd, sizeof(int));
+	}
+
+	return (sendmsg(socket_fd, &msg, MSG_NOSIGNAL) == (ssize_t)sizeof(reply));
+}
+
+void ow_shm_ring_destroy(ow_shm_ring_t* ring)
+{
+	munmap(ring->header, ring->mapping_length);
+	close(ring->read_only_fd);
+	close(ring->fd);
+	free(ring);
+}
+
+ow_shm_client_t* ow_shm_attach(const char* socket_path, const char* name)
+{
+	if (strlen(name) > OW_SHM_MAX_NAME_LENGTH)
+	{
+		errno = ENAMETOOLONG;
+		return NULL;
+	}
+
+	int ring_fd = -1;
+
+	if (!ow_shm_request(socket_path ? socket_path : OW_SHM_DEFAULT_SOCKET_PATH, name, &ring_fd))
+	{
+		return NULL;
+	}
+
+	int error;
+	ow_shm_client_t* client = malloc(sizeof(ow_shm_client_t));
+
+	if (!client)
+	{
+		error = errno;
+		goto close_out;
+	}
+
+	//Map the whole ring (read-only) and check that it is what we expect:
+	struct stat ring_stat;
+
+	if (fstat(ring_fd, &ring_stat) != 0)
+	{
+		error = errno;
+		goto free_out;
+	}
+
+	if ((size_t)ring_stat.st_size < sizeof(ow_shm_header_t))
+	{
+		error = EPROTO;
+		goto free_out;
+	}
+
+	client->mapping_length = (size_t)ring_stat.st_size;
+
+	void* mapping = mmap(NULL, client->mapping_length, PROT_READ, MAP_SHARED, ring_fd, 0);
+
+	if (mapping == MAP_FAILED)
+	{
+		error = errno;
+		goto free_out;
+	}
+
+	client->header = mapping;
+	client->slots = (const ow_shm_slot_t*)&client->header[1];
+	client->capacity = client->header->capacity;
+	client->mask = client->capacity - 1;
+
+	if ((client->header->magic != OW_SHM_MAGIC) || (client->header->version != OW_SHM_VERSION) ||
+		(client->capacity == 0) || ((client->capacity & client->mask) != 0) ||
+		(client->capacity > ((client->mapping_length - sizeof(ow_shm_header_t)) / sizeof(ow_shm_slot_t))))
+	{
+		error = EPROTO;
+		munmap(mapping, client->mapping_length);
+		goto free_out;
+	}
+
+	//The mapping stays valid without the descriptor:
+	close(ring_fd);
+
+	client->position = __atomic_load_n(&client->header->head, __ATOMIC_ACQUIRE);
+	client->received = 0;
+	client->dropped = 0;
+
+	return client;
+
+free_out:
+	free(client);
+
+close_out:
+	close(ring_fd);
+
+	errno = error;
+	return NULL;
+}
+
+size_t ow_shm_poll(ow_shm_client_t* client, ow_sample_t* samples, size_t max_samples)
+{
+	uint64_t head = __atomic_load_n(&client->header->head, __ATOMIC_ACQUIRE);
+	uint64_t position = client->position;
+	size_t count = 0;
+
+	//Too far behind? Older samples have been overwritten already.
+	if ((head - position) > client->capacity)
+	{
+		uint64_t resume = ow_shm_resume_position(client->capacity, head);
+
+		client->dropped += resume - position;
+		position = resume;
+	}
+
+	while ((count < max_samples) && (position != head))
+	{
+		const ow_shm_slot_t* slot = &client->slots[position & client->mask];
+		uint64_t sequence = ow_shm_sequence(position);
+
+		if (__atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE) == sequence)
+		{
+			int64_t timestamp_ns = slot->timestamp_ns;
+			ow_sample_packed_t packed = slot->sample;
+
+			//Has the publisher started to overwrite the slot while we were copying?
+			__atomic_thread_fence(__ATOMIC_ACQUIRE);
+
+			if (__atomic_load_n(&slot->sequence, __ATOMIC_ACQUIRE) == sequence)
+			{
+				ow_sample_unpack(&packed, &samples[count]);
+				samples[count].timestamp.tv_sec = (time_t)(timestamp_ns / 1000000000);
+				samples[count].timestamp.tv_nsec = (long)(timestamp_ns % 1000000000);
+
+				count++;
+				position++;
+
+				continue;
+			}
+		}
+
+		//We have been lapped:
+		head = __atomic_load_n(&client->header->head, __ATOMIC_ACQUIRE);
+
+		uint64_t resume = ow_shm_resume_position(client->capacity, head);
+		client->dropped += resume - position;
+		position = resume;
+	}
+
+	client->position = position;
+	client->received += count;
+
+	return count;
+}
+
+bool ow_shm_is_running(const ow_shm_client_t* client, int* error)
+{
+	if (!__atomic_load_n(&client->header->is_finished, __ATOMIC_ACQUIRE))
+	{
+		return true;
+	}
+
+	if (error)
+	{
+		*error = __atomic_load_n(&client->header->error, __ATOMIC_RELAXED);
+	}
+
+	return false;
+}
+
+void ow_shm_get_stats(const ow_shm_client_t* client, ow_shm_stats_t* stats)
+{
+	stats->capacity = client->capacity;
+	stats->received = client->received;
+	stats->dropped = client->dropped;
+}
+
+void ow_shm_detach(ow_shm_client_t* client)
+{
+	munmap((void*)client->header, client->mapping_length);
+	free(client);
+}
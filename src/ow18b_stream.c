@@ -0,0 +1,353 @@
+#include "ow18b_stream.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <unistd.h>
+
+#include <sys/eventfd.h>
+
+//Keep producer and consumer state on separate cache lines:
+#define OW_STREAM_CACHE_LINE_SIZE 64
+
+//How many samples the receiver thread decodes per wakeup at most:
+#define OW_STREAM_CHUNK_LENGTH 64
+
+struct __ow_stream_t__
+{
+	//Written by the producer only:
+	size_t head __attribute__((aligned(OW_STREAM_CACHE_LINE_SIZE)));
+	size_t cached_tail;
+	size_t high_water_mark;
+	uint64_t published;
+	uint64_t dropped;
+
+	//Written by the consumer only:
+	size_t tail __attribute__((aligned(OW_STREAM_CACHE_LINE_SIZE)));
+	size_t cached_head;
+
+	//Fixed after start:
+	ow_sample_t* ring __attribute__((aligned(OW_STREAM_CACHE_LINE_SIZE)));
+	size_t capacity;
+	size_t mask;
+
+	//The receiver thread, its session and an eventfd to wake it up for stopping:
+	ow_session_t session;
+	pthread_t thread;
+	int wake_fd;
+	bool shall_stop;
+
+	//Set by the receiver thread when it ends:
+	bool is_running;
+	int error;
+};
+
+//Allocate a stream with a ring of at least the given capacity.
+//Sets errno on error.
+static ow_stream_t* ow_stream_create(size_t capacity);
+
+//Free a stream that has no running thread:
+static void ow_stream_destroy(ow_stream_t* stream);
+
+//Start the receiver thread on the already opened session.
+//Frees the stream and sets errno on error.
+static ow_stream_t* ow_stream_launch(ow_stream_t* stream);
+
+//The receiver thread:
+static void* ow_stream_run(void* context);
+
+//Publish samples into the ring (dropping those that don't fit):
+static void ow_stream_publish(ow_stream_t* stream, const ow_sample_t* samples, size_t count);
+
+static ow_stream_t* ow_stream_create(size_t capacity)
+{
+	if (capacity == 0)
+	{
+		errno = EINVAL;
+		return NULL;
+	}
+
+	//Round the capacity up to a power of two, so wrapping is a mask:
+	size_t rounded_capacity = 1;
+
+	while (rounded_capacity < capacity)
+	{
+		rounded_capacity <<= 1;
+	}
+
+	//The struct is cache line aligned:
+	ow_stream_t* stream;
+	int error = posix_memalign((void**)&stream, OW_STREAM_CACHE_LINE_SIZE, sizeof(ow_stream_t));
+
+	if (error != 0)
+	{
+		errno = error;
+		return NULL;
+	}
+
+	memset(stream, 0, sizeof(ow_stream_t));
+
+	stream->capacity = rounded_capacity;
+	stream->mask = rounded_capacity - 1;
+	stream->ring = malloc(rounded_capacity * sizeof(ow_sample_t));
+
+	if (!stream->ring)
+	{
+		free(stream);
+		return NULL;
+	}
+
+	//The wakeup descriptor for stopping:
+	stream->wake_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+
+	if (stream->wake_fd < 0)
+	{
+		error = errno;
+
+		free(stream->ring);
+		free(stream);
+
+		errno = error;
+		return NULL;
+	}
+
+	return stream;
+}
+
+static void ow_stream_destroy(ow_stream_t* stream)
+{
+	close(stream->wake_fd);
+	free(stream->ring);
+	free(stream);
+}
+
+static ow_stream_t* ow_stream_launch(ow_stream_t* stream)
+{
+	stream->is_running = true;
+
+	int error = pthread_create(&stream->thread, NULL, ow_stream_run, stream);
+
+	if (error != 0)
+	{
+		ow_session_close(&stream->session);
+		ow_stream_destroy(stream);
+
+		errno = error;
+		return NULL;
+	}
+
+	return stream;
+}
+
+static void* ow_stream_run(void* context)
+{
+	ow_stream_t* stream = context;
+	int fd = ow_session_fd(&stream->session);
+	int error = 0;
+
+	while (!__atomic_load_n(&stream->shall_stop, __ATOMIC_ACQUIRE))
+	{
+		//Wait for frames or the stop signal (sources that can't be polled block in the read instead):
+		if (fd >= 0)
+		{
+			struct pollfd poll_fds[2] =
+			{
+				{ .fd = fd, .events = POLLIN },
+				{ .fd = stream->wake_fd, .events = POLLIN }
+			};
+
+			if (poll(poll_fds, 2, -1) < 0)
+			{
+				if (errno == EINTR)
+				{
+					continue;
+				}
+
+				error = errno;
+				break;
+			}
+
+			if (poll_fds[1].revents)
+			{
+				break;
+			}
+		}
+
+		//Decode whatever is ready and publish it:
+		ow_sample_t samples[OW_STREAM_CHUNK_LENGTH];
+		size_t count;
+
+		if (!ow_session_process(&stream->session, samples, OW_STREAM_CHUNK_LENGTH, &count))
+		{
+			error = errno;
+			break;
+		}
+
+		ow_stream_publish(stream, samples, count);
+	}
+
+	//Tell the consumer why we have stopped:
+	__atomic_store_n(&stream->error, error, __ATOMIC_RELAXED);
+	__atomic_store_n(&stream->is_running, false, __ATOMIC_RELEASE);
+
+	return NULL;
+}
+
+static void ow_stream_publish(ow_stream_t* stream, const ow_sample_t* samples, size_t count)
+{
+	size_t head = stream->head;
+	uint64_t dropped = 0;
+
+	for (size_t i = 0; i < count; i++)
+	{
+		//Full? Only then we have to look at the consumer's cache line.
+		if ((head - stream->cached_tail) == stream->capacity)
+		{
+			stream->cached_tail = __atomic_load_n(&stream->tail, __ATOMIC_ACQUIRE);
+
+			if ((head - stream->cached_tail) == stream->capacity)
+			{
+				dropped++;
+				continue;
+			}
+		}
+
+		stream->ring[head & stream->mask] = samples[i];
+		head++;
+	}
+
+	//Make the samples visible to the consumer:
+	__atomic_store_n(&stream->head, head, __ATOMIC_RELEASE);
+
+	//Update the counters (we are their only writer):
+	size_t waiting = head - __atomic_load_n(&stream->tail, __ATOMIC_ACQUIRE);
+
+	if (waiting > stream->high_water_mark)
+	{
+		__atomic_store_n(&stream->high_water_mark, waiting, __ATOMIC_RELAXED);
+	}
+
+	__atomic_store_n(&stream->published, stream->published + (count - dropped), __ATOMIC_RELAXED);
+	__atomic_store_n(&stream->dropped, stream->dropped + dropped, __ATOMIC_RELAXED);
+}
+
+ow_stream_t* ow_stream_start(const ow_config_t* config, size_t capacity)
+{
+	ow_stream_t* stream = ow_stream_create(capacity);
+
+	if (!stream)
+	{
+		return NULL;
+	}
+
+	//Connect on the caller's thread, so errors show up right here:
+	if (!ow_session_open(&stream->session, config))
+	{
+		int error = errno;
+		ow_stream_destroy(stream);
+
+		errno = error;
+		return NULL;
+	}
+
+	return ow_stream_launch(stream);
+}
+
+ow_stream_t* ow_stream_start_source(const ow_source_t* source, size_t capacity)
+{
+	ow_stream_t* stream = ow_stream_create(capacity);
+
+	if (!stream)
+	{
+		return NULL;
+	}
+
+	if (!ow_session_open_source(&stream->session, source))
+	{
+		int error = errno;
+		ow_stream_destroy(stream);
+
+		errno = error;
+		return NULL;
+	}
+
+	return ow_stream_launch(stream);
+}
+
+bool ow_stream_pop(ow_stream_t* stream, ow_sample_t* sample)
+{
+	return (ow_stream_pop_bulk(stream, sample, 1) == 1);
+}
+
+size_t ow_stream_pop_bulk(ow_stream_t* stream, ow_sample_t* samples, size_t max_samples)
+{
+	size_t tail = stream->tail;
+
+	//Only look at the producer's cache line if our cached view is not enough:
+	if ((stream->cached_head - tail) < max_samples)
+	{
+		stream->cached_head = __atomic_load_n(&stream->head, __ATOMIC_ACQUIRE);
+	}
+
+	size_t available = stream->cached_head - tail;
+	size_t count = (available < max_samples) ? available : max_samples;
+
+	//Copy in (at most) two parts because of wrapping:
+	size_t offset = tail & stream->mask;
+	size_t first_count = stream->capacity - offset;
+
+	if (first_count > count)
+	{
+		first_count = count;
+	}
+
+	memcpy(samples, &stream->ring[offset], first_count * sizeof(ow_sample_t));
+	memcpy(&samples[first_count], stream->ring, (count - first_count) * sizeof(ow_sample_t));
+
+	//Hand the slots back to the producer:
+	__atomic_store_n(&stream->tail, tail + count, __ATOMIC_RELEASE);
+
+	return count;
+}
+
+bool ow_stream_is_running(const ow_stream_t* stream, int* error)
+{
+	if (__atomic_load_n(&stream->is_running, __ATOMIC_ACQUIRE))
+	{
+		return true;
+	}
+
+	if (error)
+	{
+		*error = __atomic_load_n(&stream->error, __ATOMIC_RELAXED);
+	}
+
+	return false;
+}
+
+void ow_stream_get_stats(const ow_stream_t* stream, ow_stream_stats_t* stats)
+{
+	stats->capacity = stream->capacity;
+	stats->high_water_mark = __atomic_load_n(&stream->high_water_mark, __ATOMIC_RELAXED);
+	stats->published = __atomic_load_n(&stream->published, __ATOMIC_RELAXED);
+	stats->dropped = __atomic_load_n(&stream->dropped, __ATOMIC_RELAXED);
+}
+
+void ow_stream_stop(ow_stream_t* stream)
+{
+	//Signal the thread and wait for it:
+	__atomic_store_n(&stream->shall_stop, true, __ATOMIC_RELEASE);
+
+	uint64_t one = 1;
+	ssize_t written = write(stream->wake_fd, &one, sizeof(one));
+	(void)written;
+
+	pthread_join(stream->thread, NULL);
+
+	//Disconnect and clean up:
+	ow_session_close(&stream->session);
+	ow_stream_destroy(stream);
+}
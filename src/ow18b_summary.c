@@ -0,0 +1,447 @@
+#include "ow18b_summary.h"
+
+#include <errno.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+//The ratio between two bucket bounds:
+#define OW_SKETCH_GAMMA ((1.0 + OW_SKETCH_RELATIVE_ACCURACY) / (1.0 - OW_SKETCH_RELATIVE_ACCURACY))
+
+//Map an absolute value (> 0) to its bucket index resp. a bucket index to the value that represents it:
+static int32_t ow_sketch_index(double value);
+static double ow_sketch_value(int32_t index);
+
+//Find the lowest and highest used bucket of a (non-empty) store:
+static void ow_sketch_store_bounds(const ow_sketch_store_t* store, int32_t* low, int32_t* high);
+
+//Move the window of a store so it covers "low" to "high" (or the top of it if that range is too wide):
+static void ow_sketch_store_move(ow_sketch_store_t* store, int32_t low, int32_t high);
+
+//Count a bucket index "count" times:
+static void ow_sketch_store_add(ow_sketch_store_t* store, int32_t index, uint64_t count);
+
+//Add the counts of "source" to "store":
+static void ow_sketch_store_merge(ow_sketch_store_t* store, const ow_sketch_store_t* source);
+
+//Are two keys equal?
+static bool ow_summary_key_equals(const ow_summary_key_t* a, const ow_summary_key_t* b);
+
+//Find the stream of a key or allocate it:
+static ow_summary_stream_t* ow_summary_get_stream(ow_summary_t* summary, const ow_summary_key_t* key);
+
+static int32_t ow_sketch_index(double value)
+{
+	return (int32_t)ceil(log(value) / log(OW_SKETCH_GAMMA));
+}
+
+static double ow_sketch_value(int32_t index)
+{
+	//The bucket holds (gamma^(index - 1), gamma^index]. This is the value with the least relative error to both bounds:
+	return 2.0 * exp((double)index * log(OW_SKETCH_GAMMA)) / (OW_SKETCH_GAMMA + 1.0);
+}
+
+static void ow_sketch_store_bounds(const ow_sketch_store_t* store, int32_t* low, int32_t* high)
+{
+	int32_t i = 0;
+	int32_t j = OW_SKETCH_BUCKET_COUNT - 1;
+
+	while (store->counts[i] == 0)
+	{
+		i++;
+	}
+
+	while (store->counts[j] == 0)
+	{
+		j--;
+	}
+
+	*low = store->offset + i;
+	*high = store->offset + j;
+}
+
+static void ow_sketch_store_move(ow_sketch_store_t* store, int32_t low, int32_t high)
+{
+	int32_t offset;
+
+	if ((high - low) < OW_SKETCH_BUCKET_COUNT)
+	{
+		//Everything fits, keep the same space below and above:
+		offset = low - (OW_SKETCH_BUCKET_COUNT - 1 - (high - low)) / 2;
+	}
+	else
+	{
+		//Keep the largest values, the smallest ones end up in the lowest bucket:
+		offset = high - (OW_SKETCH_BUCKET_COUNT - 1);
+	}
+
+	int32_t shift = offset - store->offset;
+
+	if (shift > 0)
+	{
+		//Everything that drops out of the window is merged into the lowest bucket:
+		uint64_t collapsed = 0;
+		int32_t kept = (shift < OW_SKETCH_BUCKET_COUNT) ? (OW_SKETCH_BUCKET_COUNT - shift) : 0;
+
+		for (int32_t i = 0; i < OW_SKETCH_BUCKET_COUNT - kept; i++)
+		{
+			collapsed += store->counts[i];
+		}
+
+		memmove(store->counts, &store->counts[OW_SKETCH_BUCKET_COUNT - kept], (size_t)kept * sizeof(uint64_t));
+		memset(&store->counts[kept], 0, (size_t)(OW_SKETCH_BUCKET_COUNT - kept) * sizeof(uint64_t));
+
+		store->counts[0] += collapsed;
+	}
+	else if (shift < 0)
+	{
+		//Moving down never drops anything, because "high" still fits:
+		int32_t kept = (-shift < OW_SKETCH_BUCKET_COUNT) ? (OW_SKETCH_BUCKET_COUNT + shift) : 0;
+
+		memmove(&store->counts[OW_SKETCH_BUCKET_COUNT - kept], store->counts, (size_t)kept * sizeof(uint64_t));
+		memset(store->counts, 0, (size_t)(OW_SKETCH_BUCKET_COUNT - kept) * sizeof(uint64_t));
+	}
+
+	store->offset = offset;
+}
+
+static void ow_sketch_store_add(ow_sketch_store_t* store, int32_t index, uint64_t count)
+{
+	if (store->count == 0)
+	{
+		//Start with the index in the middle of the window:
+		ow_sketch_store_move(store, index, index);
+	}
+	else if ((index < store->offset) || (index >= (store->offset + OW_SKETCH_BUCKET_COUNT)))
+	{
+		int32_t low, high;
+		ow_sketch_store_bounds(store, &low, &high);
+
+		ow_sketch_store_move(store, (index < low) ? index : low, (index > high) ? index : high);
+	}
+
+	//If the index is still below the window, the range is too wide and it goes to the lowest bucket:
+	int32_t bucket = index - store->offset;
+
+	store->counts[(bucket < 0) ? 0 : bucket] += count;
+	store->count += count;
+}
+
+static void ow_sketch_store_merge(ow_sketch_store_t* store, const ow_sketch_store_t* source)
+{
+	if (source->count == 0)
+	{
+		return;
+	}
+
+	if (store->count == 0)
+	{
+		memcpy(store, source, sizeof(ow_sketch_store_t));
+		return;
+	}
+
+	//Make room for both ranges at once:
+	int32_t low, high, source_low, source_high;
+
+	ow_sketch_store_bounds(store, &low, &high);
+	ow_sketch_store_bounds(source, &source_low, &source_high);
+
+	if ((source_low < store->offset) || (source_high >= (store->offset + OW_SKETCH_BUCKET_COUNT)))
+	{
+		ow_sketch_store_move(store, (source_low < low) ? source_low : low, (source_high > high) ? source_high : high);
+	}
+
+	for (int32_t i = 0; i < OW_SKETCH_BUCKET_COUNT; i++)
+	{
+		if (source->counts[i] != 0)
+		{
+			int32_t bucket = source->offset + i - store->offset;
+			store->counts[(bucket < 0) ? 0 : bucket] += source->counts[i];
+		}
+	}
+
+	store->count += source->count;
+}
+
+void ow_sketch_init(ow_sketch_t* sketch)
+{
+	memset(sketch, 0, sizeof(ow_sketch_t));
+}
+
+void ow_sketch_add(ow_sketch_t* sketch, double value)
+{
+	if (value > 0.0)
+	{
+		ow_sketch_store_add(&sketch->positive, ow_sketch_index(value), 1);
+	}
+	else if (value < 0.0)
+	{
+		ow_sketch_store_add(&sketch->negative, ow_sketch_index(-value), 1);
+	}
+	else
+	{
+		sketch->zero_count++;
+	}
+}
+
+void ow_sketch_merge(ow_sketch_t* sketch, const ow_sketch_t* source)
+{
+	ow_sketch_store_merge(&sketch->positive, &source->positive);
+	ow_sketch_store_merge(&sketch->negative, &source->negative);
+
+	sketch->zero_count += source->zero_count;
+}
+
+uint64_t ow_sketch_count(const ow_sketch_t* sketch)
+{
+	return sketch->negative.count + sketch->zero_count + sketch->positive.count;
+}
+
+double ow_sketch_quantile(const ow_sketch_t* sketch, double quantile)
+{
+	uint64_t count = ow_sketch_count(sketch);
+
+	if (count == 0)
+	{
+		return NAN;
+	}
+
+	//The (zero-based) rank of the wanted value:
+	double rank = quantile * (double)(count - 1);
+	uint64_t wanted = (rank <= 0.0) ? 0 : (rank >= (double)(count - 1)) ? (count - 1) : (uint64_t)rank;
+
+	//Negative values first, the largest absolute values are the smallest ones:
+	uint64_t seen = 0;
+
+	if (sketch->negative.count > 0)
+	{
+		for (int32_t i = OW_SKETCH_BUCKET_COUNT - 1; i >= 0; i--)
+		{
+			seen += sketch->negative.counts[i];
+
+			if (seen > wanted)
+			{
+				return -ow_sketch_value(sketch->negative.offset + i);
+			}
+		}
+	}
+
+	seen += sketch->zero_count;
+
+	if (seen > wanted)
+	{
+		return 0.0;
+	}
+
+	for (int32_t i = 0; i < OW_SKETCH_BUCKET_COUNT; i++)
+	{
+		seen += sketch->positive.counts[i];
+
+		if (seen > wanted)
+		{
+			return ow_sketch_value(sketch->positive.offset + i);
+		}
+	}
+
+	//Unreachable as long as the counts are consistent:
+	return NAN;
+}
+
+static bool ow_summary_key_equals(const ow_summary_key_t* a, const ow_summary_key_t* b)
+{
+	return (a->unit == b->unit) &&
+		(a->current_type == b->current_type) &&
+		(a->is_diode_test == b->is_diode_test) &&
+		(a->is_continuity_test == b->is_continuity_test) &&
+		(a->is_relative == b->is_relative);
+}
+
+static ow_summary_stream_t* ow_summary_get_stream(ow_summary_t* summary, const ow_summary_key_t* key)
+{
+	//There are only a handful of keys, a linear search is fine:
+	for (size_t i = 0; i < summary->stream_count; i++)
+	{
+		if (ow_summary_key_equals(&summary->streams[i]->key, key))
+		{
+			return summary->streams[i];
+		}
+	}
+
+	if (summary->stream_count == OW_SUMMARY_MAX_STREAMS)
+	{
+		errno = ENOSPC;
+		return NULL;
+	}
+
+	ow_summary_stream_t* stream = malloc(sizeof(ow_summary_stream_t));
+
+	if (!stream)
+	{
+		return NULL;
+	}
+
+	stream->key = *key;
+	stream->count = 0;
+	stream->overflows = 0;
+	stream->min = INFINITY;
+	stream->max = -INFINITY;
+	stream->mean = 0.0;
+	stream->m2 = 0.0;
+
+	ow_sketch_init(&stream->sketch);
+
+	summary->streams[summary->stream_count++] = stream;
+	return stream;
+}
+
+void ow_summary_init(ow_summary_t* summary)
+{
+	summary->stream_count = 0;
+	summary->unknown_units = 0;
+}
+
+void ow_summary_destroy(ow_summary_t* summary)
+{
+	for (size_t i = 0; i < summary->stream_count; i++)
+	{
+		free(summary->streams[i]);
+	}
+
+	summary->stream_count = 0;
+}
+
+bool ow_summary_add(ow_summary_t* summary, const ow_sample_t* sample)
+{
+	if (sample->unit == OW_UNIT_UNKNOWN)
+	{
+		summary->unknown_units++;
+		return true;
+	}
+
+	ow_summary_key_t key;
+	ow_summary_key_from_sample(sample, &key);
+
+	ow_summary_stream_t* stream = ow_summary_get_stream(summary, &key);
+
+	if (!stream)
+	{
+		return false;
+	}
+
+	if (sample->is_overflow || isnan(sample->value))
+	{
+		stream->overflows++;
+		return true;
+	}
+
+	double value = ow_unit_to_base_value(sample->unit, sample->value);
+
+	//Welford's update of mean and squared differences:
+	stream->count++;
+
+	double delta = value - stream->mean;
+	stream->mean += delta / (double)stream->count;
+	stream->m2 += delta * (value - stream->mean);
+
+	if (value < stream->min)
+	{
+		stream->min = value;
+	}
+
+	if (value > stream->max)
+	{
+		stream->max = value;
+	}
+
+	ow_sketch_add(&stream->sketch, value);
+	return true;
+}
+
+bool ow_summary_sample_func(ow_sample_t sample, void* context)
+{
+	return ow_summary_add(context, &sample);
+}
+
+bool ow_summary_merge(ow_summary_t* summary, const ow_summary_t* source)
+{
+	summary->unknown_units += source->unknown_units;
+
+	for (size_t i = 0; i < source->stream_count; i++)
+	{
+		const ow_summary_stream_t* source_stream = source->streams[i];
+		ow_summary_stream_t* stream = ow_summary_get_stream(summary, &source_stream->key);
+
+		if (!stream)
+		{
+			return false;
+		}
+
+		stream->overflows += source_stream->overflows;
+
+		if (source_stream->count == 0)
+		{
+			continue;
+		}
+
+		//Chan et al.: combine the means and squared differences of both parts.
+		uint64_t count = stream->count + source_stream->count;
+		double delta = source_stream->mean - stream->mean;
+
+		stream->mean += delta * (double)source_stream->count / (double)count;
+		stream->m2 += source_stream->m2 + delta * delta * (double)stream->count * (double)source_stream->count / (double)count;
+		stream->count = count;
+
+		if (source_stream->min < stream->min)
+		{
+			stream->min = source_stream->min;
+		}
+
+		if (source_stream->max > stream->max)
+		{
+			stream->max = source_stream->max;
+		}
+
+		ow_sketch_merge(&stream->sketch, &source_stream->sketch);
+	}
+
+	return true;
+}
+
+void ow_summary_key_from_sample(const ow_sample_t* sample, ow_summary_key_t* key)
+{
+	key->unit = ow_unit_to_base_unit(sample->unit);
+	key->current_type = sample->current_type;
+	key->is_diode_test = sample->is_diode_test;
+	key->is_continuity_test = sample->is_continuity_test;
+	key->is_relative = sample->is_relative;
+}
+
+const ow_summary_stream_t* ow_summary_find(const ow_summary_t* summary, const ow_summary_key_t* key)
+{
+	for (size_t i = 0; i < summary->stream_count; i++)
+	{
+		if (ow_summary_key_equals(&summary->streams[i]->key, key))
+		{
+			return summary->streams[i];
+		}
+	}
+
+	return NULL;
+}
+
+double ow_summary_stream_variance(const ow_summary_stream_t* stream)
+{
+	return (stream->count >= 2) ? (stream->m2 / (double)(stream->count - 1)) : NAN;
+}
+
+double ow_summary_stream_quantile(const ow_summary_stream_t* stream, double quantile)
+{
+	double value = ow_sketch_quantile(&stream->sketch, quantile);
+
+	if (isnan(value))
+	{
+		return value;
+	}
+
+	return (value < stream->min) ? stream->min : (value > stream->max) ? stream->max : value;
+}
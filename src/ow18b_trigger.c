@@ -0,0 +1,528 @@
+#include "ow18b_trigger.h"
+
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <errno.h>
+
+//All flags a condition can watch:
+#define OW_TRIGGER_FLAGS_MASK (OW_FLAGS_MASK | OW_TRIGGER_FLAG_OVERFLOW)
+
+//What the instructions of a program read from a sample (nothing else is decoded):
+#define OW_TRIGGER_NEED_UNIT (1 << 0)
+#define OW_TRIGGER_NEED_MODE (1 << 1)
+#define OW_TRIGGER_NEED_VALUE (1 << 2)
+#define OW_TRIGGER_NEED_RATE (1 << 3)
+
+//The opcodes of a program.
+//Conditions are lowered to fewer opcodes: Falling thresholds run the code of rising ones on the negated value, cleared flags the code of set ones on the inverted flags.
+typedef enum __ow_trigger_opcode_t__
+{
+	OW_TRIGGER_OP_THRESHOLD,
+	OW_TRIGGER_OP_RATE,
+	OW_TRIGGER_OP_UNIT,
+	OW_TRIGGER_OP_MODE,
+	OW_TRIGGER_OP_FLAGS
+} ow_trigger_opcode_t;
+
+//The state of a threshold resp. rate instruction:
+typedef enum __ow_trigger_state_t__
+{
+	OW_TRIGGER_STATE_UNKNOWN,
+	OW_TRIGGER_STATE_INACTIVE,
+	OW_TRIGGER_STATE_ACTIVE
+} ow_trigger_state_t;
+
+//An instruction of a program:
+typedef struct __ow_trigger_instruction_t__
+{
+	ow_trigger_opcode_t opcode;
+
+	//The index of the condition it has been compiled from:
+	size_t condition;
+
+	//Thresholds and rates: The instruction becomes active above "enter" and inactive below "leave" (both apply to "sign * value").
+	//Levels fire with every sample while active, edges only when they become active.
+	ow_quantity_t quantity;
+	double sign;
+	double enter;
+	double leave;
+	bool is_level;
+	ow_trigger_state_t state;
+
+	//Flags: Fire if one of "flag_mask" goes from 0 to 1 after XOR with "flag_invert":
+	uint8_t flag_mask;
+	uint8_t flag_invert;
+} ow_trigger_instruction_t;
+
+//What the program reads from a sample (only the parts in "needs" are valid):
+typedef struct __ow_trigger_input_t__
+{
+	ow_unit_t unit;
+	uint32_t mode;
+	ow_quantity_t quantity;
+	double value;
+	double rate;
+	uint8_t flags;
+	struct timespec timestamp;
+} ow_trigger_input_t;
+
+struct __ow_trigger_t__
+{
+	//The program, which inputs it needs and the quantities its thresholds and rates watch (one bit each):
+	ow_trigger_instruction_t* instructions;
+	size_t count;
+	unsigned int needs;
+	uint32_t quantities;
+
+	//The previous sample:
+	bool has_previous;
+	ow_unit_t previous_unit;
+	uint32_t previous_mode;
+	uint8_t previous_flags;
+
+	//The previous value that has not been an overflow (for rates):
+	bool has_previous_value;
+	ow_quantity_t previous_quantity;
+	double previous_value;
+	struct timespec previous_timestamp;
+};
+
+//Internally used for ow_recv_trigger(...):
+typedef struct __ow_trigger_recv_context_t__
+{
+	ow_trigger_t* trigger;
+	ow_trigger_func_t callback;
+	void* context;
+} ow_trigger_recv_context_t;
+
+//Compile a condition into an instruction. Returns false if it is malformed.
+static bool ow_trigger_compile(const ow_condition_t* condition, size_t index, ow_trigger_instruction_t* instruction);
+
+//Get the mode of a sample as a single word, so a change is one compare:
+static uint32_t ow_trigger_mode(ow_quantity_t quantity, ow_current_type_t current_type, bool is_diode_test, bool is_continuity_test, bool is_relative);
+
+//Fill in the quantity and the value of an input from its unit and the displayed value of "sample" resp. "view":
+static void ow_trigger_input_value(const ow_trigger_t* trigger, ow_trigger_input_t* input, const ow_sample_t* sample, const ow_frame_view_t* view);
+
+//Fill in the rate of an input and remember its value for the next one:
+static void ow_trigger_input_rate(ow_trigger_t* trigger, ow_trigger_input_t* input);
+
+//Run the program on an input. The event sample is taken from "sample" or decoded from "view" on the first event.
+static bool ow_trigger_run(ow_trigger_t* trigger, const ow_trigger_input_t* input, const ow_sample_t* sample, const ow_frame_view_t* view, ow_trigger_func_t callback, void* context);
+
+//Advance a threshold resp. rate instruction. Returns true if it fires.
+static bool ow_trigger_step(ow_trigger_instruction_t* instruction, double value);
+
+//The frame view func for ow_recv_trigger(...):
+static bool ow_trigger_view_func(const ow_frame_view_t* view, void* context);
+
+static bool ow_trigger_compile(const ow_condition_t* condition, size_t index, ow_trigger_instruction_t* instruction)
+{
+	memset(instruction, 0, sizeof(ow_trigger_instruction_t));
+
+	instruction->condition = index;
+	instruction->state = OW_TRIGGER_STATE_UNKNOWN;
+
+	switch (condition->type)
+	{
+	case OW_CONDITION_ABOVE:
+	case OW_CONDITION_BELOW:
+	case OW_CONDITION_RISING:
+	case OW_CONDITION_FALLING:
+	case OW_CONDITION_RATE:
+		if (((unsigned int)condition->quantity >= OW_QUANTITY_UNKNOWN) || isnan(condition->threshold) || !(condition->hysteresis >= 0.0))
+		{
+			return false;
+		}
+
+		instruction->quantity = condition->quantity;
+		instruction->is_level = (condition->type == OW_CONDITION_ABOVE) || (condition->type == OW_CONDITION_BELOW);
+
+		//Rates are compared by their absolute value:
+		if (condition->type == OW_CONDITION_RATE)
+		{
+			instruction->opcode = OW_TRIGGER_OP_RATE;
+			instruction->sign = 1.0;
+		}
+		else
+		{
+			bool is_falling = (condition->type == OW_CONDITION_BELOW) || (condition->type == OW_CONDITION_FALLING);
+
+			instruction->opcode = OW_TRIGGER_OP_THRESHOLD;
+			instruction->sign = is_falling ? -1.0 : 1.0;
+		}
+
+		instruction->enter = instruction->sign * condition->threshold;
+		instruction->leave = instruction->enter - condition->hysteresis;
+		return true;
+
+	case OW_CONDITION_UNIT_CHANGE:
+		instruction->opcode = OW_TRIGGER_OP_UNIT;
+		return true;
+
+	case OW_CONDITION_MODE_CHANGE:
+		instruction->opcode = OW_TRIGGER_OP_MODE;
+		return true;
+
+	case OW_CONDITION_FLAG_SET:
+	case OW_CONDITION_FLAG_CLEARED:
+		if ((condition->flags == 0) || (condition->flags & ~OW_TRIGGER_FLAGS_MASK))
+		{
+			return false;
+		}
+
+		instruction->opcode = OW_TRIGGER_OP_FLAGS;
+		instruction->flag_mask = condition->flags;
+		instruction->flag_invert = (condition->type == OW_CONDITION_FLAG_CLEARED) ? OW_TRIGGER_FLAGS_MASK : 0;
+		return true;
+
+	default:
+		return false;
+	}
+}
+
+static uint32_t ow_trigger_mode(ow_quantity_t quantity, ow_current_type_t current_type, bool is_diode_test, bool is_continuity_test, bool is_relative)
+{
+	return (uint32_t)quantity | ((uint32_t)current_type << 8) | ((uint32_t)is_diode_test << 16) | ((uint32_t)is_continuity_test << 17) | ((uint32_t)is_relative << 18);
+}
+
+static void ow_trigger_input_value(const ow_trigger_t* trigger, ow_trigger_input_t* input, const ow_sample_t* sample, const ow_frame_view_t* view)
+{
+	input->quantity = ow_unit_to_quantity(input->unit);
+
+	//Values that no instruction looks at are neither decoded nor converted:
+	if (!(trigger->quantities & (1u << input->quantity)))
+	{
+		input->value = NAN;
+		return;
+	}
+
+	//Only the unit, the value and the relative mode matter for the conversion:
+	ow_sample_t value_sample =
+	{
+		.unit = input->unit,
+		.value = sample ? sample->value : ow_frame_view_value(view),
+		.is_relative = sample ? sample->is_relative : ow_frame_view_is_relative(view)
+	};
+	ow_normalized_sample_t normalized;
+	ow_normalize(&value_sample, 1, &normalized);
+
+	input->value = normalized.value;
+}
+
+static void ow_trigger_input_rate(ow_trigger_t* trigger, ow_trigger_input_t* input)
+{
+	input->rate = NAN;
+
+	//A new quantity starts over:
+	if (trigger->has_previous_value && (trigger->previous_quantity != input->quantity))
+	{
+		trigger->has_previous_value = false;
+	}
+
+	//Overflows are skipped:
+	if (isnan(input->value))
+	{
+		return;
+	}
+
+	if (trigger->has_previous_value)
+	{
+		double seconds = (double)(input->timestamp.tv_sec - trigger->previous_timestamp.tv_sec) + (double)(input->timestamp.tv_nsec - trigger->previous_timestamp.tv_nsec) * 1e-9;
+
+		//Without a time difference (e. g. samples without timestamps), there is no rate:
+		if (seconds > 0.0)
+		{
+			input->rate = (input->value - trigger->previous_value) / seconds;
+		}
+	}
+
+	trigger->has_previous_value = true;
+	trigger->previous_quantity = input->quantity;
+	trigger->previous_value = input->value;
+	trigger->previous_timestamp = input->timestamp;
+}
+
+static bool ow_trigger_step(ow_trigger_instruction_t* instruction, double value)
+{
+	bool was_active = (instruction->state == OW_TRIGGER_STATE_ACTIVE);
+	double signed_value = instruction->sign * value;
+
+	//Between "leave" and "enter", the state is kept (hysteresis):
+	if (signed_value > instruction->enter)
+	{
+		instruction->state = OW_TRIGGER_STATE_ACTIVE;
+	}
+	else if ((signed_value < instruction->leave) || (instruction->state == OW_TRIGGER_STATE_UNKNOWN))
+	{
+		instruction->state = OW_TRIGGER_STATE_INACTIVE;
+	}
+
+	return (instruction->state == OW_TRIGGER_STATE_ACTIVE) && (instruction->is_level || !was_active);
+}
+
+static bool ow_trigger_run(ow_trigger_t* trigger, const ow_trigger_input_t* input, const ow_sample_t* sample, const ow_frame_view_t* view, ow_trigger_func_t callback, void* context)
+{
+	bool result = true;
+	bool has_event = false;
+	ow_trigger_event_t event;
+
+	for (size_t i = 0; i < trigger->count; i++)
+	{
+		ow_trigger_instruction_t* instruction = &trigger->instructions[i];
+		bool does_fire = false;
+		double value = NAN;
+
+		switch (instruction->opcode)
+		{
+		case OW_TRIGGER_OP_THRESHOLD:
+		case OW_TRIGGER_OP_RATE:
+			//Another quantity starts over, overflows (and missing rates) are skipped:
+			if (input->quantity != instruction->quantity)
+			{
+				instruction->state = OW_TRIGGER_STATE_UNKNOWN;
+				break;
+			}
+
+			value = (instruction->opcode == OW_TRIGGER_OP_RATE) ? input->rate : input->value;
+
+			if (!isnan(value))
+			{
+				does_fire = ow_trigger_step(instruction, (instruction->opcode == OW_TRIGGER_OP_RATE) ? fabs(value) : value);
+			}
+
+			break;
+
+		case OW_TRIGGER_OP_UNIT:
+			does_fire = trigger->has_previous && (input->unit != trigger->previous_unit);
+			break;
+
+		case OW_TRIGGER_OP_MODE:
+			does_fire = trigger->has_previous && (input->mode != trigger->previous_mode);
+			break;
+
+		case OW_TRIGGER_OP_FLAGS:
+		{
+			uint8_t flags = input->flags ^ instruction->flag_invert;
+			uint8_t previous_flags = trigger->previous_flags ^ instruction->flag_invert;
+
+			does_fire = (flags & ~previous_flags & instruction->flag_mask) != 0;
+			break;
+		}
+		}
+
+		//The remaining instructions still update their state after the callback has returned false:
+		if (!does_fire || !result)
+		{
+			continue;
+		}
+
+		//Decode the sample for the first event only:
+		if (!has_event)
+		{
+			if (sample)
+			{
+				event.sample = *sample;
+			}
+			else
+			{
+				ow_frame_view_decode(view, &event.sample);
+			}
+
+			has_event = true;
+		}
+
+		event.condition = instruction->condition;
+
+		if (instruction->opcode == OW_TRIGGER_OP_RATE)
+		{
+			event.value = value;
+		}
+		else
+		{
+			ow_normalized_sample_t normalized;
+			ow_normalize(&event.sample, 1, &normalized);
+
+			event.value = normalized.value;
+		}
+
+		result = callback(&event, context);
+	}
+
+	trigger->has_previous = true;
+	trigger->previous_unit = input->unit;
+	trigger->previous_mode = input->mode;
+	trigger->previous_flags = input->flags;
+
+	return result;
+}
+
+static bool ow_trigger_view_func(const ow_frame_view_t* view, void* context)
+{
+	ow_trigger_recv_context_t* recv_context = context;
+	ow_trigger_t* trigger = recv_context->trigger;
+
+	//Decode only what the program reads:
+	ow_trigger_input_t input =
+	{
+		.flags = ow_frame_view_flags(view) | (ow_frame_view_is_overflow(view) ? OW_TRIGGER_FLAG_OVERFLOW : 0),
+		.timestamp = view->timestamp
+	};
+
+	if (trigger->needs & OW_TRIGGER_NEED_UNIT)
+	{
+		input.unit = ow_frame_view_unit(view);
+	}
+
+	if (trigger->needs & OW_TRIGGER_NEED_MODE)
+	{
+		uint16_t unit_code = ow_frame_view_unit_code(view);
+
+		input.mode = ow_trigger_mode(ow_unit_to_quantity(input.unit), ow_unit_code_to_current_type(unit_code), ow_unit_code_is_diode_test(unit_code), ow_unit_code_is_continuity_test(unit_code), ow_frame_view_is_relative(view));
+	}
+
+	if (trigger->needs & OW_TRIGGER_NEED_VALUE)
+	{
+		ow_trigger_input_value(trigger, &input, NULL, view);
+	}
+
+	if (trigger->needs & OW_TRIGGER_NEED_RATE)
+	{
+		ow_trigger_input_rate(trigger, &input);
+	}
+
+	return ow_trigger_run(trigger, &input, NULL, view, recv_context->callback, recv_context->context);
+}
+
+ow_trigger_t* ow_trigger_create(const ow_condition_t* conditions, size_t count)
+{
+	if (count == 0)
+	{
+		errno = EINVAL;
+		return NULL;
+	}
+
+	ow_trigger_t* trigger = calloc(1, sizeof(ow_trigger_t));
+
+	if (!trigger)
+	{
+		return NULL;
+	}
+
+	trigger->instructions = calloc(count, sizeof(ow_trigger_instruction_t));
+
+	if (!trigger->instructions)
+	{
+		free(trigger);
+		return NULL;
+	}
+
+	trigger->count = count;
+
+	for (size_t i = 0; i < count; i++)
+	{
+		if (!ow_trigger_compile(&conditions[i], i, &trigger->instructions[i]))
+		{
+			ow_trigger_destroy(trigger);
+
+			errno = EINVAL;
+			return NULL;
+		}
+
+		//Collect what the program needs (the value and the mode need the unit, the rate needs the value):
+		switch (trigger->instructions[i].opcode)
+		{
+		case OW_TRIGGER_OP_RATE:
+			trigger->needs |= OW_TRIGGER_NEED_RATE | OW_TRIGGER_NEED_VALUE | OW_TRIGGER_NEED_UNIT;
+			trigger->quantities |= 1u << trigger->instructions[i].quantity;
+			break;
+
+		case OW_TRIGGER_OP_THRESHOLD:
+			trigger->needs |= OW_TRIGGER_NEED_VALUE | OW_TRIGGER_NEED_UNIT;
+			trigger->quantities |= 1u << trigger->instructions[i].quantity;
+			break;
+
+		case OW_TRIGGER_OP_MODE:
+			trigger->needs |= OW_TRIGGER_NEED_MODE | OW_TRIGGER_NEED_UNIT;
+			break;
+
+		case OW_TRIGGER_OP_UNIT:
+			trigger->needs |= OW_TRIGGER_NEED_UNIT;
+			break;
+
+		case OW_TRIGGER_OP_FLAGS:
+			break;
+		}
+	}
+
+	return trigger;
+}
+
+void ow_trigger_reset(ow_trigger_t* trigger)
+{
+	for (size_t i = 0; i < trigger->count; i++)
+	{
+		trigger->instructions[i].state = OW_TRIGGER_STATE_UNKNOWN;
+	}
+
+	trigger->has_previous = false;
+	trigger->previous_flags = 0;
+	trigger->has_previous_value = false;
+}
+
+bool ow_trigger_evaluate(ow_trigger_t* trigger, const ow_sample_t* sample, ow_trigger_func_t callback, void* context)
+{
+	ow_trigger_input_t input =
+	{
+		.unit = sample->unit,
+		.mode = ow_trigger_mode(ow_unit_to_quantity(sample->unit), sample->current_type, sample->is_diode_test, sample->is_continuity_test, sample->is_relative),
+		.flags = (sample->is_data_hold ? OW_TRIGGER_FLAG_DATA_HOLD : 0) | (sample->is_relative ? OW_TRIGGER_FLAG_RELATIVE : 0) | (sample->is_auto_range ? OW_TRIGGER_FLAG_AUTO_RANGE : 0) |
+			(sample->is_low_battery ? OW_TRIGGER_FLAG_LOW_BATTERY : 0) | (sample->is_overflow ? OW_TRIGGER_FLAG_OVERFLOW : 0),
+		.timestamp = sample->timestamp
+	};
+
+	//The sample is decoded already, so only the conversions are left:
+	if (trigger->needs & OW_TRIGGER_NEED_VALUE)
+	{
+		ow_trigger_input_value(trigger, &input, sample, NULL);
+	}
+
+	if (trigger->needs & OW_TRIGGER_NEED_RATE)
+	{
+		ow_trigger_input_rate(trigger, &input);
+	}
+
+	return ow_trigger_run(trigger, &input, sample, NULL, callback, context);
+}
+
+bool ow_recv_trigger(const ow_config_t* config, ow_trigger_t* trigger, ow_trigger_func_t callback, void* context)
+{
+	ow_trigger_recv_context_t recv_context =
+	{
+		.trigger = trigger,
+		.callback = callback,
+		.context = context
+	};
+
+	return ow_recv_view(config, ow_trigger_view_func, &recv_context);
+}
+
+bool ow_recv_trigger_source(const ow_source_t* source, ow_trigger_t* trigger, ow_trigger_func_t callback, void* context)
+{
+	ow_trigger_recv_context_t recv_context =
+	{
+		.trigger = trigger,
+		.callback = callback,
+		.context = context
+	};
+
+	return ow_recv_view_source(source, ow_trigger_view_func, &recv_context);
+}
+
+void ow_trigger_destroy(ow_trigger_t* trigger)
+{
+	free(trigger->instructions);
+	free(trigger);
+}